@@ -0,0 +1,120 @@
+// Whole-frame cost of the preprocessing backends: processFrame() latency
+// (upload, resize + convert, map, copy out, one frame at a time) and the
+// throughput of keeping range(2) frames in flight with submitFrame() /
+// waitMappedFrame(), as the pipeline does. The OpenCL driver runs on the
+// first device of any type (pocl on a machine without a GPU); the CPU
+// backend is the reference.
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "cpu_backend.hpp"
+#include "opencl_driver.hpp"
+
+namespace
+{
+const size_t SLOTS = 4;
+
+PreprocessBackend *openCL()
+{
+    static std::unique_ptr<OpenCLDriver> driver = []
+    {
+        std::vector<cl_device_id> devices = OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL);
+        return devices.empty() ? nullptr : std::make_unique<OpenCLDriver>(devices.front(), SLOTS);
+    }();
+    return driver.get();
+}
+
+PreprocessBackend *cpu()
+{
+    static CpuBackend backend(0, CpuIsa::Auto, SLOTS);
+    return &backend;
+}
+
+// 16:9 frames, range(0) source rows -> range(1) output rows
+cv::Mat sourceFrame(const benchmark::State &state, int &dstW, int &dstH)
+{
+    int srcH = static_cast<int>(state.range(0));
+    dstH = static_cast<int>(state.range(1));
+    dstW = dstH * 16 / 9;
+    cv::Mat input(srcH, srcH * 16 / 9, CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+    return input;
+}
+
+void processFrame(benchmark::State &state, PreprocessBackend *backend)
+{
+    if (!backend)
+    {
+        state.SkipWithError("no OpenCL device");
+        return;
+    }
+    int dstW, dstH;
+    cv::Mat input = sourceFrame(state, dstW, dstH);
+    backend->setResizeFilter(ResizeFilter::Fast);
+    std::vector<uint8_t> yuv;
+    for (auto _ : state)
+    {
+        backend->processFrame(input, yuv, dstW, dstH);
+        benchmark::DoNotOptimize(yuv.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(backend->name());
+}
+
+void pipelined(benchmark::State &state, PreprocessBackend *backend)
+{
+    if (!backend)
+    {
+        state.SkipWithError("no OpenCL device");
+        return;
+    }
+    int dstW, dstH;
+    cv::Mat input = sourceFrame(state, dstW, dstH);
+    backend->setResizeFilter(ResizeFilter::Fast);
+    const int64_t depth = state.range(2);
+    const int64_t FRAMES = 32;
+    std::vector<PreprocessBackend::FrameTicket> tickets(depth); // ring, oldest at waited % depth
+    for (auto _ : state)
+    {
+        int64_t submitted = 0, waited = 0;
+        while (waited < FRAMES)
+        {
+            if (submitted < FRAMES && submitted - waited < depth)
+                tickets[submitted++ % depth] = backend->submitFrame(input, dstW, dstH);
+            else
+            {
+                YuvFrame frame = backend->waitMappedFrame(tickets[waited++ % depth]);
+                benchmark::DoNotOptimize(frame.data());
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * FRAMES);
+    state.SetLabel(backend->name());
+}
+
+void BM_OpenCLProcessFrame(benchmark::State &state) { processFrame(state, openCL()); }
+void BM_CpuProcessFrame(benchmark::State &state) { processFrame(state, cpu()); }
+void BM_OpenCLPipelined(benchmark::State &state) { pipelined(state, openCL()); }
+void BM_CpuPipelined(benchmark::State &state) { pipelined(state, cpu()); }
+
+void latencySizes(benchmark::internal::Benchmark *b)
+{
+    b->Args({720, 360})->Args({1080, 540})->Args({2160, 1080});
+}
+
+void pipelinedSizes(benchmark::internal::Benchmark *b)
+{
+    for (int64_t depth : {1, 2, 4})
+        b->Args({1080, 540, depth});
+}
+} // namespace
+
+BENCHMARK(BM_OpenCLProcessFrame)->Apply(latencySizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CpuProcessFrame)->Apply(latencySizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_OpenCLPipelined)->Apply(pipelinedSizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CpuPipelined)->Apply(pipelinedSizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,78 @@
+// Encoder::encodeFrame() throughput into ffmpeg's null muxer, so only the
+// x264 encode (and, in pipe mode, the pipe to the child process) is
+// measured. Frames are a moving gradient with noise, generated once in
+// memory; range(0) is the output height of 16:9 frames. The encoder is
+// opened once per benchmark, so process start-up and the final flush are
+// not included.
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "encoder.hpp"
+
+namespace
+{
+const int FRAMES = 16;
+
+std::vector<std::vector<uint8_t>> syntheticFrames(int width, int height)
+{
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> noise(-8, 8);
+    std::vector<std::vector<uint8_t>> frames(FRAMES);
+    for (int f = 0; f < FRAMES; ++f)
+    {
+        std::vector<uint8_t> &frame = frames[f];
+        frame.resize((size_t)width * height * 3 / 2);
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                frame[(size_t)y * width + x] = (uint8_t)(((x + y + 4 * f) & 0xff) / 2 + 64 + noise(rng));
+        std::fill(frame.begin() + (size_t)width * height, frame.end(), 128);
+    }
+    return frames;
+}
+
+void encode(benchmark::State &state, EncoderOptions::Backend backend)
+{
+    int height = static_cast<int>(state.range(0));
+    int width = height * 16 / 9 / 2 * 2;
+    std::vector<std::vector<uint8_t>> frames = syntheticFrames(width, height);
+
+    EncoderOptions options;
+    options.backend = backend;
+    options.container = "null";
+    std::unique_ptr<Encoder> encoder;
+    try
+    {
+        encoder = std::make_unique<Encoder>("-", width, height, 30.0, options);
+    }
+    catch (const std::exception &ex)
+    {
+        state.SkipWithError(ex.what());
+        return;
+    }
+
+    size_t next = 0;
+    for (auto _ : state)
+    {
+        encoder->encodeFrame(frames[next]);
+        next = (next + 1) % frames.size();
+    }
+    encoder->finish();
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * (int64_t)frames[0].size());
+    state.SetLabel(encoder->backendName());
+}
+
+void BM_EncodePipe(benchmark::State &state) { encode(state, EncoderOptions::Backend::Pipe); }
+void BM_EncodeLibav(benchmark::State &state) { encode(state, EncoderOptions::Backend::Libav); }
+} // namespace
+
+BENCHMARK(BM_EncodePipe)->Arg(360)->Arg(720)->Arg(1080)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EncodeLibav)->Arg(360)->Arg(720)->Arg(1080)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
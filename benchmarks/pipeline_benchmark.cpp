@@ -0,0 +1,101 @@
+// End-to-end frames per second of runPipeline(): decode -> preprocess ->
+// encode into ffmpeg's null muxer. The input is a synthetic 720p clip,
+// generated once and written to the temp directory as MJPEG, since
+// VideoReader reads files. range(0) is VideoReader's read-ahead depth, so
+// the effect of decoding ahead shows up next to decoding on the reader
+// thread.
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+#include "cpu_backend.hpp"
+#include "encoder.hpp"
+#include "opencl_driver.hpp"
+#include "pipeline.hpp"
+#include "video_reader.hpp"
+
+namespace
+{
+const int INPUT_W = 1280, INPUT_H = 720, FRAMES = 120;
+
+// Path of the synthetic clip, or empty if it cannot be written
+const std::string &syntheticInput()
+{
+    static const std::string path = []
+    {
+        std::string file = (std::filesystem::temp_directory_path() / "pipeline_benchmark_input.avi").string();
+        cv::VideoWriter writer(file, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 30.0, cv::Size(INPUT_W, INPUT_H));
+        if (!writer.isOpened())
+            return std::string();
+        cv::Mat frame(INPUT_H, INPUT_W, CV_8UC3);
+        for (int i = 0; i < FRAMES; ++i)
+        {
+            // Moving bars, so the encoder sees motion
+            for (int y = 0; y < INPUT_H; ++y)
+            {
+                uint8_t *row = frame.ptr<uint8_t>(y);
+                for (int x = 0; x < INPUT_W * 3; ++x)
+                    row[x] = (uint8_t)(((x / 3 + 8 * i) / 32 % 2 ? 160 : 40) + y / 16);
+            }
+            writer.write(frame);
+        }
+        return file;
+    }();
+    return path;
+}
+
+void transcode(benchmark::State &state, PreprocessBackend *backend)
+{
+    if (!backend)
+    {
+        state.SkipWithError("no OpenCL device");
+        return;
+    }
+    const std::string &input = syntheticInput();
+    if (input.empty())
+    {
+        state.SkipWithError("cannot write the synthetic input");
+        return;
+    }
+    VideoReader::Options readerOptions;
+    readerOptions.readAhead = static_cast<size_t>(state.range(0));
+    EncoderOptions encoderOptions;
+    encoderOptions.container = "null";
+    PipelineOptions options;
+    options.outWidth = INPUT_W / 2;
+    options.outHeight = INPUT_H / 2;
+
+    size_t frames = 0;
+    for (auto _ : state)
+    {
+        VideoReader reader(input, readerOptions);
+        Encoder encoder("-", options.outWidth, options.outHeight, reader.getFPS(), encoderOptions);
+        frames += runPipeline(reader, *backend, encoder, options).framesProcessed;
+    }
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(frames), benchmark::Counter::kIsRate);
+    state.SetLabel(backend->name());
+}
+
+void BM_PipelineCpu(benchmark::State &state)
+{
+    static CpuBackend backend;
+    transcode(state, &backend);
+}
+
+void BM_PipelineOpenCL(benchmark::State &state)
+{
+    static std::unique_ptr<OpenCLDriver> driver = []
+    {
+        std::vector<cl_device_id> devices = OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL);
+        return devices.empty() ? nullptr : std::make_unique<OpenCLDriver>(devices.front());
+    }();
+    transcode(state, driver.get());
+}
+} // namespace
+
+BENCHMARK(BM_PipelineCpu)->Arg(0)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PipelineOpenCL)->Arg(0)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
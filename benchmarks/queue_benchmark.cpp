@@ -0,0 +1,113 @@
+// Producer/consumer throughput of the stage queues: one thread pushes
+// ITEMS_PER_RUN items, another pops them, for several queue capacities.
+// BoundedQueue is also measured with several producers and consumers, as
+// the multi-worker pipeline uses it.
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "spsc_ring.hpp"
+
+namespace
+{
+const int64_t ITEMS_PER_RUN = 1 << 18;
+
+template <typename Queue>
+void transfer(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        Queue queue(static_cast<size_t>(state.range(0)));
+        std::thread producer([&]
+                             {
+            for (int64_t i = 0; i < ITEMS_PER_RUN; ++i)
+                queue.push(i);
+            queue.close(); });
+
+        int64_t item = 0;
+        int64_t sum = 0;
+        while (queue.pop(item))
+            sum += item;
+        producer.join();
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * ITEMS_PER_RUN);
+}
+
+void BM_BoundedQueue(benchmark::State &state) { transfer<BoundedQueue<int64_t>>(state); }
+void BM_SpscRing(benchmark::State &state) { transfer<SpscRing<int64_t>>(state); }
+
+// Same transfer with push_batch/pop_batch moving up to 16 items per index
+// update
+void BM_SpscRingBatch(benchmark::State &state)
+{
+    const int64_t BATCH = 16;
+    for (auto _ : state)
+    {
+        SpscRing<int64_t> queue(static_cast<size_t>(state.range(0)));
+        std::thread producer([&]
+                             {
+            int64_t items[BATCH];
+            for (int64_t i = 0; i < ITEMS_PER_RUN; i += BATCH) {
+                for (int64_t k = 0; k < BATCH; ++k)
+                    items[k] = i + k;
+                queue.push_batch(items, BATCH);
+            }
+            queue.close(); });
+
+        int64_t items[BATCH];
+        int64_t sum = 0;
+        while (size_t n = queue.pop_batch(items, BATCH))
+            for (size_t k = 0; k < n; ++k)
+                sum += items[k];
+        producer.join();
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * ITEMS_PER_RUN);
+}
+
+// range(0) producers and range(1) consumers sharing one queue of capacity
+// range(2); the producers split ITEMS_PER_RUN between them
+void BM_BoundedQueueMany(benchmark::State &state)
+{
+    const int64_t producers = state.range(0), consumers = state.range(1);
+    for (auto _ : state)
+    {
+        BoundedQueue<int64_t> queue(static_cast<size_t>(state.range(2)));
+        std::vector<std::thread> producerThreads, consumerThreads;
+        std::vector<int64_t> sums(consumers, 0);
+        for (int64_t c = 0; c < consumers; ++c)
+            consumerThreads.emplace_back([&, c]
+                                         {
+                int64_t item = 0, sum = 0;
+                while (queue.pop(item))
+                    sum += item;
+                sums[c] = sum; });
+        for (int64_t p = 0; p < producers; ++p)
+            producerThreads.emplace_back([&, p]
+                                         {
+                for (int64_t i = p; i < ITEMS_PER_RUN; i += producers)
+                    queue.push(i); });
+        for (std::thread &producer : producerThreads)
+            producer.join();
+        queue.close();
+        for (std::thread &consumer : consumerThreads)
+            consumer.join();
+        benchmark::DoNotOptimize(sums.data());
+    }
+    state.SetItemsProcessed(state.iterations() * ITEMS_PER_RUN);
+}
+} // namespace
+
+BENCHMARK(BM_BoundedQueue)->Arg(4)->Arg(64)->Arg(1024)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SpscRing)->Arg(4)->Arg(64)->Arg(1024)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SpscRingBatch)->Arg(4)->Arg(64)->Arg(1024)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BoundedQueueMany)
+    ->ArgsProduct({{1, 2, 4}, {1, 2, 4}, {4, 64}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
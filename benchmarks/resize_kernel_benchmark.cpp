@@ -0,0 +1,104 @@
+// Resize kernels on the first OpenCL device of any type (pocl on a machine
+// without a GPU): the fast filter's direct kernel against the tiled
+// local-memory kernel, the two-pass polyphase kernels, and the plane-wise
+// kernels for I420 sources, per source/output size. Each iteration uploads
+// one frame, runs the kernels and maps the I420 result; variants with the
+// same source format pay the same transfers, so the difference in bytes/s
+// is the kernels' memory traffic. Equal source and output rows leave only
+// the BGR->I420 conversion.
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <opencv2/core.hpp>
+
+#include "opencl_driver.hpp"
+
+namespace
+{
+OpenCLDriver *device()
+{
+    static std::unique_ptr<OpenCLDriver> driver = []
+    {
+        std::vector<cl_device_id> devices = OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL);
+        return devices.empty() ? nullptr : std::make_unique<OpenCLDriver>(devices.front(), 2);
+    }();
+    return driver.get();
+}
+
+void resize(benchmark::State &state, OpenCLDriver::FastKernel kernel)
+{
+    OpenCLDriver *driver = device();
+    if (!driver)
+    {
+        state.SkipWithError("no OpenCL device");
+        return;
+    }
+    // 16:9 frames, range(0) source rows -> range(1) output rows
+    int srcH = static_cast<int>(state.range(0)), dstH = static_cast<int>(state.range(1));
+    int srcW = srcH * 16 / 9, dstW = dstH * 16 / 9;
+    driver->setResizeFilter(ResizeFilter::Fast);
+    driver->setFastKernel(kernel);
+    if (kernel == OpenCLDriver::FastKernel::Tiled && !driver->usesTiledKernel(srcW, srcH, dstW, dstH))
+    {
+        state.SkipWithError("tile does not fit in local memory");
+        return;
+    }
+
+    cv::Mat input(srcH, srcW, CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+    for (auto _ : state)
+    {
+        YuvFrame frame = driver->waitMappedFrame(driver->submitFrame(input, dstW, dstH));
+        benchmark::DoNotOptimize(frame.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)(input.total() * 3 + (size_t)dstW * dstH * 3 / 2));
+    state.SetLabel(OpenCLDriver::deviceName(OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL).front()));
+}
+
+// Polyphase filters and I420 sources; range(0)/range(1) as above
+void resizeWith(benchmark::State &state, ResizeFilter filter, bool planar)
+{
+    OpenCLDriver *driver = device();
+    if (!driver)
+    {
+        state.SkipWithError("no OpenCL device");
+        return;
+    }
+    int srcH = static_cast<int>(state.range(0)), dstH = static_cast<int>(state.range(1));
+    int srcW = srcH * 16 / 9, dstW = dstH * 16 / 9;
+    driver->setResizeFilter(filter);
+    driver->setFastKernel(OpenCLDriver::FastKernel::Direct);
+
+    cv::Mat input(planar ? srcH * 3 / 2 : srcH, srcW, planar ? CV_8UC1 : CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+    for (auto _ : state)
+    {
+        YuvFrame frame = driver->waitMappedFrame(driver->submitFrame(input, dstW, dstH));
+        benchmark::DoNotOptimize(frame.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)(input.total() * input.elemSize() +
+                                                           (size_t)dstW * dstH * 3 / 2));
+    state.SetLabel(resizeFilterName(filter));
+}
+
+void BM_DirectKernel(benchmark::State &state) { resize(state, OpenCLDriver::FastKernel::Direct); }
+void BM_TiledKernel(benchmark::State &state) { resize(state, OpenCLDriver::FastKernel::Tiled); }
+void BM_BicubicKernel(benchmark::State &state) { resizeWith(state, ResizeFilter::Bicubic, false); }
+void BM_AreaKernel(benchmark::State &state) { resizeWith(state, ResizeFilter::Area, false); }
+void BM_PlanarFastKernel(benchmark::State &state) { resizeWith(state, ResizeFilter::Fast, true); }
+void BM_PlanarAreaKernel(benchmark::State &state) { resizeWith(state, ResizeFilter::Area, true); }
+
+void sizes(benchmark::internal::Benchmark *b)
+{
+    b->Args({1080, 540})->Args({1080, 720})->Args({2160, 1080})->Args({720, 1080})->Args({1080, 1080});
+}
+} // namespace
+
+BENCHMARK(BM_DirectKernel)->Apply(sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TiledKernel)->Apply(sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BicubicKernel)->Apply(sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AreaKernel)->Apply(sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PlanarFastKernel)->Apply(sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PlanarAreaKernel)->Apply(sizes)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -46,6 +46,7 @@ private:
     QLabel *inputLabel;
     QLabel *outputLabel;
     QComboBox *presetBox;
+    QComboBox *sizeBox;
     QSlider *crfSlider;
     QLabel *crfValue;
     QPushButton *startBtn;
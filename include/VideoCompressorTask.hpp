@@ -8,7 +8,15 @@ class VideoCompressorTask : public QObject
 public:
   explicit VideoCompressorTask(QObject *parent = nullptr);
   ~VideoCompressorTask();
-  void compress(const QString &in, const QString &out, int crf, int preset, QString *err);
+  // targetHeight 0 keeps the half-size output; otherwise the width follows
+  // the input's aspect ratio.
+  void compress(const QString &in, const QString &out, int crf, int preset, int targetHeight, QString *err);
+
+  // Build the preprocessing backend (OpenCL init + kernel build) on a
+  // background thread so the first job does not pay for it. Jobs reuse the
+  // same backend; shutdownBackend() frees it before the app exits.
+  static void prewarmBackend();
+  static void shutdownBackend();
 
 signals:
   void progress(double percent, double elapsed, double eta);
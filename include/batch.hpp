@@ -0,0 +1,87 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "encoder.hpp"
+#include "pipeline.hpp"
+#include "video_reader.hpp"
+
+class PreprocessBackend;
+
+struct BatchItem
+{
+    std::string input;
+    std::string output;
+};
+
+// Expand a batch spec into input/output pairs:
+//  - a glob such as clips/*.mp4 (wildcards * and ? in the file name only),
+//  - a directory (every regular file in it), or
+//  - a manifest file with one input per line, optionally followed by a tab
+//    and an explicit output path; blank lines and lines starting with #
+//    are skipped.
+// Outputs without an explicit path go to outputDir as <input stem>.mp4.
+// Results are sorted by input for globs and directories, in file order for
+// manifests. Throws std::invalid_argument if the spec matches nothing or
+// two items would write the same output or overwrite an input.
+std::vector<BatchItem> loadBatch(const std::string &spec, const std::string &outputDir);
+
+// Files to run at once when the user gives no limit: enough that the
+// encoders use every core, at most two streams per OpenCL GPU (one
+// uploading while the other computes), and never more than the files.
+size_t defaultBatchJobs(const std::string &backendName, size_t files);
+
+struct BatchFileStats
+{
+    BatchItem item;
+    bool ok = false;
+    std::string error;
+    size_t frames = 0;
+    double totalSec = 0.0;
+    uintmax_t inBytes = 0;
+    uintmax_t outBytes = 0;
+};
+
+struct BatchStats
+{
+    size_t failed = 0;
+    size_t frames = 0;
+    double totalSec = 0.0;
+    uintmax_t inBytes = 0;
+    uintmax_t outBytes = 0;
+    std::vector<BatchFileStats> files; // in batch order
+
+    double filesPerHour() const { return totalSec > 0.0 ? 3600.0 * (files.size() - failed) / totalSec : 0.0; }
+    double fps() const { return totalSec > 0.0 ? frames / totalSec : 0.0; }
+};
+
+struct BatchOptions
+{
+    PipelineOptions pipeline; // outWidth/outHeight are set per file
+    EncoderOptions encoder;
+    // Requested output size, resolved per file by computeOutputSize()
+    int width = 0;
+    int height = 0;
+    bool keepAspect = false;
+    VideoReader::Options reader; // how each file is decoded
+    // Called from a job thread after each file, successful or not
+    std::function<void(const BatchFileStats &)> onFileDone;
+};
+
+// Transcode one item on backend; errors are caught and recorded in the
+// result. onFileDone is not called.
+BatchFileStats transcodeItem(const BatchItem &item, PreprocessBackend &backend, const BatchOptions &options);
+
+// Transcode every item. Runs one file per backend at a time, so
+// backends.size() is the concurrency limit; each backend (and its compiled
+// program and device buffers) is reused for every file its job picks up.
+// A failing file is recorded and the batch moves on.
+BatchStats runBatch(const std::vector<BatchItem> &items,
+                    const std::vector<PreprocessBackend *> &backends,
+                    const BatchOptions &options);
+
+#endif // BATCH_HPP
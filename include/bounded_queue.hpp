@@ -1,26 +1,44 @@
 #ifndef BOUNDED_QUEUE_HPP
 #define BOUNDED_QUEUE_HPP
 
-#include <queue>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
+#include <utility>
 
+// Items live in a ring allocated up front, so pushing and popping never
+// touch the heap.
 template <typename T>
 class BoundedQueue
 {
 public:
   explicit BoundedQueue(size_t maxSize)
-      : maxSize_(maxSize), closed_(false) {}
+      : slots_(maxSize > 0 ? maxSize : 1), maxSize_(slots_.size()), closed_(false) {}
 
   // Push an item. Returns false if the queue is closed.
   bool push(const T &item)
   {
     std::unique_lock<std::mutex> lock(mtx_);
     cond_not_full_.wait(lock, [this]
-                        { return queue_.size() < maxSize_ || closed_; });
+                        { return size_ < maxSize_ || closed_; });
     if (closed_)
       return false;
-    queue_.push(item);
+    slots_[(head_ + size_) % maxSize_] = item;
+    ++size_;
+    cond_not_empty_.notify_one();
+    return true;
+  }
+
+  // Move overload for move-only items such as frame handles.
+  bool push(T &&item)
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_not_full_.wait(lock, [this]
+                        { return size_ < maxSize_ || closed_; });
+    if (closed_)
+      return false;
+    slots_[(head_ + size_) % maxSize_] = std::move(item);
+    ++size_;
     cond_not_empty_.notify_one();
     return true;
   }
@@ -30,11 +48,25 @@ public:
   {
     std::unique_lock<std::mutex> lock(mtx_);
     cond_not_empty_.wait(lock, [this]
-                         { return !queue_.empty() || closed_; });
-    if (queue_.empty())
+                         { return size_ > 0 || closed_; });
+    if (size_ == 0)
+      return false;
+    item = std::move(slots_[head_]);
+    head_ = (head_ + 1) % maxSize_;
+    --size_;
+    cond_not_full_.notify_one();
+    return true;
+  }
+
+  // Non-blocking pop. Returns false if nothing is queued right now.
+  bool try_pop(T &item)
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (size_ == 0)
       return false;
-    item = std::move(queue_.front());
-    queue_.pop();
+    item = std::move(slots_[head_]);
+    head_ = (head_ + 1) % maxSize_;
+    --size_;
     cond_not_full_.notify_one();
     return true;
   }
@@ -51,7 +83,9 @@ public:
   }
 
 private:
-  std::queue<T> queue_;
+  std::vector<T> slots_;
+  size_t head_ = 0;
+  size_t size_ = 0;
   std::mutex mtx_;
   std::condition_variable cond_not_empty_;
   std::condition_variable cond_not_full_;
@@ -0,0 +1,58 @@
+#ifndef COLOR_SPACE_HPP
+#define COLOR_SPACE_HPP
+
+#include <cstdint>
+#include <string>
+
+// Y'CbCr matrix and range of the I420 frames the backends produce; the
+// encoder tags its output with the same values.
+enum class ColorMatrix
+{
+    BT601, // SD (SMPTE 170M)
+    BT709  // HD
+};
+
+enum class ColorRange
+{
+    Limited, // Y 16..235, chroma 16..240 ("tv"); what players assume
+    Full     // 0..255 ("pc", JPEG)
+};
+
+struct ColorSpace
+{
+    ColorMatrix matrix = ColorMatrix::BT601;
+    ColorRange range = ColorRange::Limited;
+
+    bool operator==(const ColorSpace &o) const { return matrix == o.matrix && range == o.range; }
+    bool operator!=(const ColorSpace &o) const { return !(*this == o); }
+};
+
+const char *colorMatrixName(ColorMatrix matrix);
+const char *colorRangeName(ColorRange range);
+// Throw std::invalid_argument for unknown names.
+ColorMatrix parseColorMatrix(const std::string &name);
+ColorRange parseColorRange(const std::string &name);
+
+// Fixed-point BGR -> Y'CbCr with COLOR_COEFF_BITS fractional bits:
+//   Y = (yR * R + yG * G + yB * B + yBias) >> 14 for every pixel,
+//   U = (uR * sumR + uG * sumG + uB * sumB + uvBias) >> 16 and V likewise,
+// where the sums run over the four pixels of a 2x2 block; all results are
+// clamped to 0..255. The luma coefficients sum to the range's scale and
+// the chroma ones to zero, so white and grey map exactly. The values are
+// the same constants opencl_preprocess.cl selects from its build options.
+const int COLOR_COEFF_BITS = 14;
+
+struct ColorCoefficients
+{
+    int32_t yR, yG, yB, yBias;
+    int32_t uR, uG, uB;
+    int32_t vR, vG, vB;
+    int32_t uvBias;
+};
+
+const ColorCoefficients &colorCoefficients(ColorSpace space);
+
+// OpenCL build options that select this matrix and range in the kernels.
+std::string colorBuildOptions(ColorSpace space);
+
+#endif // COLOR_SPACE_HPP
@@ -0,0 +1,138 @@
+#ifndef CPU_BACKEND_HPP
+#define CPU_BACKEND_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_kernels.hpp"
+#include "preprocess_backend.hpp"
+#include "resize_filter.hpp"
+#include "yuv_frame.hpp"
+
+// Native CPU implementation of the resize + BGR->I420 step, for hosts
+// without a usable OpenCL GPU. Row kernels are hand-vectorized for SSE4.1,
+// AVX2 and AVX-512 and picked at runtime from CPUID; output rows are split
+// into bands processed on a persistent pool of worker threads.
+//
+// The fast filter is done separably (vertical, then horizontal), so results
+// can differ from resize_bgr_to_i420 in opencl_preprocess.cl by float
+// rounding: every Y, U and V sample is within +/-1 LSB of the kernel's
+// output. Polyphase filters use the same fixed-point tables and pass order
+// as the OpenCL kernels, so their resampled pixels match exactly. Planar
+// I420 sources are resized plane by plane like resize_plane and the
+// resize_plane_polyphase kernels.
+class CpuBackend : public PreprocessBackend, public FrameOwner
+{
+public:
+    // threads: worker count including the caller, 0 = hardware concurrency.
+    // isa: CpuIsa::Auto picks the widest instruction set the CPU supports;
+    // an explicit ISA the CPU lacks throws std::runtime_error.
+    explicit CpuBackend(size_t threads = 0, CpuIsa isa = CpuIsa::Auto, size_t slots = 4);
+    ~CpuBackend();
+
+    std::string name() const override;
+    size_t slotCount() const override { return slots_.size(); }
+
+    // Frames are processed inside submitFrame(), so the input may be reused
+    // as soon as it returns.
+    FrameTicket submitFrame(const cv::Mat &input, int targetWidth, int targetHeight) override;
+    YuvFrame waitMappedFrame(FrameTicket ticket) override;
+    void releaseFrame(size_t slot) override;
+
+    CpuIsa isa() const { return kernels_->isa; }
+
+    // Widest instruction set usable on this machine.
+    static CpuIsa detectIsa();
+    static const char *isaName(CpuIsa isa);
+
+private:
+    enum class SlotState
+    {
+        Free,
+        Done,  // processed, ticket not yet waited on
+        Mapped // handed out as a YuvFrame
+    };
+
+    struct FrameSlot
+    {
+        std::vector<uint8_t> yuv;
+        SlotState state = SlotState::Free;
+    };
+
+    // Source taps and weights per output column / row; recomputed only when
+    // the geometry or filter changes.
+    struct ResizeTables
+    {
+        int srcW = 0, srcH = 0, dstW = 0, dstH = 0;
+        ResizeFilter filter = ResizeFilter::Fast;
+        bool planar = false; // I420 source; chromaTables_ holds the U/V planes
+        // Fast filter
+        std::vector<int> x0, x1, y0, y1;
+        std::vector<float> fx, fy;
+        // Polyphase filters
+        ResizeCoefficients h, v;
+    };
+
+    // Per-thread working rows
+    struct Scratch
+    {
+        std::vector<float> vertical;      // one vertically blended source row
+        std::vector<float> planes[2][3]; // [row][B,G,R] resampled pixels
+        std::vector<int32_t> accum;       // polyphase vertical sums, BGR interleaved
+    };
+
+    // Polyphase filters run in two band passes over the frame
+    enum class BandPass
+    {
+        Horizontal, // source rows -> horizontal_
+        Output      // horizontal_ (or the source, for Fast) -> I420
+    };
+
+    const CpuKernelTable *kernels_;
+    std::vector<FrameSlot> slots_;
+    FrameTicket nextTicket_ = 0;
+    FrameTicket nextWait_ = 0;
+    std::mutex slotMutex_;
+    std::condition_variable slotReleased_;
+
+    ResizeTables tables_;
+    ResizeTables chromaTables_; // half-size planes of planar sources
+    std::vector<Scratch> scratch_;
+    std::vector<uint8_t> horizontal_; // dstW x srcH BGR (or I420 planes) after the horizontal pass
+
+    // Worker pool: runBands() hands out band indices of the current frame
+    // through nextBand_; the caller thread works on bands too.
+    std::vector<std::thread> workers_;
+    std::mutex poolMutex_;
+    std::condition_variable poolWake_;
+    std::condition_variable poolDone_;
+    const cv::Mat *bandInput_ = nullptr;
+    uint8_t *bandOutput_ = nullptr;
+    std::atomic<int> nextBand_{0};
+    int bandCount_ = 0;
+    BandPass bandPass_ = BandPass::Output;
+    int busyWorkers_ = 0;
+    uint64_t generation_ = 0;
+    bool stopping_ = false;
+
+    static void fillTables(ResizeTables &t, int srcW, int srcH, int dstW, int dstH, ResizeFilter filter);
+    void ensureTables(int srcW, int srcH, int dstW, int dstH, ResizeFilter filter, bool planar);
+    void processBand(int band, Scratch &scratch);
+    void processRows(const cv::Mat &src, uint8_t *dst, int blockRowBegin, int blockRowEnd, Scratch &scratch);
+    void resampleRow(const cv::Mat &src, int dy, Scratch &scratch, int row);
+    void horizontalRows(const cv::Mat &src, int rowBegin, int rowEnd);
+    void verticalRow(int dy, Scratch &scratch, int row);
+    // Planar sources: plane index of a stacked Y/U/V row, made plane-relative
+    int planeOfRow(int &row, int lumaRows) const;
+    void planeHorizontalRows(const cv::Mat &src, int rowBegin, int rowEnd);
+    void planeRows(const cv::Mat &src, uint8_t *dst, int rowBegin, int rowEnd, Scratch &scratch);
+    void runBands(const cv::Mat &input, uint8_t *output, int bands, BandPass pass);
+    void drainBands(Scratch &scratch);
+    void workerLoop(size_t index);
+};
+
+#endif // CPU_BACKEND_HPP
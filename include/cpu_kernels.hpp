@@ -0,0 +1,65 @@
+#ifndef CPU_KERNELS_HPP
+#define CPU_KERNELS_HPP
+
+#include <cstdint>
+
+#include "color_space.hpp"
+
+// Row kernels behind CpuBackend. Each SIMD variant lives in its own
+// translation unit compiled with that instruction set enabled, and is only
+// called after CPUID reports support for it.
+
+enum class CpuIsa
+{
+    Auto,
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+// Two output rows of resampled pixels in planar float form. Values are
+// already quantized to whole numbers in 0..255, matching the uchar
+// intermediate of the OpenCL kernel.
+struct PlanarRowPair
+{
+    const float *b[2];
+    const float *g[2];
+    const float *r[2];
+};
+
+struct CpuKernelTable
+{
+    CpuIsa isa;
+
+    // Vertical bilinear pass: dst[i] = a[i] * (1 - fy) + b[i] * fy, i < n.
+    void (*blendRows)(const uint8_t *a, const uint8_t *b, float fy, float *dst, int n);
+
+    // Horizontal bilinear pass for output columns dx < n: blends the BGR
+    // pixels x0[dx] and x1[dx] of an interleaved float row by fx[dx],
+    // clamps to 0..255 and truncates into the planar rows b, g, r. Returns
+    // the number of columns handled; SIMD variants may leave a tail for the
+    // scalar version.
+    int (*lerpColumns)(const float *row, const int *x0, const int *x1, const float *fx, int n,
+                       float *b, float *g, float *r);
+
+    // BGR -> I420 for the first `blocks` 2x2 blocks of a row pair with the
+    // fixed-point coefficients k: writes 2 * blocks luma samples per row and
+    // one U/V sample per block. Returns the number of blocks handled; SIMD
+    // variants may leave a tail for the scalar version.
+    int (*convertBlocks)(const PlanarRowPair &rows, int blocks, const ColorCoefficients &k,
+                         uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v);
+};
+
+const CpuKernelTable &cpuKernelsScalar();
+#ifdef CPU_BACKEND_X86
+const CpuKernelTable &cpuKernelsSSE41();
+const CpuKernelTable &cpuKernelsAVX2();
+const CpuKernelTable &cpuKernelsAVX512();
+#endif
+
+// Luma for a single row of planar pixels (odd trailing rows/columns, which
+// carry no chroma in I420).
+void cpuLumaRow(const float *b, const float *g, const float *r, int n, const ColorCoefficients &k, uint8_t *y);
+
+#endif // CPU_KERNELS_HPP
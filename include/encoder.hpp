@@ -3,23 +3,89 @@
 #include <vector>
 #include <cstdint>
 #include <cstdio>
+#include <functional>
+#include <memory>
+
+#include "color_space.hpp"
+
+// What one encodeFrame() call cost and produced. Encoders with lookahead
+// emit packets later than the frame that caused them, so packets and bytes
+// are those written during this call, not necessarily for this frame.
+struct EncodedFrameInfo
+{
+    uint64_t frameIndex = 0;
+    double encodeSec = 0.0;
+    size_t packets = 0;
+    size_t packetBytes = 0;
+};
+
+struct EncoderStats
+{
+    uint64_t frames = 0;
+    uint64_t packets = 0; // 0 in pipe mode, where packets are not visible
+    uint64_t bytes = 0;
+    double encodeSec = 0.0;
+    double maxFrameSec = 0.0;
+};
+
+struct EncoderOptions
+{
+    enum class Backend
+    {
+        Auto,  // libav if built in and usable, else pipe
+        Libav, // in-process libavcodec/libavformat
+        Pipe   // ffmpeg child process fed through a pipe
+    };
+
+    Backend backend = Backend::Auto;
+    int crf = 23;                      // 0 (lossless) .. 51 (smallest)
+    std::string preset = "ultrafast"; // one of encoderPresets()
+    int threads = 0;                   // encoder threads, 0 = codec default
+    ColorSpace color;                  // tagged on the stream; must match the frames
+    std::string container;             // muxer, e.g. "null"; empty = from the output extension
+
+    // Called from encodeFrame() after every frame
+    std::function<void(const EncodedFrameInfo &)> onFrameEncoded;
+};
+
+// x264 preset names, fastest (least compression) first
+const std::vector<std::string> &encoderPresets();
+
+// Quote one argument for the platform shell (popen/system).
+std::string shellQuote(const std::string &arg);
+
+// Implementation behind Encoder: libav or pipe
+class EncoderBackend
+{
+public:
+    virtual ~EncoderBackend() = default;
+    virtual const char *name() const = 0;
+    // Add the packets written during the call to info.
+    virtual void encodeFrame(const uint8_t *data, size_t size, EncodedFrameInfo &info) = 0;
+    // Flush delayed frames and close the output; must be idempotent.
+    virtual void finish(EncodedFrameInfo &info) = 0;
+};
 
 class Encoder
 {
 public:
     // Constructor: initialize with output path, frame width & height, and frames per second
-    Encoder(const std::string &outputPath, int width, int height, double fps);
+    Encoder(const std::string &outputPath, int width, int height, double fps,
+            const EncoderOptions &options = EncoderOptions());
     ~Encoder();
 
     // Encode a single frame (YUV420p raw data)
     void encodeFrame(const std::vector<uint8_t> &yuvFrame);
+    void encodeFrame(const uint8_t *data, size_t size);
 
-    // Finalize encoding and close FFmpeg process
+    // Finalize encoding and close the output
     void finish();
 
+    const char *backendName() const { return backend_->name(); }
+    const EncoderStats &stats() const { return stats_; }
+
 private:
-    FILE *ffmpegPipe;
-    int width;
-    int height;
-    double fps;
-};
\ No newline at end of file
+    std::unique_ptr<EncoderBackend> backend_;
+    EncoderOptions options_;
+    EncoderStats stats_;
+};
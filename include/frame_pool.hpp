@@ -0,0 +1,219 @@
+#ifndef FRAME_POOL_HPP
+#define FRAME_POOL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "yuv_frame.hpp"
+
+class FramePool;
+
+// Move-only handle to one of a FramePool's buffers. The buffer belongs to
+// the holder alone until the handle is released or destroyed, at which
+// point it goes back to the pool for the next frame.
+class PooledFrame
+{
+public:
+    PooledFrame() = default;
+    PooledFrame(FramePool *pool, size_t index, cv::Mat *mat)
+        : pool_(pool), index_(index), mat_(mat) {}
+
+    PooledFrame(const PooledFrame &) = delete;
+    PooledFrame &operator=(const PooledFrame &) = delete;
+
+    PooledFrame(PooledFrame &&other) noexcept { *this = static_cast<PooledFrame &&>(other); }
+    PooledFrame &operator=(PooledFrame &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            pool_ = other.pool_;
+            index_ = other.index_;
+            mat_ = other.mat_;
+            other.pool_ = nullptr;
+            other.mat_ = nullptr;
+        }
+        return *this;
+    }
+
+    ~PooledFrame() { release(); }
+
+    cv::Mat &mat() const { return *mat_; }
+    explicit operator bool() const { return mat_ != nullptr; }
+
+    // Return the buffer to its pool. Safe to call more than once.
+    inline void release();
+
+private:
+    FramePool *pool_ = nullptr;
+    size_t index_ = 0;
+    cv::Mat *mat_ = nullptr;
+};
+
+// Fixed set of preallocated frame buffers handed out as PooledFrame
+// handles. The pool size bounds the memory in flight: acquire() blocks
+// while every buffer is in use. Once the buffers have the stream's size,
+// recycling them does no heap allocation (cv::Mat::create() is a no-op for
+// an unchanged size and type).
+class FramePool
+{
+public:
+    FramePool(size_t count, int rows, int cols, int type)
+        : mats_(count > 0 ? count : 1)
+    {
+        free_.reserve(mats_.size());
+        for (size_t i = 0; i < mats_.size(); ++i)
+        {
+            if (rows > 0 && cols > 0)
+                mats_[i].create(rows, cols, type);
+            free_.push_back(mats_.size() - 1 - i);
+        }
+    }
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    size_t size() const { return mats_.size(); }
+
+    // Wait for a free buffer. Returns an empty handle once closed.
+    PooledFrame acquire()
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_free_.wait(lock, [this]
+                        { return !free_.empty() || closed_; });
+        if (closed_)
+            return PooledFrame();
+        size_t index = free_.back();
+        free_.pop_back();
+        return PooledFrame(this, index, &mats_[index]);
+    }
+
+    // Wake up and fail any waiting acquire().
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            closed_ = true;
+        }
+        cond_free_.notify_all();
+    }
+
+private:
+    friend class PooledFrame;
+
+    void giveBack(size_t index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            free_.push_back(index); // capacity reserved up front
+        }
+        cond_free_.notify_one();
+    }
+
+    std::vector<cv::Mat> mats_;
+    std::vector<size_t> free_;
+    std::mutex mtx_;
+    std::condition_variable cond_free_;
+    bool closed_ = false;
+};
+
+// Fixed set of host I420 buffers handed out as YuvFrames. Lets a stage
+// give a backend's frame back right away while a slower consumer (one
+// rung of a rendition ladder) still has copies queued: copyIn() blocks
+// only once all of that consumer's buffers are taken.
+class YuvBufferPool : public FrameOwner
+{
+public:
+    YuvBufferPool(size_t count, size_t frameSize)
+        : buffers_(count > 0 ? count : 1)
+    {
+        free_.reserve(buffers_.size());
+        for (size_t i = 0; i < buffers_.size(); ++i)
+        {
+            buffers_[i].resize(frameSize);
+            free_.push_back(buffers_.size() - 1 - i);
+        }
+    }
+
+    YuvBufferPool(const YuvBufferPool &) = delete;
+    YuvBufferPool &operator=(const YuvBufferPool &) = delete;
+
+    size_t size() const { return buffers_.size(); }
+
+    // Copy a frame into a free buffer, waiting for one if necessary.
+    // Returns an empty handle once closed.
+    YuvFrame copyIn(const uint8_t *data, size_t size)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (free_.empty() && !closed_)
+            {
+                auto t0 = std::chrono::steady_clock::now();
+                cond_free_.wait(lock, [this]
+                                { return !free_.empty() || closed_; });
+                waitSec_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            }
+            if (closed_)
+                return YuvFrame();
+            index = free_.back();
+            free_.pop_back();
+        }
+        std::vector<uint8_t> &buffer = buffers_[index];
+        if (buffer.size() < size)
+            buffer.resize(size);
+        std::memcpy(buffer.data(), data, size);
+        return YuvFrame(this, index, buffer.data(), size);
+    }
+
+    // Wake up and fail any waiting copyIn().
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            closed_ = true;
+        }
+        cond_free_.notify_all();
+    }
+
+    // Total time copyIn() spent waiting for a buffer.
+    double waitSec()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return waitSec_;
+    }
+
+    // FrameOwner
+    void releaseFrame(size_t index) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            free_.push_back(index); // capacity reserved up front
+        }
+        cond_free_.notify_one();
+    }
+
+private:
+    std::vector<std::vector<uint8_t>> buffers_;
+    std::vector<size_t> free_;
+    std::mutex mtx_;
+    std::condition_variable cond_free_;
+    bool closed_ = false;
+    double waitSec_ = 0.0;
+};
+
+inline void PooledFrame::release()
+{
+    if (pool_)
+        pool_->giveBack(index_);
+    pool_ = nullptr;
+    mat_ = nullptr;
+}
+
+#endif // FRAME_POOL_HPP
@@ -0,0 +1,143 @@
+#ifndef JOB_SERVER_HPP
+#define JOB_SERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.hpp"
+
+class PreprocessBackend;
+
+// One transcode submitted to a JobServer. Paths are used as given, so
+// clients should send absolute ones.
+struct JobRequest
+{
+    std::string input;
+    std::string output;
+    int width = 0;      // output size as --width/--height; both 0 = the server's
+    int height = 0;
+    int crf = -1;       // -1 = the server's
+    std::string preset; // empty = the server's
+    int priority = 0;   // higher runs first, then in order of arrival
+};
+
+// What the server tells a client about its job, one line per update
+struct JobUpdate
+{
+    enum class Kind
+    {
+        Queued,   // position = jobs that will start before this one
+        Started,
+        Progress, // frames encoded so far
+        Done,     // frames, seconds, inBytes, outBytes
+        Failed    // error
+    };
+
+    Kind kind = Kind::Queued;
+    uint64_t id = 0;
+    size_t position = 0;
+    size_t frames = 0;
+    double seconds = 0.0;
+    uintmax_t inBytes = 0;
+    uintmax_t outBytes = 0;
+    std::string error;
+};
+
+// Wire format: one tab-separated line per message, without the newline.
+// The parsers throw std::invalid_argument on malformed input; formatting
+// a request throws if a field contains a tab or newline.
+std::string formatJobRequest(const JobRequest &job);
+JobRequest parseJobRequest(const std::string &line);
+std::string formatJobUpdate(const JobUpdate &update);
+JobUpdate parseJobUpdate(const std::string &line);
+
+struct JobServerOptions
+{
+    BatchOptions defaults;  // a job's size, crf and preset override these
+    size_t maxQueued = 64;  // further submissions fail at once
+    // Called from server threads for every update sent, progress included
+    std::function<void(const JobRequest &, const JobUpdate &)> onUpdate;
+};
+
+// Long-lived transcoder listening on a Unix domain socket. Each backend
+// stays initialized (OpenCL context, compiled program, device buffers)
+// for the life of the server and runs one job at a time, so
+// backends.size() is the concurrency limit. A client connects, sends one
+// request line and receives updates until Done or Failed; a client that
+// disconnects does not cancel its job.
+class JobServer
+{
+public:
+    // Binds socketPath, replacing a stale socket file. Throws
+    // std::runtime_error if the socket cannot be bound, another server is
+    // listening on it or the path is some other kind of file.
+    JobServer(const std::string &socketPath, const std::vector<PreprocessBackend *> &backends,
+              JobServerOptions options);
+    ~JobServer();
+
+    // Accept jobs until stop(); then close the socket, let running jobs
+    // finish, fail the queued ones and return
+    void run();
+    // Only sets a flag, so it may be called from a signal handler
+    void stop() { stopping_ = true; }
+
+    JobServer(const JobServer &) = delete;
+    JobServer &operator=(const JobServer &) = delete;
+
+private:
+    struct Job
+    {
+        uint64_t id = 0;
+        JobRequest request;
+        int fd = -1; // client connection, closed when the job ends
+    };
+    // Heap order for queue_: the top is the next job to run
+    static bool runsLater(const Job &a, const Job &b)
+    {
+        return a.request.priority != b.request.priority ? a.request.priority < b.request.priority : a.id > b.id;
+    }
+
+    // A client whose request line has not all arrived yet
+    struct Connection
+    {
+        int fd = -1;
+        std::string received;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    // Read what the client sent; true once the connection is done with,
+    // either queued as a job (fd handed over and set to -1) or to be closed
+    bool readRequest(Connection &connection);
+    void acceptJob(int fd, const std::string &line);
+    void worker(PreprocessBackend &backend);
+    void runJob(Job &job, PreprocessBackend &backend);
+    void send(const Job &job, const JobUpdate &update);
+    void closeSocket();
+
+    std::string socketPath_;
+    std::vector<PreprocessBackend *> backends_;
+    JobServerOptions options_;
+    int listenFd_ = -1;
+    std::atomic<bool> stopping_{false};
+
+    std::mutex mutex_;
+    std::condition_variable jobReady_;
+    std::vector<Job> queue_; // heap by runsLater()
+    bool closed_ = false; // no more jobs will be queued
+    uint64_t nextId_ = 1;
+    std::vector<std::thread> workers_;
+};
+
+// Submit job to the server at socketPath and wait for it to end, passing
+// every update to onUpdate. Returns the final update (Done or Failed);
+// throws std::runtime_error if the server cannot be reached or hangs up.
+JobUpdate submitJob(const std::string &socketPath, const JobRequest &job,
+                    const std::function<void(const JobUpdate &)> &onUpdate);
+
+#endif // JOB_SERVER_HPP
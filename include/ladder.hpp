@@ -0,0 +1,70 @@
+#ifndef LADDER_HPP
+#define LADDER_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class VideoReader;
+class PreprocessBackend;
+class Encoder;
+
+// One output of a rendition ladder; the encoder must be opened at this size
+struct LadderRendition
+{
+    int width = 0;
+    int height = 0;
+    Encoder *encoder = nullptr;
+};
+
+struct LadderOptions
+{
+    size_t queueCapacity = 4; // decoded frames waiting for the backend
+    // Frames each rendition may buffer ahead of its encoder. Once a slow
+    // rendition's buffer is full it holds up the whole ladder; until then
+    // the others run at their own pace.
+    size_t renditionBuffer = 8;
+    // Source frame buffers; 0 = queueCapacity + ladders in flight + 1
+    size_t framePoolSize = 0;
+    // Stop after this many frames; 0 = run to the end of the input
+    size_t maxFrames = 0;
+};
+
+struct RenditionStats
+{
+    int width = 0;
+    int height = 0;
+    size_t frames = 0;
+    double encSec = 0.0;   // time spent in the encoder
+    double wallSec = 0.0;  // lifetime of the rendition's encoder thread
+    double stallSec = 0.0; // time the ladder waited for this rendition's buffer
+
+    double fps() const { return wallSec > 0.0 ? frames / wallSec : 0.0; }
+};
+
+struct LadderStats
+{
+    size_t framesRead = 0;
+    double totalSec = 0.0;
+    double procSec = 0.0; // time the processing thread spent in the backend
+    std::vector<RenditionStats> renditions; // in ladder order
+};
+
+// Parse a comma-separated list of output heights such as "1080,720,480".
+// Throws std::invalid_argument for empty, non-positive or repeated heights.
+std::vector<int> parseLadder(const std::string &spec);
+
+// <output stem>_<height>p<output extension>, next to the output
+std::string renditionPath(const std::string &outPath, int height);
+
+// Decode the input once and encode it at every rendition's size. Each
+// source frame is uploaded once and turned into all sizes by a single
+// submitRenditions() call; every rendition then has its own queue and
+// encoder thread. Finishes every encoder. Throws std::invalid_argument if
+// renditions is empty or the backend cannot hold a whole ladder.
+LadderStats runLadder(VideoReader &reader,
+                      PreprocessBackend &processor,
+                      const std::vector<LadderRendition> &renditions,
+                      const LadderOptions &options);
+
+#endif // LADDER_HPP
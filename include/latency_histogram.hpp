@@ -0,0 +1,117 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Fixed-size log-scale histogram of durations in seconds. Buckets are 1/16
+// of an octave wide from 1 us to about 70 minutes, so percentiles are
+// within ~2% of the true value; min, max and mean are exact. Recording
+// does not allocate. Not thread-safe: record from one thread and merge()
+// per-thread histograms once the threads are done.
+class LatencyHistogram
+{
+public:
+    void record(double sec)
+    {
+        ++buckets_[bucketOf(sec)];
+        if (count_ == 0 || sec < min_)
+            min_ = sec;
+        max_ = std::max(max_, sec);
+        sum_ += sec;
+        ++count_;
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        if (other.count_ == 0)
+            return;
+        for (size_t i = 0; i < BUCKETS; ++i)
+            buckets_[i] += other.buckets_[i];
+        min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        sum_ += other.sum_;
+        count_ += other.count_;
+    }
+
+    uint64_t count() const { return count_; }
+    double sum() const { return sum_; }
+    double min() const { return min_; }
+    double max() const { return max_; }
+    double mean() const { return count_ > 0 ? sum_ / count_ : 0.0; }
+
+    // Smallest recorded duration with at least p percent of the samples at
+    // or below it (p in 0..100), to bucket resolution; exact for 100, 0
+    // when empty.
+    double percentile(double p) const
+    {
+        if (count_ == 0)
+            return 0.0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 100.0) / 100.0 * count_));
+        rank = std::max<uint64_t>(rank, 1);
+        if (rank >= count_)
+            return max_;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            seen += buckets_[i];
+            if (seen >= rank)
+                return std::clamp(bucketMid(i), min_, max_);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int STEPS_PER_OCTAVE = 16;
+    static constexpr int OCTAVES = 32; // 1 us .. 2^32 us
+    static constexpr size_t BUCKETS = 1 + STEPS_PER_OCTAVE * OCTAVES;
+
+    // Bucket 0 holds everything below 1 us
+    static size_t bucketOf(double sec)
+    {
+        double us = sec * 1e6;
+        if (!(us >= 1.0))
+            return 0;
+        double index = 1 + std::floor(std::log2(us) * STEPS_PER_OCTAVE);
+        return static_cast<size_t>(std::min(index, static_cast<double>(BUCKETS - 1)));
+    }
+
+    // Geometric centre of a bucket, in seconds
+    static double bucketMid(size_t i)
+    {
+        if (i == 0)
+            return 0.5e-6;
+        return std::exp2((i - 1 + 0.5) / STEPS_PER_OCTAVE) * 1e-6;
+    }
+
+    std::array<uint64_t, BUCKETS> buckets_{};
+    uint64_t count_ = 0;
+    double sum_ = 0.0;
+    double min_ = 0.0;
+    double max_ = 0.0;
+};
+
+// Named per-stage histograms, in the order the stages were first seen
+using StageLatencies = std::vector<std::pair<std::string, LatencyHistogram>>;
+
+// Merge each of stages into the entry of the same name in into, appending
+// stages it does not have yet
+inline void mergeStageLatencies(StageLatencies &into, const StageLatencies &stages)
+{
+    for (const auto &stage : stages)
+    {
+        auto it = std::find_if(into.begin(), into.end(), [&](const auto &entry) { return entry.first == stage.first; });
+        if (it == into.end())
+            into.push_back(stage);
+        else
+            it->second.merge(stage.second);
+    }
+}
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,94 @@
+#ifndef MULTI_DEVICE_DRIVER_HPP
+#define MULTI_DEVICE_DRIVER_HPP
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "bounded_queue.hpp"
+#include "opencl_driver.hpp"
+#include "preprocess_backend.hpp"
+#include "reorder_buffer.hpp"
+#include "yuv_frame.hpp"
+
+// Shards frames across several OpenCL devices, one OpenCLDriver (context,
+// program and queues) per device. Each frame goes to the device with the
+// lowest expected completion time, estimated from its queue length and its
+// measured per-frame time, so faster devices take proportionally more
+// frames. Results are put back into submission order before they are
+// handed out; a frame a device failed on is handed out as its error, so
+// waitMappedFrame() throws for that ticket and the devices keep running.
+class MultiDeviceDriver : public PreprocessBackend
+{
+public:
+    struct DeviceStats
+    {
+        std::string name;
+        uint64_t frames = 0;
+        double avgFrameMs = 0.0; // smoothed device time per frame
+    };
+
+    // Every OpenCL device on every platform. Devices that fail to
+    // initialize are skipped; throws std::runtime_error if none is usable.
+    explicit MultiDeviceDriver(size_t inFlightPerDevice = 4);
+
+    // A specific set of devices, e.g. sub-devices from clCreateSubDevices().
+    explicit MultiDeviceDriver(const std::vector<cl_device_id> &devices, size_t inFlightPerDevice = 4);
+    ~MultiDeviceDriver();
+
+    std::string name() const override;
+    size_t slotCount() const override { return slotCount_; }
+
+    FrameTicket submitFrame(const cv::Mat &input, int targetWidth, int targetHeight) override;
+    YuvFrame waitMappedFrame(FrameTicket ticket) override;
+    void setResizeFilter(ResizeFilter filter) override;
+    void setColorSpace(ColorSpace space) override;
+
+    size_t deviceCount() const { return devices_.size(); }
+    std::vector<DeviceStats> deviceStats() const;
+    // Every device's stage latencies, merged
+    StageLatencies stageLatencies() const override;
+
+private:
+    struct Job
+    {
+        FrameTicket ticket = 0;
+        cv::Mat input;
+        int targetWidth = 0;
+        int targetHeight = 0;
+    };
+
+    // A finished frame, or why its device could not produce it
+    struct Result
+    {
+        YuvFrame frame;
+        std::exception_ptr error;
+    };
+
+    struct Device
+    {
+        std::unique_ptr<OpenCLDriver> driver;
+        std::string name;
+        std::unique_ptr<BoundedQueue<Job>> jobs;
+        std::thread worker;
+        std::atomic<size_t> pending{0};     // queued + in flight
+        std::atomic<uint64_t> frames{0};
+        std::atomic<double> frameSec{0.0}; // EWMA, 0 until the first frame
+    };
+
+    std::vector<std::unique_ptr<Device>> devices_;
+    size_t slotCount_ = 0;
+    std::unique_ptr<ReorderBuffer<Result>> reorder_;
+    FrameTicket nextTicket_ = 0;
+    FrameTicket nextWait_ = 0;
+
+    void start(const std::vector<cl_device_id> &devices, size_t inFlightPerDevice);
+    size_t pickDevice() const;
+    void workerLoop(Device &device);
+};
+
+#endif // MULTI_DEVICE_DRIVER_HPP
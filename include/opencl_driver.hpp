@@ -1,8 +1,13 @@
 #ifndef OPENCL_DRIVER_HPP
 #define OPENCL_DRIVER_HPP
 
+#include <array>
+#include <map>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
 #ifdef __APPLE__
 #include <OpenCL/opencl.h>
 #else
@@ -10,24 +15,247 @@
 #endif
 #include <opencv2/core.hpp>
 
-class OpenCLDriver
+#include "latency_histogram.hpp"
+#include "preprocess_backend.hpp"
+#include "resize_filter.hpp"
+#include "yuv_frame.hpp"
+
+class OpenCLDriver : public PreprocessBackend, public FrameOwner
 {
 public:
-    OpenCLDriver();
+    // inFlightFrames: number of frame slots that may be queued on the device
+    // at once. Each slot owns its own device buffers and kernel instance.
+    // Uses the first GPU on any platform, else the first OpenCL device of
+    // any type; throws std::runtime_error if there is none.
+    explicit OpenCLDriver(size_t inFlightFrames = 4);
+
+    // Runs on a specific device (root or sub-device), which must outlive
+    // the driver.
+    explicit OpenCLDriver(cl_device_id device, size_t inFlightFrames = 4);
     ~OpenCLDriver();
 
-    void processFrame(const cv::Mat &input, std::vector<uint8_t> &outputYUV, int targetWidth, int targetHeight);
+    // Every device of the given type across all platforms.
+    static std::vector<cl_device_id> enumerateDevices(cl_device_type type = CL_DEVICE_TYPE_ALL);
+    static std::string deviceName(cl_device_id device);
+
+    std::string name() const override { return "opencl"; }
+
+    // Rebuilds the kernels for the new matrix and range. Throws
+    // std::runtime_error if frames are still in flight.
+    void setColorSpace(ColorSpace space) override;
+
+    // Kernel behind the fast filter. Auto picks the tiled local-memory
+    // kernel when the device has dedicated local memory and the source tile
+    // fits in it, and the direct kernel otherwise. Tiled also uses it on
+    // devices that emulate local memory (most CPU drivers) whenever the
+    // tile fits. Takes effect from the next submitted frame.
+    enum class FastKernel
+    {
+        Auto,
+        Direct, // resize_bgr_to_i420, one 2x2 block per work-item
+        Tiled   // resize_bgr_to_i420_tiled
+    };
+    void setFastKernel(FastKernel kernel) { fastKernel_ = kernel; }
+    // Whether fast-filter frames of this geometry run the tiled kernel.
+    bool usesTiledKernel(int srcW, int srcH, int dstW, int dstH) const;
+
+    // Kernels without a required work-group size run with the fastest of
+    // a few candidate local sizes, benchmarked on the first frame of each
+    // geometry and cached on disk per device, driver and kernel (see
+    // loadCachedLocalSize()). Off leaves the choice to the runtime. Takes
+    // effect for geometries not yet seen by a slot.
+    void setWorkGroupTuning(bool enabled) { tuneWorkGroups_ = enabled; }
+
+    // Queue upload, preprocessing and mapping of one frame without blocking
+    // on the device. The input's pixel data must stay untouched until the
+    // ticket is waited on. If the next slot is still held by a YuvFrame
+    // handed out earlier, blocks until that frame is released; throws
+    // std::runtime_error if it holds a ticket that was never waited on.
+    FrameTicket submitFrame(const cv::Mat &input, int targetWidth, int targetHeight) override;
+
+    // Block until the given frame is done and return a handle to its I420
+    // data, mapped straight from the device buffer (zero-copy on host-memory
+    // devices). The slot is reused once the handle is released, which may
+    // happen on another thread. Tickets must be waited on in submission order.
+    YuvFrame waitMappedFrame(FrameTicket ticket) override;
+
+    // One upload of the input feeds a kernel and a mapped output buffer per
+    // size, all in the same slot, so a ladder takes a single ticket.
+    FrameTicket submitRenditions(const cv::Mat &input, const std::vector<OutputSize> &sizes) override;
+    void waitRenditions(FrameTicket ticket, size_t count, std::vector<YuvFrame> &frames) override;
+    size_t renditionSlotCount(size_t) const override { return slots_.size(); }
+
+    // FrameOwner: unmap one output buffer; its slot is available again
+    // once every output of the frame has been released.
+    void releaseFrame(size_t handle) override;
+
+    size_t slotCount() const override { return slots_.size(); }
+    // True if the next submitFrame() will not wait for a frame release.
+    bool nextSlotFree();
+    size_t framesInFlight() const { return static_cast<size_t>(nextTicket_ - nextWait_); }
+
+    // Device time per stage from the queues' profiling counters, over every
+    // frame waited on so far: "upload", "resize" (single-pass kernels),
+    // "resize_h" / "resize_v" (polyphase passes) and "readback" (the map).
+    // Colour conversion of BGR sources is fused into the last kernel pass.
+    // Ladder frames add one sample per output to the kernel stages.
+    StageLatencies stageLatencies() const override;
 
 private:
-    cl_context context_;
-    cl_command_queue queue_;
-    cl_program program_;
-    cl_kernel resizeKernel_;
-    cl_kernel convertKernel_;
-    cl_device_id device_;
+    enum class DeviceStage
+    {
+        Upload,
+        Resize,
+        HorizontalPass,
+        VerticalPass,
+        Readback,
+        Count
+    };
+    // Kernel launches of one output per frame: at most two passes of
+    // three planes
+    static const int MAX_KERNEL_EVENTS = 6;
+
+    // Input/output dimensions and resolved filter a set of device buffers
+    // was allocated for.
+    struct FrameGeometry
+    {
+        int srcW = 0;
+        int srcH = 0;
+        int dstW = 0;
+        int dstH = 0;
+        ResizeFilter filter = ResizeFilter::Fast;
+        bool tiled = false;  // fast filter through resize_bgr_to_i420_tiled
+        bool planar = false; // I420 source, resized plane by plane
+
+        bool operator==(const FrameGeometry &o) const
+        {
+            return srcW == o.srcW && srcH == o.srcH && dstW == o.dstW && dstH == o.dstH && filter == o.filter &&
+                   tiled == o.tiled && planar == o.planar;
+        }
+        bool operator!=(const FrameGeometry &o) const { return !(*this == o); }
+    };
+
+    enum class SlotState
+    {
+        Free,      // available for submitFrame()
+        Submitted, // queued on the device, ticket not yet waited on
+        Mapped     // handed out as a YuvFrame, waiting for releaseFrame()
+    };
+
+    // One output size of a frame. Device buffers and kernel arguments are
+    // reused across frames and only rebuilt when the geometry changes.
+    struct SlotOutput
+    {
+        FrameGeometry geometry;
+        cl_mem yuvBuffer = nullptr; // host-visible contiguous I420: Y, U, V
+        cl_kernel kernel = nullptr; // resize_bgr_to_i420 or its tiled variant
+        size_t yuvSize = 0;
+
+        // Polyphase filters: horizontal pass output and coefficient tables
+        // (offsets and weights per direction), uploaded once per geometry
+        cl_mem tmpBuffer = nullptr;
+        cl_mem coeffBuffers[4] = {nullptr, nullptr, nullptr, nullptr};
+        cl_kernel hKernel = nullptr;
+        cl_kernel vKernel = nullptr;
+
+        // Planar sources: a kernel per plane (Y, U, V) for the fast filter
+        // or the horizontal pass, one per plane for the vertical pass, and
+        // the chroma tables (the luma ones are in coeffBuffers)
+        cl_kernel planeKernels[3] = {nullptr, nullptr, nullptr};
+        cl_kernel planeVKernels[3] = {nullptr, nullptr, nullptr};
+        cl_mem chromaCoeffBuffers[4] = {nullptr, nullptr, nullptr, nullptr};
+
+        // Every kernel launch of the current frame, for profiling; the last
+        // one is what the map waits for
+        cl_event kernelEvents[MAX_KERNEL_EVENTS] = {};
+        DeviceStage kernelStages[MAX_KERNEL_EVENTS] = {};
+        int kernelEventCount = 0;
+        // Local size of each launch of a frame, resolved on the first one
+        // with this geometry; {0, 0} leaves it to the runtime
+        size_t launchLocal[MAX_KERNEL_EVENTS][2] = {};
+        int tunedLaunches = 0;
+
+        uint8_t *mapped = nullptr; // yuvBuffer mapping while Submitted/Mapped
+        cl_event mapDone = nullptr;
+        cl_event unmapDone = nullptr; // next kernel must wait for this
+    };
+
+    // One in-flight frame: the uploaded source and one output per
+    // requested size (a single one outside of ladders).
+    struct FrameSlot
+    {
+        cl_mem inputBuffer = nullptr;
+        size_t inputSize = 0; // BGR24 or I420 source bytes
+        std::vector<SlotOutput> outputs; // grows to the largest ladder seen
+        size_t activeOutputs = 0;        // outputs of the current frame
+        size_t mappedOutputs = 0;        // still held as YuvFrames
+
+        cv::Mat hostInput; // keeps the source pixels alive during upload
+        cl_event writeDone = nullptr; // upload, kept until profiled
+        SlotState state = SlotState::Free;
+    };
+
+    cl_context context_ = nullptr;
+    cl_command_queue uploadQueue_ = nullptr;
+    cl_command_queue queue_ = nullptr; // compute
+    cl_command_queue downloadQueue_ = nullptr;
+    cl_program program_ = nullptr;
+    cl_program globalCoeffProgram_ = nullptr; // tables in __global, built on demand
+    cl_ulong maxConstantBytes_ = 0;
+    // Tiled kernel capabilities
+    bool dedicatedLocalMem_ = false;
+    cl_ulong localMemBytes_ = 0;
+    size_t tiledGroupLimit_ = 0; // CL_KERNEL_WORK_GROUP_SIZE of the tiled kernel
+    FastKernel fastKernel_ = FastKernel::Auto;
+    bool tuneWorkGroups_ = true;
+    // Winning local size per launch key (kernel, build options, global size)
+    std::map<std::string, std::array<size_t, 2>> tunedLocalSizes_;
+    cl_device_id device_ = nullptr;
+    std::vector<FrameSlot> slots_;
+    FrameTicket nextTicket_ = 0;
+    FrameTicket nextWait_ = 0;
+    std::mutex slotMutex_; // guards FrameSlot::state and mappedOutputs
+    std::condition_variable slotReleased_;
+    // Recorded by the thread that waits on tickets
+    LatencyHistogram deviceLatency_[static_cast<int>(DeviceStage::Count)];
+
+    // Host copy of the polyphase tables for the latest geometry; slots
+    // with the same geometry upload it without recomputing
+    FrameGeometry tablesGeometry_;
+    ResizeCoefficients hTables_;
+    ResizeCoefficients vTables_;
+
+    // Source pixels (tileW x tileH) one tiled work-group reads
+    static void tiledSourceTile(int srcW, int srcH, int dstW, int dstH, int &tileW, int &tileH);
 
     void initOpenCL();
-    void loadKernel(const std::string &filePath);
+    void releaseOpenCL();
+    // Program for colorSpace_; output kernels are created as needed
+    void buildKernels();
+    void releaseKernels();
+    void ensureInput(FrameSlot &slot, size_t inputSize);
+    void ensureOutput(FrameSlot &slot, SlotOutput &output, const FrameGeometry &geometry);
+    void ensurePolyphase(FrameSlot &slot, SlotOutput &output, const FrameGeometry &geometry);
+    void ensurePlanar(FrameSlot &slot, SlotOutput &output, const FrameGeometry &geometry);
+    // Program for polyphase tables of up to tableBytes per direction
+    cl_program coeffProgram(size_t tableBytes);
+    void enqueueOutput(SlotOutput &output, cl_event writeDone);
+    cl_int launchKernel(SlotOutput &output, DeviceStage stage, cl_kernel kernel, const size_t *global,
+                        const size_t *local, cl_uint numDeps, const cl_event *deps);
+    // Local size for a launch of kernel over global: from memory, the disk
+    // cache or, failing both, a benchmark once deps are complete
+    void tunedLocalSize(cl_kernel kernel, const size_t *global, cl_uint numDeps, const cl_event *deps,
+                        size_t local[2]);
+    std::array<size_t, 2> benchmarkLocalSizes(cl_kernel kernel, const size_t *global);
+    // Add a waited-on frame's event timings to deviceLatency_ and release
+    // the events
+    void recordDeviceTimes(FrameSlot &slot, size_t count);
+    void releaseOutput(SlotOutput &output);
+    void releaseBuffers(FrameSlot &slot);
+    // Shared by the single-frame and ladder entry points; no allocations
+    // once the slot's buffers exist
+    FrameTicket submitOutputs(const cv::Mat &input, const OutputSize *sizes, size_t count);
+    void waitOutputs(FrameTicket ticket, YuvFrame *frames, size_t count);
 };
 
-#endif // OPENCL_DRIVER_HPP
\ No newline at end of file
+#endif // OPENCL_DRIVER_HPP
@@ -0,0 +1,78 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "latency_histogram.hpp"
+
+class VideoReader;
+class PreprocessBackend;
+class Encoder;
+
+// Queue used for the links between stages. With one processing worker
+// every link has one producer and one consumer, so the lock-free SpscRing
+// can replace BoundedQueue; with several, the source link stays a
+// BoundedQueue.
+enum class QueueKind
+{
+    Mutex, // BoundedQueue
+    Spsc   // SpscRing
+};
+
+struct PipelineOptions
+{
+    int outWidth = 0;
+    int outHeight = 0;
+    size_t queueCapacity = 4;
+    QueueKind queueKind = QueueKind::Mutex;
+    // Source frame buffers; 0 = queueCapacity + backend slots + 1. Bounds
+    // the decoded frames held in memory.
+    size_t framePoolSize = 0;
+    // Stop after this many frames; 0 = run to the end of the input
+    size_t maxFrames = 0;
+
+    // Called from the encoder thread after each frame has been written.
+    std::function<void(size_t framesEncoded)> onFrameEncoded;
+};
+
+struct PipelineStats
+{
+    struct WorkerStats
+    {
+        size_t frames = 0;
+        double busySec = 0.0; // time spent in the backend
+        double wallSec = 0.0; // lifetime of the worker thread
+        LatencyHistogram latency; // submitFrame() + waitMappedFrame() per frame
+    };
+
+    size_t framesProcessed = 0;
+    double totalSec = 0.0;
+    double procSec = 0.0; // time the processing workers spent in their backends
+    double encSec = 0.0;  // time the encoder thread spent writing frames
+    std::vector<WorkerStats> workers;
+
+    // Per-frame latencies; each is recorded by a single stage thread
+    LatencyHistogram decodeLatency; // VideoReader::getNextFrame()
+    LatencyHistogram procLatency;   // every worker's latency, merged
+    LatencyHistogram encodeLatency; // Encoder::encodeFrame()
+};
+
+// Runs the reader -> processor -> encoder pipeline on three threads until
+// the input is exhausted (or maxFrames have been read), then finishes the
+// encoder.
+PipelineStats runPipeline(VideoReader &reader,
+                          PreprocessBackend &processor,
+                          Encoder &encoder,
+                          const PipelineOptions &options);
+
+// Same with one processing worker thread per backend. Workers take frames
+// from a shared queue; a reorder buffer restores presentation order before
+// the encoder. Throws std::invalid_argument if processors is empty.
+PipelineStats runPipeline(VideoReader &reader,
+                          const std::vector<PreprocessBackend *> &processors,
+                          Encoder &encoder,
+                          const PipelineOptions &options);
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,69 @@
+#ifndef PIPELINE_TUNING_HPP
+#define PIPELINE_TUNING_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "encoder.hpp"
+#include "pipeline.hpp"
+#include "video_reader.hpp"
+
+class PreprocessBackend;
+
+// Stage queue depth and processing workers for one kind of job
+struct PipelineTuning
+{
+    size_t queueCapacity = 4;
+    size_t workers = 1;
+    double fps = 0.0; // steady-state rate measured for this configuration
+    size_t memoryBytes = 0; // frame buffers it holds, as checked against memoryCap
+};
+
+struct TuningOptions
+{
+    std::vector<size_t> queueDepths = {1, 2, 4, 8, 16};
+    std::vector<size_t> workerCounts = {1, 2, 4};
+    double calibrationSec = 3.0; // of input, from the start of the file
+    // Frames excluded from the rate while the stages fill, as a share of
+    // the calibration run
+    double warmupShare = 0.25;
+    // Upper bound for the frame buffers a configuration holds: decoder
+    // read-ahead, source pool and backend output slots
+    size_t memoryCap = size_t(1) << 30;
+    VideoReader::Options reader;
+    EncoderOptions encoder; // encodes go to the null muxer
+    QueueKind queueKind = QueueKind::Mutex;
+    // Called after each configuration is measured (fps 0 if over memoryCap)
+    std::function<void(const PipelineTuning &)> onMeasured;
+};
+
+// Backend for one of `workers` processing workers
+using TuningBackendFactory = std::function<std::unique_ptr<PreprocessBackend>(size_t workers)>;
+
+// Run the first calibrationSec of inPath through the full pipeline once
+// per queue depth and worker count and return the configuration with the
+// best steady-state frame rate that fits memoryCap. Backends are created
+// once per worker count and shared by its queue depths. Throws
+// std::runtime_error if no configuration fits.
+PipelineTuning calibratePipeline(const std::string &inPath, int outW, int outH,
+                                 const TuningBackendFactory &createBackend, const TuningOptions &options);
+
+// Per-host profile of tuned configurations: one line per job kind in
+// programCacheDirectory(), named after the host, so a shared home
+// directory keeps one profile per machine. Empty if there is no cache
+// directory.
+std::string tuningProfilePath();
+
+// Job kind: backend, input and output size and decoder output format
+std::string tuningKey(const std::string &backendName, int inW, int inH, int outW, int outH,
+                      VideoReader::PixelFormat format);
+
+// False if the profile has no entry for key. Profile errors are never
+// fatal: an unreadable profile reads as empty and a failed save is skipped.
+bool loadTuning(const std::string &path, const std::string &key, PipelineTuning &tuning);
+void saveTuning(const std::string &path, const std::string &key, const PipelineTuning &tuning);
+
+#endif // PIPELINE_TUNING_HPP
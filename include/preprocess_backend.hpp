@@ -0,0 +1,109 @@
+#ifndef PREPROCESS_BACKEND_HPP
+#define PREPROCESS_BACKEND_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "color_space.hpp"
+#include "latency_histogram.hpp"
+#include "resize_filter.hpp"
+#include "yuv_frame.hpp"
+
+// Source frames are BGR24 (CV_8UC3), or planar I420 (CV_8UC1, width x
+// height * 3 / 2, even sizes) as VideoReader::PixelFormat::I420 reads
+// them. I420 sources are resized plane by plane with no colour conversion,
+// so they keep the decoder's matrix and range.
+inline bool isI420Frame(const cv::Mat &frame) { return frame.type() == CV_8UC1; }
+// Picture height of a source frame in either layout
+inline int sourceHeight(const cv::Mat &frame) { return isI420Frame(frame) ? frame.rows * 2 / 3 : frame.rows; }
+
+// Common interface for everything that turns a source frame into a resized
+// I420 frame (OpenCL driver, native CPU path, ...). Frames are submitted
+// and collected in order; up to slotCount() may be outstanding at once.
+class PreprocessBackend
+{
+public:
+    // Handle returned by submitFrame(); redeem it with waitMappedFrame().
+    using FrameTicket = uint64_t;
+
+    struct OutputSize
+    {
+        int width = 0;
+        int height = 0;
+    };
+
+    virtual ~PreprocessBackend() = default;
+
+    // Short identifier for logs and summaries, e.g. "opencl" or "cpu-avx2".
+    virtual std::string name() const = 0;
+
+    virtual size_t slotCount() const = 0;
+
+    // Filter for frames submitted from now on (default Auto). Set it
+    // between streams, not while frames are in flight; backends that wrap
+    // others override this to pass it on.
+    virtual void setResizeFilter(ResizeFilter filter) { resizeFilter_ = filter; }
+    ResizeFilter resizeFilter() const { return resizeFilter_; }
+
+    // Y'CbCr matrix and range of the output frames (default BT.601,
+    // limited range), with the same rule on when to change it.
+    virtual void setColorSpace(ColorSpace space) { colorSpace_ = space; }
+    ColorSpace colorSpace() const { return colorSpace_; }
+
+    // Start preprocessing one frame. The input's pixel data must stay
+    // untouched until the ticket is waited on.
+    virtual FrameTicket submitFrame(const cv::Mat &input, int targetWidth, int targetHeight) = 0;
+
+    // Block until the frame is done and return a handle to its I420 data.
+    // Tickets must be waited on in submission order.
+    virtual YuvFrame waitMappedFrame(FrameTicket ticket) = 0;
+
+    // Preprocess one input to several output sizes (a rendition ladder).
+    // The default submits a frame per size, relying on tickets being
+    // consecutive; OpenCLDriver uploads the input once and produces every
+    // size from the same device buffer. Throws std::invalid_argument if
+    // sizes is empty or larger than slotCount().
+    virtual FrameTicket submitRenditions(const cv::Mat &input, const std::vector<OutputSize> &sizes);
+
+    // Wait for the count frames of a submitRenditions() ticket, in size order.
+    virtual void waitRenditions(FrameTicket ticket, size_t count, std::vector<YuvFrame> &frames);
+
+    // Ladders of this many sizes that may be in flight at once.
+    virtual size_t renditionSlotCount(size_t sizes) const { return sizes > 0 ? slotCount() / sizes : 0; }
+
+    // Like waitMappedFrame(), but copies the frame into outputYUV and
+    // releases it immediately.
+    void waitFrame(FrameTicket ticket, std::vector<uint8_t> &outputYUV)
+    {
+        YuvFrame frame = waitMappedFrame(ticket);
+        outputYUV.assign(frame.data(), frame.data() + frame.size());
+    }
+
+    // Per-stage latencies measured inside the backend (device timings for
+    // OpenCL), over every frame waited on so far; empty if not measured.
+    // Call once the frames are done.
+    virtual StageLatencies stageLatencies() const { return {}; }
+
+    // Synchronous convenience wrapper: submitFrame() + waitFrame().
+    void processFrame(const cv::Mat &input, std::vector<uint8_t> &outputYUV, int targetWidth, int targetHeight)
+    {
+        waitFrame(submitFrame(input, targetWidth, targetHeight), outputYUV);
+    }
+
+protected:
+    ResizeFilter resizeFilter_ = ResizeFilter::Auto;
+    ColorSpace colorSpace_;
+};
+
+// Create a backend by name: "opencl" (first GPU), "multi" (every OpenCL
+// device), "cpu", or "auto" (OpenCL if a GPU is usable, sharded across all
+// devices when there are several; otherwise the native CPU path).
+// cpuThreads caps the CPU backend's worker pool (0 = all cores), for when
+// several backends run side by side. Throws std::invalid_argument for
+// unknown names and std::runtime_error if the backend cannot start.
+std::unique_ptr<PreprocessBackend> createBackend(const std::string &name = "auto", size_t cpuThreads = 0);
+
+#endif // PREPROCESS_BACKEND_HPP
@@ -0,0 +1,42 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <cstddef>
+#include <string>
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Build an OpenCL program for one device, reusing a device binary from the
+// on-disk cache when one exists for the same platform, device, driver
+// version, build options and source. Freshly built binaries are stored for
+// the next run; cache errors are never fatal. Throws std::runtime_error if
+// the program cannot be built.
+cl_program buildProgramCached(cl_context context, cl_device_id device,
+                              const std::string &source, const std::string &options = "");
+
+// Directory for cached binaries: $VIDEO_RESIZER_CACHE_DIR, else the
+// platform's per-user cache directory. Empty if none can be determined,
+// which disables caching.
+std::string programCacheDirectory();
+
+// Work-group size tuned for one kernel launch, cached next to the program
+// binaries under the same platform, device and driver key plus the
+// program source and launchKey (kernel name, build options, global size).
+// {0, 0} means the runtime's own choice. False if nothing is cached.
+bool loadCachedLocalSize(cl_device_id device, const std::string &source, const std::string &launchKey,
+                         size_t local[2]);
+void storeCachedLocalSize(cl_device_id device, const std::string &source, const std::string &launchKey,
+                          const size_t local[2]);
+
+// Write size bytes to path, creating its directory, through a private
+// temporary that is renamed into place, so concurrent processes never see
+// a partial file. Best effort: on failure the old file, if any, is kept.
+void storeFileAtomically(const std::string &path, const char *data, size_t size);
+
+// The contents of kernels/opencl_preprocess.cl, embedded at build time.
+const std::string &openclPreprocessSource();
+
+#endif // PROGRAM_CACHE_HPP
@@ -0,0 +1,90 @@
+#ifndef REORDER_BUFFER_HPP
+#define REORDER_BUFFER_HPP
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+// Collects items produced out of order by several workers and hands them
+// out by sequence number, starting at 0. At most `window` sequence numbers
+// past the next one to pop may be buffered; producers further ahead block.
+// Storage is one slot per window position, allocated up front.
+template <typename T>
+class ReorderBuffer
+{
+public:
+  explicit ReorderBuffer(size_t window)
+      : window_(window > 0 ? window : 1), items_(window_), present_(window_, false) {}
+
+  // Store the item for `seq`. Returns false if the buffer is closed.
+  bool put(uint64_t seq, T &&item)
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_space_.wait(lock, [this, seq]
+                     { return seq < next_ + window_ || closed_; });
+    if (closed_)
+      return false;
+    items_[seq % window_] = std::move(item);
+    present_[seq % window_] = true;
+    if (seq == next_)
+      cond_ready_.notify_all();
+    return true;
+  }
+
+  // Pop the next item in sequence. Returns false once closed and the next
+  // item can no longer arrive.
+  bool pop(T &item)
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_ready_.wait(lock, [this]
+                     { return present_[next_ % window_] || closed_; });
+    size_t index = next_ % window_;
+    if (!present_[index])
+      return false;
+    item = std::move(items_[index]);
+    present_[index] = false;
+    ++next_;
+    cond_space_.notify_all();
+    return true;
+  }
+
+  // Wake up all waiting threads; buffered items are dropped on destruction.
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      closed_ = true;
+    }
+    cond_ready_.notify_all();
+    cond_space_.notify_all();
+  }
+
+  // Drop the buffered items now, so what they hold (backend slots) is
+  // released without waiting for destruction.
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (size_t i = 0; i < window_; ++i)
+    {
+      if (present_[i])
+      {
+        items_[i] = T();
+        present_[i] = false;
+      }
+    }
+  }
+
+private:
+  size_t window_;
+  std::vector<T> items_;
+  std::vector<bool> present_;
+  std::mutex mtx_;
+  std::condition_variable cond_ready_;
+  std::condition_variable cond_space_;
+  uint64_t next_ = 0;
+  bool closed_ = false;
+};
+
+#endif // REORDER_BUFFER_HPP
@@ -0,0 +1,52 @@
+#ifndef RESIZE_FILTER_HPP
+#define RESIZE_FILTER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Resampling filter used by the preprocessing backends.
+enum class ResizeFilter
+{
+    Auto,     // Fast up to a 2x downscale, Area beyond
+    Fast,     // fused 4-tap bilinear (resize_bgr_to_i420); aliases on large downscales
+    Bilinear, // polyphase triangle, widened by the downscale factor
+    Bicubic,  // polyphase Catmull-Rom style cubic (a = -0.5)
+    Lanczos,  // polyphase Lanczos-3
+    Area      // polyphase pixel-area average; bilinear when upscaling
+};
+
+const char *resizeFilterName(ResizeFilter filter);
+// Throws std::invalid_argument for unknown names.
+ResizeFilter parseResizeFilter(const std::string &name);
+
+// The filter actually used for a geometry: resolves Auto, keeps the rest.
+ResizeFilter resolveResizeFilter(ResizeFilter filter, int srcW, int srcH, int dstW, int dstH);
+
+// Polyphase weights are 2.14 fixed point and sum to exactly 1 << 14 per
+// output sample, so every backend computes the same integers.
+const int RESIZE_WEIGHT_BITS = 14;
+
+// One direction of a separable resize: output sample i is
+// sum(weights[i * taps + t] * src[offsets[i] + t]) >> RESIZE_WEIGHT_BITS,
+// rounded and clamped to 0..255. Taps that would fall outside the source
+// are folded onto the edge sample, so offsets[i] + taps <= srcSize.
+struct ResizeCoefficients
+{
+    int taps = 0;
+    std::vector<int32_t> offsets;
+    std::vector<int16_t> weights;
+};
+
+// Throws std::invalid_argument for Auto/Fast or non-positive sizes.
+ResizeCoefficients computeResizeCoefficients(int srcSize, int dstSize, ResizeFilter filter);
+
+// Output frame size for a requested width/height, each 0 = unspecified:
+// neither given keeps the old half-size output; one given derives the
+// other from the source aspect ratio; both given stretches to exactly that
+// size unless keepAspect, which fits the frame inside the box instead.
+// Results are rounded down to even sizes, as 4:2:0 encoding needs.
+void computeOutputSize(int srcW, int srcH, int requestW, int requestH, bool keepAspect,
+                       int &outW, int &outH);
+
+#endif // RESIZE_FILTER_HPP
@@ -0,0 +1,36 @@
+#ifndef RUN_REPORT_HPP
+#define RUN_REPORT_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "latency_histogram.hpp"
+
+// Machine-readable summary of one run: top-level fields in the order they
+// were set, then a "stages" object with the count, mean and p50/p90/p99/
+// max latency in milliseconds of every stage added, e.g.
+//   {"backend": "opencl", "frames": 300, ...,
+//    "stages": {"decode": {"count": 300, "mean_ms": 2.1, "p50_ms": 2.0, ...}}}
+class RunReport
+{
+public:
+    void set(const std::string &key, const std::string &value);
+    void set(const std::string &key, const char *value) { set(key, std::string(value)); }
+    void set(const std::string &key, double value);
+    // Stages without samples are left out
+    void addStage(const std::string &name, const LatencyHistogram &latency);
+
+    std::string toJson() const;
+    // Throws std::runtime_error if the file cannot be written
+    void write(const std::string &path) const;
+
+private:
+    std::vector<std::pair<std::string, std::string>> fields_; // key, JSON value
+    StageLatencies stages_;
+};
+
+// A JSON string literal for value, quotes included
+std::string jsonQuote(const std::string &value);
+
+#endif // RUN_REPORT_HPP
@@ -0,0 +1,85 @@
+#ifndef SEGMENTED_TRANSCODE_HPP
+#define SEGMENTED_TRANSCODE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "encoder.hpp"
+#include "pipeline.hpp"
+#include "video_reader.hpp"
+
+class PreprocessBackend;
+
+// Keyframe positions of a file's first video stream, as 0-based frame
+// indices in presentation order.
+struct KeyframeIndex
+{
+    std::vector<int64_t> keyframes;
+    int64_t frameCount = 0;
+};
+
+// A run of frames starting at a keyframe
+struct Segment
+{
+    int64_t startFrame = 0;
+    int64_t frameCount = 0;
+};
+
+// List the video packets with ffprobe (no decoding). Assumes a constant
+// frame rate, the same assumption OpenCV's frame seeking makes. Throws
+// std::runtime_error if ffprobe cannot be run or finds no video frames.
+KeyframeIndex probeKeyframes(const std::string &path);
+
+// Split frameCount frames into at most `segments` runs that each start at
+// a keyframe, with boundaries at the keyframes closest to an even split.
+// Frame 0 always starts the first run. Fewer runs come back when there
+// are too few keyframes.
+std::vector<Segment> planSegments(const KeyframeIndex &index, size_t segments);
+
+struct SegmentedOptions
+{
+    size_t segments = 2;
+    // outWidth/outHeight required; maxFrames is set per segment.
+    // onFrameEncoded gets the total over all segments and may be called
+    // from several segments' encoder threads at once.
+    PipelineOptions pipeline;
+    EncoderOptions encoder;
+    VideoReader::Options reader; // how each segment is decoded
+    // Backends for one segment's pipeline; called once per segment, on
+    // the calling thread, before any segment starts
+    std::function<std::vector<std::unique_ptr<PreprocessBackend>>()> makeBackends;
+};
+
+struct SegmentedStats
+{
+    struct SegmentStats
+    {
+        Segment segment;
+        PipelineStats pipeline;
+    };
+
+    size_t framesProcessed = 0;
+    double probeSec = 0.0;
+    double concatSec = 0.0;
+    double totalSec = 0.0;         // probe + segments + concat
+    double segmentSecSum = 0.0;    // sum of the segment pipelines' run times
+    double segmentsWallSec = 0.0;  // time from the first segment start to the last end
+    std::vector<SegmentStats> segments;
+
+    // Segment time over wall time. Segments sharing cores slow each other
+    // down, so this is an upper bound on the gain over a sequential run.
+    double speedup() const { return segmentsWallSec > 0.0 ? segmentSecSum / segmentsWallSec : 0.0; }
+};
+
+// Transcode inPath to outPath as independent pipelines, one per segment,
+// each seeking to its first keyframe and encoding to its own file; the
+// encoded segments are then joined without re-encoding by ffmpeg's concat
+// demuxer. Produces the same frames in the same order as runPipeline();
+// each segment starts a new GOP. Throws std::runtime_error on failure.
+SegmentedStats runSegmented(const std::string &inPath, const std::string &outPath,
+                            const SegmentedOptions &options);
+
+#endif // SEGMENTED_TRANSCODE_HPP
@@ -0,0 +1,334 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace spsc_detail
+{
+constexpr size_t CACHE_LINE = 64;
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Sleep/wake primitive for one side of the ring: wait() returns once the
+// epoch differs from the value read before re-checking the condition, so a
+// notify() between the check and the sleep is never lost. The seq_cst
+// fences pair up Dekker-style: either the waiter sees the new state or the
+// notifier sees the waiter, so notify() stays a fence and a load unless
+// someone is actually sleeping. Each side has a single thread, so one flag
+// is enough, and only the first notify() after it is raised makes a
+// syscall.
+class EpochWaiter
+{
+public:
+  uint32_t epoch() const { return epoch_.load(std::memory_order_relaxed); }
+
+  void prepareWait()
+  {
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  void cancelWait() { sleeping_.store(false, std::memory_order_relaxed); }
+
+  // Call between prepareWait() and cancelWait().
+  void wait(uint32_t seen)
+  {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch_), FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+#else
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait(lock, [this, seen]
+               { return epoch_.load() != seen; });
+#endif
+  }
+
+  // Call after publishing the state change the waiter is looking for.
+  void notify()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping_.load(std::memory_order_relaxed) || !sleeping_.exchange(false, std::memory_order_relaxed))
+      return;
+    epoch_.fetch_add(1, std::memory_order_relaxed);
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+    }
+    cond_.notify_all();
+#endif
+  }
+
+private:
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<bool> sleeping_{false};
+#if !defined(__linux__)
+  std::mutex mtx_;
+  std::condition_variable cond_;
+#endif
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+} // namespace spsc_detail
+
+// Fixed-capacity ring for exactly one producer thread and one consumer
+// thread. Indices are published with acquire/release, each side keeps a
+// cached copy of the other's index, and the hot fields sit on separate
+// cache lines, so a push or pop is a few loads and one store with no lock.
+// Blocking calls spin briefly and then sleep on a futex (a mutex and
+// condition variable where futexes are unavailable).
+//
+// Drop-in for BoundedQueue on 1:1 links: same push/pop/close semantics.
+template <typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(size_t capacity)
+      : capacity_(capacity > 0 ? capacity : 1)
+  {
+    size_t size = 1;
+    while (size < capacity_)
+      size <<= 1;
+    mask_ = size - 1;
+    slots_.resize(size);
+  }
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  size_t capacity() const { return capacity_; }
+
+  // Producer: enqueue without blocking. Returns false if full or closed.
+  bool try_push(const T &item) { return emplace(item); }
+  bool try_push(T &&item) { return emplace(std::move(item)); }
+
+  // Producer: push an item, waiting for space. Returns false if closed.
+  bool push(const T &item)
+  {
+    T copy(item);
+    return push(std::move(copy));
+  }
+
+  bool push(T &&item)
+  {
+    for (;;)
+    {
+      if (emplace(std::move(item)))
+        return true;
+      if (closed_.load(std::memory_order_acquire) || !waitForSpace())
+        return false;
+    }
+  }
+
+  // Producer: move all `count` items in, publishing as many per index
+  // update as fit. Returns false if the ring was closed first.
+  bool push_batch(T *items, size_t count)
+  {
+    while (count > 0)
+    {
+      if (closed_.load(std::memory_order_acquire))
+        return false;
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      size_t space = capacity_ - (tail - headCache_);
+      if (space == 0)
+      {
+        headCache_ = head_.load(std::memory_order_acquire);
+        space = capacity_ - (tail - headCache_);
+      }
+      if (space == 0)
+      {
+        if (!waitForSpace())
+          return false;
+        continue;
+      }
+      size_t n = space < count ? space : count;
+      for (size_t i = 0; i < n; ++i)
+        slots_[(tail + i) & mask_] = std::move(items[i]);
+      tail_.store(tail + n, std::memory_order_release);
+      notEmpty_.notify();
+      items += n;
+      count -= n;
+    }
+    return true;
+  }
+
+  // Consumer: dequeue without blocking. Returns false if empty.
+  bool try_pop(T &item)
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tailCache_)
+    {
+      tailCache_ = tail_.load(std::memory_order_acquire);
+      if (head == tailCache_)
+        return false;
+    }
+    item = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    notFull_.notify();
+    return true;
+  }
+
+  // Consumer: pop an item. Returns false if the ring is empty *and* closed.
+  bool pop(T &item)
+  {
+    for (;;)
+    {
+      if (try_pop(item))
+        return true;
+      if (!waitForItems())
+        return try_pop(item);
+    }
+  }
+
+  // Consumer: wait for at least one item, then take up to maxItems in one
+  // index update. Returns 0 only once the ring is empty and closed.
+  size_t pop_batch(T *out, size_t maxItems)
+  {
+    if (maxItems == 0)
+      return 0;
+    for (;;)
+    {
+      size_t head = head_.load(std::memory_order_relaxed);
+      tailCache_ = tail_.load(std::memory_order_acquire);
+      size_t available = tailCache_ - head;
+      if (available > 0)
+      {
+        size_t n = available < maxItems ? available : maxItems;
+        for (size_t i = 0; i < n; ++i)
+          out[i] = std::move(slots_[(head + i) & mask_]);
+        head_.store(head + n, std::memory_order_release);
+        notFull_.notify();
+        return n;
+      }
+      if (!waitForItems() && tail_.load(std::memory_order_acquire) == head)
+        return 0;
+    }
+  }
+
+  // Signal no more pushes; wakes up any waiting threads. Items already in
+  // the ring can still be popped.
+  void close()
+  {
+    closed_.store(true, std::memory_order_release);
+    notEmpty_.notify();
+    notFull_.notify();
+  }
+
+private:
+  static constexpr int SPIN_LIMIT = 256;
+
+  template <typename U>
+  bool emplace(U &&item)
+  {
+    if (closed_.load(std::memory_order_relaxed))
+      return false;
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - headCache_ == capacity_)
+    {
+      headCache_ = head_.load(std::memory_order_acquire);
+      if (tail - headCache_ == capacity_)
+        return false;
+    }
+    slots_[tail & mask_] = std::forward<U>(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    notEmpty_.notify();
+    return true;
+  }
+
+  bool hasSpace() const
+  {
+    return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire) < capacity_;
+  }
+
+  bool hasItems() const
+  {
+    return tail_.load(std::memory_order_acquire) != head_.load(std::memory_order_relaxed);
+  }
+
+  // Spin, then sleep until `ready` holds or the ring is closed. Returns
+  // false if it gave up because the ring was closed.
+  template <typename Ready>
+  bool waitUntil(spsc_detail::EpochWaiter &waiter, Ready ready)
+  {
+    // Spinning only pays off if the other side runs on another core
+    static const int spinLimit = std::thread::hardware_concurrency() > 1 ? SPIN_LIMIT : 0;
+    for (int i = 0; i < spinLimit; ++i)
+    {
+      if (ready())
+        return true;
+      if (closed_.load(std::memory_order_acquire))
+        return false;
+      spsc_detail::cpuRelax();
+    }
+    for (;;)
+    {
+      waiter.prepareWait();
+      uint32_t seen = waiter.epoch();
+      bool isReady = ready();
+      bool isClosed = closed_.load(std::memory_order_acquire);
+      if (!isReady && !isClosed)
+        waiter.wait(seen);
+      waiter.cancelWait();
+      if (isReady || ready())
+        return true;
+      if (isClosed || closed_.load(std::memory_order_acquire))
+        return false;
+    }
+  }
+
+  bool waitForSpace()
+  {
+    return waitUntil(notFull_, [this]
+                     { return hasSpace(); });
+  }
+
+  bool waitForItems()
+  {
+    return waitUntil(notEmpty_, [this]
+                     { return hasItems(); });
+  }
+
+  // Consumer side
+  alignas(spsc_detail::CACHE_LINE) std::atomic<size_t> head_{0};
+  size_t tailCache_ = 0;
+
+  // Producer side
+  alignas(spsc_detail::CACHE_LINE) std::atomic<size_t> tail_{0};
+  size_t headCache_ = 0;
+
+  // Shared, read-mostly
+  alignas(spsc_detail::CACHE_LINE) std::atomic<bool> closed_{false};
+  size_t capacity_;
+  size_t mask_ = 0;
+  std::vector<T> slots_;
+
+  alignas(spsc_detail::CACHE_LINE) spsc_detail::EpochWaiter notEmpty_;
+  alignas(spsc_detail::CACHE_LINE) spsc_detail::EpochWaiter notFull_;
+};
+
+#endif // SPSC_RING_HPP
@@ -0,0 +1,14 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include <chrono>
+
+// Clock for the wall-time stats the pipeline stages report
+using Clock = std::chrono::steady_clock;
+
+inline double secondsBetween(Clock::time_point t0, Clock::time_point t1)
+{
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+#endif // TIMING_HPP
@@ -0,0 +1,71 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Opt-in timeline of the pipeline threads, written as a Chrome trace-event
+// JSON file (chrome://tracing, ui.perfetto.dev). Each thread records into
+// its own fixed-size buffer with no locks after its first event; a full
+// buffer drops further events rather than allocating. While tracing is off
+// a TraceScope is one relaxed load.
+
+// Start recording, with room for eventsPerThread events on each thread.
+// Call before the traced threads start; tracing stays on until exit or
+// resetTracing().
+void enableTracing(size_t eventsPerThread = 1 << 18);
+
+// Turn tracing off and drop everything recorded, so the next
+// enableTracing() starts empty. For tests; no scope started while tracing
+// was on may still be open.
+void resetTracing();
+
+namespace trace_detail
+{
+extern std::atomic<bool> enabled;
+
+int64_t nowNs();
+void record(const char *name, int64_t frame, int64_t startNs, int64_t endNs);
+} // namespace trace_detail
+
+inline bool tracingEnabled()
+{
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Label for the calling thread's track; no-op while tracing is off
+void setTraceThreadName(const std::string &name);
+
+// Write everything recorded so far. Call once the traced threads are done;
+// throws std::runtime_error if the file cannot be written.
+void writeTrace(const std::string &path);
+
+// Records [construction, destruction) as one event. name must outlive the
+// trace (a string literal); frame is the sequence number or -1.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, int64_t frame = -1)
+        : name_(name), frame_(frame), startNs_(tracingEnabled() ? trace_detail::nowNs() : -1) {}
+
+    ~TraceScope()
+    {
+        if (startNs_ >= 0)
+            trace_detail::record(name_, frame_, startNs_, trace_detail::nowNs());
+    }
+
+    // For events whose frame is only known at the end, e.g. a queue pop
+    void setFrame(int64_t frame) { frame_ = frame; }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name_;
+    int64_t frame_;
+    int64_t startNs_;
+};
+
+#endif // TRACE_HPP
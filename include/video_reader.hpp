@@ -1,21 +1,114 @@
 #ifndef VIDEO_READER_HPP
 #define VIDEO_READER_HPP
 
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <opencv2/opencv.hpp>
 
 class VideoReader
 {
 public:
-    VideoReader(const std::string &path);
+    // Layout of the frames getNextFrame() returns
+    enum class PixelFormat
+    {
+        BGR, // CV_8UC3, converted by OpenCV
+        // The decoder's planar YUV as I420 in one CV_8UC1 Mat of width x
+        // height * 3 / 2 (Y, then U, then V), read from an ffmpeg child
+        // process; skips the BGR conversion and halves the frame size.
+        // Needs ffmpeg on the PATH and an even frame size.
+        I420
+    };
+
+    struct Options
+    {
+        PixelFormat format = PixelFormat::BGR;
+        // Decoder threads; 0 = the decoder's default
+        int decodeThreads = 0;
+        // Frames decoded ahead on a background thread; 0 = decode in
+        // getNextFrame() on the caller's thread
+        size_t readAhead = 0;
+    };
+
+    // Decode counters. With read-ahead the decoder runs on its own
+    // thread, so decodeSec + convertSec is hidden unless stallSec grows.
+    struct Stats
+    {
+        size_t frames = 0;
+        double decodeSec = 0.0;  // grab(): demux and decode (I420: waiting on ffmpeg)
+        double convertSec = 0.0; // retrieve(): conversion to BGR and copy out
+        double stallSec = 0.0;   // getNextFrame() waited for a decoded frame
+        double fullSec = 0.0;    // the read-ahead thread waited for a free buffer
+    };
+
+    // Throws std::runtime_error if the file cannot be opened or the I420
+    // decoder cannot start, std::invalid_argument for odd I420 sizes.
+    VideoReader(const std::string &path, PixelFormat format = PixelFormat::BGR);
+    VideoReader(const std::string &path, const Options &options);
+    ~VideoReader();
+
+    VideoReader(const VideoReader &) = delete;
+    VideoReader &operator=(const VideoReader &) = delete;
+
+    // With read-ahead the frame's buffer is swapped with a decoded one
+    // rather than copied into, so it must not be shared with another Mat.
+    // Returns false at the end of the stream; throws std::runtime_error if
+    // the I420 decoder exits with an error instead.
     bool getNextFrame(cv::Mat &frame);
 
+    // Position the stream so the next frame read is frameIndex (0-based,
+    // presentation order). Exact when frameIndex is a keyframe.
+    bool seekToFrame(int64_t frameIndex);
+
     int getWidth() const;
     int getHeight() const;
     double getFPS() const;
+    // Container estimate; may be 0 or slightly off for some formats
+    int64_t getFrameCount() const;
+
+    PixelFormat pixelFormat() const { return options_.format; }
+    // Shape of the Mats getNextFrame() fills, for preallocating them
+    int frameRows() const;
+    int frameType() const;
+
+    // Safe to call while frames are being read
+    Stats stats() const;
 
 private:
     cv::VideoCapture cap_;
+    Options options_;
+    std::string path_;
+    FILE *decoder_ = nullptr; // I420: ffmpeg's raw output
+    // Stream properties, read once so the read-ahead thread owns cap_
+    int width_ = 0;
+    int height_ = 0;
+    double fps_ = 0.0;
+    int64_t frameCount_ = 0;
+
+    // Read-ahead ring of decoded frames, oldest at head_
+    std::vector<cv::Mat> ring_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    bool ended_ = false;    // the decoder ran out of frames
+    std::exception_ptr error_; // why it did, if it failed
+    bool stopping_ = false; // stopReadAhead() asked the thread to exit
+    std::thread readAheadThread_;
+    mutable std::mutex mutex_;
+    std::condition_variable frameReady_;
+    std::condition_variable slotFree_;
+    Stats stats_;
+
+    void startDecoder(double startSec);
+    int stopDecoder(); // ffmpeg's exit status, 0 without a decoder
+    bool decodeFrame(cv::Mat &frame);
+    void startReadAhead();
+    void stopReadAhead();
+    void readAheadLoop();
 };
 
 #endif
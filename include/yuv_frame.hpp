@@ -0,0 +1,108 @@
+#ifndef YUV_FRAME_HPP
+#define YUV_FRAME_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Implemented by whoever owns the memory behind a YuvFrame (a driver slot,
+// a buffer pool, ...). releaseFrame() is called exactly once per handle.
+class FrameOwner
+{
+public:
+    virtual ~FrameOwner() = default;
+    virtual void releaseFrame(size_t slot) = 0;
+};
+
+// Move-only handle to a finished I420 frame living in memory owned by a
+// FrameOwner. Passing it through the pipeline moves a pointer, not pixels;
+// the memory goes back to its owner on release() or destruction.
+class YuvFrame
+{
+public:
+    YuvFrame() = default;
+    YuvFrame(FrameOwner *owner, size_t slot, const uint8_t *data, size_t size)
+        : owner_(owner), slot_(slot), data_(data), size_(size) {}
+
+    YuvFrame(const YuvFrame &) = delete;
+    YuvFrame &operator=(const YuvFrame &) = delete;
+
+    YuvFrame(YuvFrame &&other) noexcept
+        : owner_(other.owner_), slot_(other.slot_), data_(other.data_), size_(other.size_)
+    {
+        other.owner_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    // Releases the current frame first, so it throws what release() does
+    YuvFrame &operator=(YuvFrame &&other)
+    {
+        if (this != &other)
+        {
+            release();
+            owner_ = other.owner_;
+            slot_ = other.slot_;
+            data_ = other.data_;
+            size_ = other.size_;
+            other.owner_ = nullptr;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    // Destructors cannot throw, so an owner's error on this implicit
+    // release is dropped; call release() first to see it
+    ~YuvFrame()
+    {
+        try
+        {
+            release();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+    // Return the memory to its owner. Safe to call more than once; the
+    // handle is empty afterwards even if the owner throws.
+    void release()
+    {
+        FrameOwner *owner = owner_;
+        owner_ = nullptr;
+        data_ = nullptr;
+        size_ = 0;
+        if (owner)
+            owner->releaseFrame(slot_);
+    }
+
+private:
+    FrameOwner *owner_ = nullptr;
+    size_t slot_ = 0;
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Size and byte offset of plane 0 (Y), 1 (U) or 2 (V) in a contiguous
+// I420 frame of width x height
+struct I420Plane
+{
+    int width = 0;
+    int height = 0;
+    size_t offset = 0;
+};
+
+inline I420Plane i420Plane(int width, int height, int plane)
+{
+    I420Plane p;
+    p.width = plane == 0 ? width : width / 2;
+    p.height = plane == 0 ? height : height / 2;
+    if (plane > 0)
+        p.offset = (size_t)width * height + (size_t)(plane - 1) * (width / 2) * (height / 2);
+    return p;
+}
+
+#endif // YUV_FRAME_HPP
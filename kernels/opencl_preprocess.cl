@@ -1,14 +1,73 @@
-// resize_bilinear
-__kernel void resize_bilinear(__global const uchar *src, int srcW, int srcH,
-                              __global uchar *dst, int dstW, int dstH)
+// Y'CbCr conversion in fixed point with COLOR_COEFF_BITS (14) fractional
+// bits. The matrix and range are build options: -D COLOR_MATRIX_BT709
+// selects BT.709 (BT.601 otherwise) and -D COLOR_RANGE_FULL full range
+// (limited otherwise). The constants must match colorCoefficients() in
+// color_space.cpp.
+#define COLOR_COEFF_BITS 14
+#if defined(COLOR_MATRIX_BT709) && defined(COLOR_RANGE_FULL)
+#define COLOR_Y_R 3483
+#define COLOR_Y_G 11718
+#define COLOR_Y_B 1183
+#define COLOR_U_R -1877
+#define COLOR_U_G -6315
+#define COLOR_V_G -7441
+#define COLOR_V_B -751
+#elif defined(COLOR_MATRIX_BT709)
+#define COLOR_Y_R 2991
+#define COLOR_Y_G 10064
+#define COLOR_Y_B 1016
+#define COLOR_U_R -1649
+#define COLOR_U_G -5547
+#define COLOR_V_G -6536
+#define COLOR_V_B -660
+#elif defined(COLOR_RANGE_FULL)
+#define COLOR_Y_R 4899
+#define COLOR_Y_G 9617
+#define COLOR_Y_B 1868
+#define COLOR_U_R -2765
+#define COLOR_U_G -5427
+#define COLOR_V_G -6860
+#define COLOR_V_B -1332
+#else
+#define COLOR_Y_R 4207
+#define COLOR_Y_G 8260
+#define COLOR_Y_B 1604
+#define COLOR_U_R -2428
+#define COLOR_U_G -4768
+#define COLOR_V_G -6026
+#define COLOR_V_B -1170
+#endif
+#ifdef COLOR_RANGE_FULL
+#define COLOR_Y_OFFSET 0
+#define COLOR_C_MAX 8192 // 0.5 in the U (B) and V (R) terms
+#else
+#define COLOR_Y_OFFSET 16
+#define COLOR_C_MAX 7196
+#endif
+
+inline uchar color_luma(int b, int g, int r)
 {
-    int dx = get_global_id(0);
-    int dy = get_global_id(1);
+    int acc = COLOR_Y_R * r + COLOR_Y_G * g + COLOR_Y_B * b +
+              (COLOR_Y_OFFSET << COLOR_COEFF_BITS) + (1 << (COLOR_COEFF_BITS - 1));
+    return (uchar)clamp(acc >> COLOR_COEFF_BITS, 0, 255);
+}
 
-    if (dx >= dstW || dy >= dstH) return;
+// Chroma of a 2x2 block from the sums of its four pixels
+inline uchar color_chroma(int kb, int kg, int kr, int sumB, int sumG, int sumR)
+{
+    int acc = kb * sumB + kg * sumG + kr * sumR +
+              (128 << (COLOR_COEFF_BITS + 2)) + (1 << (COLOR_COEFF_BITS + 1));
+    return (uchar)clamp(acc >> (COLOR_COEFF_BITS + 2), 0, 255);
+}
 
-    float x_ratio = (float)(srcW - 1) / (dstW - 1);
-    float y_ratio = (float)(srcH - 1) / (dstH - 1);
+#define color_u(sumB, sumG, sumR) color_chroma(COLOR_C_MAX, COLOR_U_G, COLOR_U_R, sumB, sumG, sumR)
+#define color_v(sumB, sumG, sumR) color_chroma(COLOR_V_B, COLOR_V_G, COLOR_C_MAX, sumB, sumG, sumR)
+
+// Bilinear sample of one BGR pixel: endpoint-aligned ratios
+// ((src - 1) / (dst - 1)) and float interpolation
+inline uchar3 sample_bilinear(__global const uchar *src, int srcW, int srcH,
+                              float x_ratio, float y_ratio, int dx, int dy)
+{
     float sx = x_ratio * dx;
     float sy = y_ratio * dy;
     int x = (int)sx;
@@ -19,71 +78,371 @@ __kernel void resize_bilinear(__global const uchar *src, int srcW, int srcH,
     int x1 = min(x + 1, srcW - 1);
     int y1 = min(y + 1, srcH - 1);
 
+    float out[3];
     for(int c = 0; c < 3; ++c) {
-        int idx00 = (y  * srcW + x ) * 3 + c;
-        int idx01 = (y  * srcW + x1) * 3 + c;
-        int idx10 = (y1 * srcW + x ) * 3 + c;
-        int idx11 = (y1 * srcW + x1) * 3 + c;
-
-        float a = src[idx00];
-        float b = src[idx01];
-        float d = src[idx10];
-        float e = src[idx11];
+        float a = src[(y  * srcW + x ) * 3 + c];
+        float b = src[(y  * srcW + x1) * 3 + c];
+        float d = src[(y1 * srcW + x ) * 3 + c];
+        float e = src[(y1 * srcW + x1) * 3 + c];
 
         float pixel = a*(1-x_diff)*(1-y_diff) + b*(x_diff)*(1-y_diff) +
                       d*(1-x_diff)*(y_diff) + e*(x_diff)*(y_diff);
+        out[c] = clamp(pixel, 0.0f, 255.0f);
+    }
+    return (uchar3)((uchar)out[0], (uchar)out[1], (uchar)out[2]);
+}
 
-        dst[(dy * dstW + dx)*3 + c] = (uchar)clamp(pixel, 0.0f, 255.0f);
+// resize_bgr_to_i420
+// Fused resize + BGR->YUV420. One work-item per 2x2 output block; the
+// result is written as a single contiguous I420 frame (Y, then U, then V).
+__kernel void resize_bgr_to_i420(__global const uchar *src, int srcW, int srcH,
+                                 __global uchar *dst, int dstW, int dstH)
+{
+    int bx = get_global_id(0);
+    int by = get_global_id(1);
+    int x0 = bx * 2;
+    int y0 = by * 2;
+
+    if (x0 >= dstW || y0 >= dstH) return;
+
+    float x_ratio = (float)(srcW - 1) / (dstW - 1);
+    float y_ratio = (float)(srcH - 1) / (dstH - 1);
+
+    int uv_width = dstW / 2;
+    int uv_height = dstH / 2;
+    __global uchar *dstY = dst;
+    __global uchar *dstU = dst + dstW * dstH;
+    __global uchar *dstV = dstU + uv_width * uv_height;
+
+    int sumB = 0, sumG = 0, sumR = 0;
+
+    for(int dy = 0; dy < 2; ++dy) {
+        for(int dx = 0; dx < 2; ++dx) {
+            int px = x0 + dx;
+            int py = y0 + dy;
+            if(px < dstW && py < dstH) {
+                uchar3 bgr = sample_bilinear(src, srcW, srcH, x_ratio, y_ratio, px, py);
+                dstY[py * dstW + px] = color_luma(bgr.x, bgr.y, bgr.z);
+                sumB += bgr.x;
+                sumG += bgr.y;
+                sumR += bgr.z;
+            }
+        }
     }
+
+    if (bx < uv_width && by < uv_height) {
+        int uv_idx = by * uv_width + bx;
+        dstU[uv_idx] = color_u(sumB, sumG, sumR);
+        dstV[uv_idx] = color_v(sumB, sumG, sumR);
+    }
+}
+
+// Separable polyphase resize (bilinear, bicubic, Lanczos, area): a
+// horizontal pass into an intermediate BGR image of dstW x srcH, then a
+// vertical pass fused with BGR->YUV420. Each direction has a table of
+// first source index per output sample and `taps` 2.14 fixed-point
+// weights summing to 1 << 14, computed once per geometry on the host
+// (resize_filter.cpp). The tables live in constant memory unless they are
+// too big for the device, in which case the host rebuilds this file with
+// -D RESIZE_COEFF_SPACE=__global.
+#ifndef RESIZE_COEFF_SPACE
+#define RESIZE_COEFF_SPACE __constant
+#endif
+#define RESIZE_WEIGHT_BITS 14
+
+inline uchar resize_round(int acc)
+{
+    return (uchar)clamp((acc + (1 << (RESIZE_WEIGHT_BITS - 1))) >> RESIZE_WEIGHT_BITS, 0, 255);
 }
 
-// bgr_to_yuv420
-__kernel void bgr_to_yuv420(__global const uchar* bgr, int width, int height,
-                            __global uchar* dstY,
-                            __global uchar* dstU,
-                            __global uchar* dstV)
+// resize_polyphase_h
+// One work-item per intermediate pixel: taps reads per channel from one row.
+__kernel void resize_polyphase_h(__global const uchar *src, int srcW, int srcH,
+                                 __global uchar *tmp, int dstW, int taps,
+                                 RESIZE_COEFF_SPACE const int *offsets,
+                                 RESIZE_COEFF_SPACE const short *weights)
 {
-    int x = get_global_id(0);
+    int dx = get_global_id(0);
     int y = get_global_id(1);
 
-    if(x >= width || y >= height) return;
+    if (dx >= dstW || y >= srcH) return;
+
+    __global const uchar *p = src + ((size_t)y * srcW + offsets[dx]) * 3;
+    RESIZE_COEFF_SPACE const short *w = weights + dx * taps;
+    int b = 0, g = 0, r = 0;
+    for(int t = 0; t < taps; ++t) {
+        int wt = w[t];
+        b += p[0] * wt;
+        g += p[1] * wt;
+        r += p[2] * wt;
+        p += 3;
+    }
+
+    __global uchar *out = tmp + ((size_t)y * dstW + dx) * 3;
+    out[0] = resize_round(b);
+    out[1] = resize_round(g);
+    out[2] = resize_round(r);
+}
+
+// Vertical taps for one output pixel of the intermediate image
+inline uchar3 sample_polyphase_v(__global const uchar *tmp, int dstW, int taps,
+                                 RESIZE_COEFF_SPACE const int *offsets,
+                                 RESIZE_COEFF_SPACE const short *weights, int px, int py)
+{
+    __global const uchar *p = tmp + ((size_t)offsets[py] * dstW + px) * 3;
+    RESIZE_COEFF_SPACE const short *w = weights + py * taps;
+    int b = 0, g = 0, r = 0;
+    for(int t = 0; t < taps; ++t) {
+        int wt = w[t];
+        b += p[0] * wt;
+        g += p[1] * wt;
+        r += p[2] * wt;
+        p += (size_t)dstW * 3;
+    }
+    return (uchar3)(resize_round(b), resize_round(g), resize_round(r));
+}
+
+// resize_polyphase_v_to_i420
+// Vertical pass + BGR->YUV420, one work-item per 2x2 output block, with the
+// same colour math and I420 layout as resize_bgr_to_i420.
+__kernel void resize_polyphase_v_to_i420(__global const uchar *tmp,
+                                         __global uchar *dst, int dstW, int dstH, int taps,
+                                         RESIZE_COEFF_SPACE const int *offsets,
+                                         RESIZE_COEFF_SPACE const short *weights)
+{
+    int bx = get_global_id(0);
+    int by = get_global_id(1);
+    int x0 = bx * 2;
+    int y0 = by * 2;
 
-    int idx = (y * width + x) * 3;
-    float B = (float)bgr[idx + 0];
-    float G = (float)bgr[idx + 1];
-    float R = (float)bgr[idx + 2];
+    if (x0 >= dstW || y0 >= dstH) return;
 
-    // Calculate and store Y channel
-    float Y =  0.114f * B + 0.587f * G + 0.299f * R;
-    dstY[y * width + x] = (uchar)clamp(Y, 0.0f, 255.0f);
+    int uv_width = dstW / 2;
+    int uv_height = dstH / 2;
+    __global uchar *dstY = dst;
+    __global uchar *dstU = dst + dstW * dstH;
+    __global uchar *dstV = dstU + uv_width * uv_height;
 
-    // Subsampled U and V (once per 2x2 block)
-    if ((x % 2 == 0) && (y % 2 == 0)) {
-        float sumU = 0.0f, sumV = 0.0f;
-        int samples = 0;
-        int uv_width = width / 2;
+    int sumB = 0, sumG = 0, sumR = 0;
+
+    for(int dy = 0; dy < 2; ++dy) {
+        for(int dx = 0; dx < 2; ++dx) {
+            int px = x0 + dx;
+            int py = y0 + dy;
+            if(px < dstW && py < dstH) {
+                uchar3 bgr = sample_polyphase_v(tmp, dstW, taps, offsets, weights, px, py);
+                dstY[py * dstW + px] = color_luma(bgr.x, bgr.y, bgr.z);
+                sumB += bgr.x;
+                sumG += bgr.y;
+                sumR += bgr.z;
+            }
+        }
+    }
+
+    if (bx < uv_width && by < uv_height) {
+        int uv_idx = by * uv_width + bx;
+        dstU[uv_idx] = color_u(sumB, sumG, sumR);
+        dstV[uv_idx] = color_v(sumB, sumG, sumR);
+    }
+}
+
+// Tiled variant of resize_bgr_to_i420 for devices with fast local memory.
+// A 16x8 work-group cooperatively copies the source rows its 128x16 output
+// pixels touch (plus a one-pixel halo) into local memory with 16-byte
+// vector loads, then each work-item produces four 2x2 blocks from the tile.
+// Taps and ratios are the same as resize_bgr_to_i420; the interpolation is
+// done in fixed point with 8-bit fractions (the horizontal lerp fits in a
+// ushort), which stays within one LSB of the float kernel. The host sizes
+// the tile with the same formula (OpenCLDriver::tiledSourceTile) and must
+// launch with a local size of TILED_GROUP_W x TILED_GROUP_H.
+#define TILED_GROUP_W 16
+#define TILED_GROUP_H 8
+#define TILED_BLOCKS_PER_ITEM 4
+#define TILED_FRAC_BITS 8
+
+// Bilinear sample from the local tile; x/y are absolute source coordinates
+inline uchar3 sample_bilinear_tile(__local const uchar *tile, int tileW, int tileX, int tileY,
+                                   int srcW, int srcH, float x_ratio, float y_ratio, int dx, int dy)
+{
+    float sx = x_ratio * dx;
+    float sy = y_ratio * dy;
+    int x = (int)sx;
+    int y = (int)sy;
+    ushort fx = (ushort)((sx - x) * (1 << TILED_FRAC_BITS) + 0.5f);
+    uint fy = (uint)((sy - y) * (1 << TILED_FRAC_BITS) + 0.5f);
+
+    int x1 = min(x + 1, srcW - 1) - tileX;
+    int y1 = min(y + 1, srcH - 1) - tileY;
+    x -= tileX;
+    y -= tileY;
+
+    ushort3 a = convert_ushort3(vload3(0, tile + (y  * tileW + x ) * 3));
+    ushort3 b = convert_ushort3(vload3(0, tile + (y  * tileW + x1) * 3));
+    ushort3 d = convert_ushort3(vload3(0, tile + (y1 * tileW + x ) * 3));
+    ushort3 e = convert_ushort3(vload3(0, tile + (y1 * tileW + x1) * 3));
+
+    ushort wx = (ushort)((1 << TILED_FRAC_BITS) - fx);
+    ushort3 top = a * wx + b * fx;
+    ushort3 bottom = d * wx + e * fx;
+    uint3 pixel = convert_uint3(top) * ((1 << TILED_FRAC_BITS) - fy) + convert_uint3(bottom) * fy;
+    // Truncate like the float kernel's (uchar) conversion
+    return convert_uchar3(pixel >> (2 * TILED_FRAC_BITS));
+}
+
+// resize_bgr_to_i420_tiled
+// Same arguments and output as resize_bgr_to_i420, plus the local tile of
+// tileW x tileH source pixels.
+__kernel __attribute__((reqd_work_group_size(TILED_GROUP_W, TILED_GROUP_H, 1)))
+void resize_bgr_to_i420_tiled(__global const uchar *src, int srcW, int srcH,
+                              __global uchar *dst, int dstW, int dstH,
+                              __local uchar *tile, int tileW, int tileH)
+{
+    int lx = get_local_id(0);
+    int ly = get_local_id(1);
+
+    float x_ratio = (float)(srcW - 1) / (dstW - 1);
+    float y_ratio = (float)(srcH - 1) / (dstH - 1);
+
+    // First output pixel of the group and the source pixel it starts at
+    int groupX = get_group_id(0) * (TILED_GROUP_W * TILED_BLOCKS_PER_ITEM * 2);
+    int groupY = get_group_id(1) * (TILED_GROUP_H * 2);
+    int tileX = (int)(x_ratio * groupX);
+    int tileY = (int)(y_ratio * groupY);
+
+    // Cooperative copy of the tile, one 16-byte chunk per work-item at a
+    // time; every work-item reaches the barrier, even past the frame edge
+    int rowBytes = min(tileW, srcW - tileX) * 3;
+    int rows = min(tileH, srcH - tileY);
+    int chunksPerRow = (rowBytes + 15) / 16;
+    for (int i = ly * TILED_GROUP_W + lx; i < rows * chunksPerRow; i += TILED_GROUP_W * TILED_GROUP_H) {
+        int r = i / chunksPerRow;
+        int c = (i - r * chunksPerRow) * 16;
+        __global const uchar *from = src + ((size_t)(tileY + r) * srcW + tileX) * 3 + c;
+        __local uchar *to = tile + r * tileW * 3 + c;
+        if (c + 16 <= rowBytes) {
+            vstore16(vload16(0, from), 0, to);
+        } else {
+            for (int k = 0; k < rowBytes - c; ++k)
+                to[k] = from[k];
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int uv_width = dstW / 2;
+    int uv_height = dstH / 2;
+    __global uchar *dstY = dst;
+    __global uchar *dstU = dst + dstW * dstH;
+    __global uchar *dstV = dstU + uv_width * uv_height;
+
+    // Neighbouring work-items take neighbouring blocks so writes coalesce
+    int by = groupY / 2 + ly;
+    for (int k = 0; k < TILED_BLOCKS_PER_ITEM; ++k) {
+        int bx = groupX / 2 + lx + k * TILED_GROUP_W;
+        int x0 = bx * 2;
+        int y0 = by * 2;
+        if (x0 >= dstW || y0 >= dstH) break;
+
+        int sumB = 0, sumG = 0, sumR = 0;
 
         for(int dy = 0; dy < 2; ++dy) {
             for(int dx = 0; dx < 2; ++dx) {
-                int sx = x + dx;
-                int sy = y + dy;
-                if(sx < width && sy < height) {
-                    int sidx = (sy * width + sx) * 3;
-                    float b = (float)bgr[sidx + 0];
-                    float g = (float)bgr[sidx + 1];
-                    float r = (float)bgr[sidx + 2];
-                    float y_val =  0.114f * b + 0.587f * g + 0.299f * r;
-                    float u = (b - y_val) * 0.565f + 128.0f;
-                    float v = (r - y_val) * 0.713f + 128.0f;
-                    sumU += u;
-                    sumV += v;
-                    samples++;
+                int px = x0 + dx;
+                int py = y0 + dy;
+                if(px < dstW && py < dstH) {
+                    uchar3 bgr = sample_bilinear_tile(tile, tileW, tileX, tileY, srcW, srcH,
+                                                      x_ratio, y_ratio, px, py);
+                    dstY[py * dstW + px] = color_luma(bgr.x, bgr.y, bgr.z);
+                    sumB += bgr.x;
+                    sumG += bgr.y;
+                    sumR += bgr.z;
                 }
             }
         }
 
-        int uv_idx = (y / 2) * uv_width + (x / 2);
-        dstU[uv_idx] = (uchar)clamp(sumU / samples, 0.0f, 255.0f);
-        dstV[uv_idx] = (uchar)clamp(sumV / samples, 0.0f, 255.0f);
+        if (bx < uv_width && by < uv_height) {
+            int uv_idx = by * uv_width + bx;
+            dstU[uv_idx] = color_u(sumB, sumG, sumR);
+            dstV[uv_idx] = color_v(sumB, sumG, sumR);
+        }
+    }
+}
+
+// Planar I420 sources: each plane is resized on its own and no colour
+// conversion is done. Planes are addressed by byte offsets so that one
+// buffer holds the whole frame; the host launches a kernel per plane.
+
+// resize_plane
+// Bilinear with the taps and ratios of resize_bgr_to_i420, one work-item
+// per output sample. Interpolates vertically, then horizontally, and
+// rounds, the same way as CpuBackend's planar path.
+__kernel void resize_plane(__global const uchar *src, int srcOffset, int srcW, int srcH,
+                           __global uchar *dst, int dstOffset, int dstW, int dstH)
+{
+    int dx = get_global_id(0);
+    int dy = get_global_id(1);
+
+    if (dx >= dstW || dy >= dstH) return;
+
+    // A one-sample wide chroma plane reads the first source column
+    float x_ratio = dstW > 1 ? (float)(srcW - 1) / (dstW - 1) : 0.0f;
+    float y_ratio = dstH > 1 ? (float)(srcH - 1) / (dstH - 1) : 0.0f;
+    float sx = x_ratio * dx;
+    float sy = y_ratio * dy;
+    int x = (int)sx;
+    int y = (int)sy;
+    float x_diff = sx - x;
+    float y_diff = sy - y;
+
+    int x1 = min(x + 1, srcW - 1);
+    int y1 = min(y + 1, srcH - 1);
+
+    __global const uchar *row0 = src + srcOffset + (size_t)y * srcW;
+    __global const uchar *row1 = src + srcOffset + (size_t)y1 * srcW;
+    float left = row0[x] * (1.0f - y_diff) + row1[x] * y_diff;
+    float right = row0[x1] * (1.0f - y_diff) + row1[x1] * y_diff;
+    float pixel = left * (1.0f - x_diff) + right * x_diff;
+    dst[dstOffset + (size_t)dy * dstW + dx] = (uchar)(clamp(pixel, 0.0f, 255.0f) + 0.5f);
+}
+
+// resize_plane_polyphase_h
+// Single-channel horizontal pass with tables for the plane's own size,
+// into a dstW x srcH intermediate plane.
+__kernel void resize_plane_polyphase_h(__global const uchar *src, int srcOffset, int srcW, int srcH,
+                                       __global uchar *tmp, int tmpOffset, int dstW, int taps,
+                                       RESIZE_COEFF_SPACE const int *offsets,
+                                       RESIZE_COEFF_SPACE const short *weights)
+{
+    int dx = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (dx >= dstW || y >= srcH) return;
+
+    __global const uchar *p = src + srcOffset + (size_t)y * srcW + offsets[dx];
+    RESIZE_COEFF_SPACE const short *w = weights + dx * taps;
+    int acc = 0;
+    for(int t = 0; t < taps; ++t)
+        acc += p[t] * w[t];
+    tmp[tmpOffset + (size_t)y * dstW + dx] = resize_round(acc);
+}
+
+// resize_plane_polyphase_v
+// Single-channel vertical pass from the intermediate plane to the output.
+__kernel void resize_plane_polyphase_v(__global const uchar *tmp, int tmpOffset,
+                                       __global uchar *dst, int dstOffset, int dstW, int dstH, int taps,
+                                       RESIZE_COEFF_SPACE const int *offsets,
+                                       RESIZE_COEFF_SPACE const short *weights)
+{
+    int dx = get_global_id(0);
+    int dy = get_global_id(1);
+
+    if (dx >= dstW || dy >= dstH) return;
+
+    __global const uchar *p = tmp + tmpOffset + (size_t)offsets[dy] * dstW + dx;
+    RESIZE_COEFF_SPACE const short *w = weights + dy * taps;
+    int acc = 0;
+    for(int t = 0; t < taps; ++t) {
+        acc += p[0] * w[t];
+        p += dstW;
     }
+    dst[dstOffset + (size_t)dy * dstW + dx] = resize_round(acc);
 }
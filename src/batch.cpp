@@ -0,0 +1,219 @@
+#include "batch.hpp"
+#include "video_reader.hpp"
+#include "preprocess_backend.hpp"
+#include "opencl_driver.hpp"
+#include "resize_filter.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+// Shell-style match with * and ?, no character classes
+bool wildcardMatch(const char *pattern, const char *text)
+{
+    const char *star = nullptr, *resume = nullptr;
+    while (*text)
+    {
+        if (*pattern == '?' || (*pattern != '*' && *pattern == *text))
+        {
+            ++pattern;
+            ++text;
+        }
+        else if (*pattern == '*')
+        {
+            star = pattern++;
+            resume = text;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            text = ++resume;
+        }
+        else
+            return false;
+    }
+    while (*pattern == '*')
+        ++pattern;
+    return *pattern == '\0';
+}
+
+std::vector<std::string> listDirectory(const fs::path &dir, const std::string &pattern)
+{
+    std::vector<std::string> inputs;
+    for (const fs::directory_entry &entry : fs::directory_iterator(dir))
+        if (entry.is_regular_file() &&
+            (pattern.empty() || wildcardMatch(pattern.c_str(), entry.path().filename().string().c_str())))
+            inputs.push_back(entry.path().string());
+    std::sort(inputs.begin(), inputs.end());
+    return inputs;
+}
+} // namespace
+
+std::vector<BatchItem> loadBatch(const std::string &spec, const std::string &outputDir)
+{
+    std::vector<BatchItem> items;
+    auto add = [&](const std::string &input, std::string output)
+    {
+        if (output.empty())
+            output = (fs::path(outputDir) / fs::path(input).stem()).string() + ".mp4";
+        items.push_back({input, output});
+    };
+
+    fs::path specPath(spec);
+    std::string name = specPath.filename().string();
+    if (name.find_first_of("*?") != std::string::npos)
+    {
+        fs::path dir = specPath.parent_path().empty() ? fs::path(".") : specPath.parent_path();
+        if (!fs::is_directory(dir))
+            throw std::invalid_argument("Batch directory not found: " + dir.string());
+        for (const std::string &input : listDirectory(dir, name))
+            add(input, "");
+    }
+    else if (fs::is_directory(specPath))
+    {
+        for (const std::string &input : listDirectory(specPath, ""))
+            add(input, "");
+    }
+    else
+    {
+        std::ifstream manifest(spec);
+        if (!manifest)
+            throw std::invalid_argument("Cannot read batch manifest " + spec);
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+            size_t tab = line.find('\t');
+            if (tab == std::string::npos)
+                add(line, "");
+            else
+                add(line.substr(0, tab), line.substr(tab + 1));
+        }
+    }
+    if (items.empty())
+        throw std::invalid_argument("Batch '" + spec + "' matched no files");
+
+    // Concurrent jobs must never write the same file or read one another's
+    // output
+    std::set<fs::path> inputs, outputs;
+    for (const BatchItem &item : items)
+        inputs.insert(fs::weakly_canonical(item.input));
+    for (const BatchItem &item : items)
+    {
+        fs::path output = fs::weakly_canonical(item.output);
+        if (!outputs.insert(output).second)
+            throw std::invalid_argument("Two batch items write " + item.output);
+        if (inputs.count(output))
+            throw std::invalid_argument("Batch output " + item.output + " would overwrite an input");
+    }
+    return items;
+}
+
+size_t defaultBatchJobs(const std::string &backendName, size_t files)
+{
+    // Decode plus x264 on a short clip keeps a few cores busy
+    const size_t CORES_PER_JOB = 4;
+    const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    size_t jobs = std::max<size_t>(1, hw / CORES_PER_JOB);
+
+    if (backendName != "cpu")
+    {
+        size_t gpus = 0;
+        try
+        {
+            gpus = OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_GPU).size();
+        }
+        catch (const std::exception &)
+        {
+        }
+        if (gpus > 0)
+            jobs = std::min(jobs, 2 * gpus);
+    }
+    return std::max<size_t>(1, std::min(jobs, files));
+}
+
+BatchFileStats transcodeItem(const BatchItem &item, PreprocessBackend &backend, const BatchOptions &options)
+{
+    BatchFileStats file;
+    file.item = item;
+    auto t0 = Clock::now();
+    try
+    {
+        VideoReader reader(item.input, options.reader);
+        PipelineOptions pipelineOptions = options.pipeline;
+        computeOutputSize(reader.getWidth(), reader.getHeight(), options.width, options.height, options.keepAspect,
+                          pipelineOptions.outWidth, pipelineOptions.outHeight);
+        fs::path outDir = fs::path(item.output).parent_path();
+        if (!outDir.empty())
+            fs::create_directories(outDir);
+        {
+            Encoder encoder(item.output, pipelineOptions.outWidth, pipelineOptions.outHeight, reader.getFPS(),
+                            options.encoder);
+            file.frames = runPipeline(reader, backend, encoder, pipelineOptions).framesProcessed;
+        } // the pipe encoder's ffmpeg exits here
+        file.inBytes = fs::file_size(item.input);
+        file.outBytes = fs::file_size(item.output);
+        file.ok = true;
+    }
+    catch (const std::exception &ex)
+    {
+        file.error = ex.what();
+    }
+    file.totalSec = secondsBetween(t0, Clock::now());
+    return file;
+}
+
+BatchStats runBatch(const std::vector<BatchItem> &items,
+                    const std::vector<PreprocessBackend *> &backends,
+                    const BatchOptions &options)
+{
+    if (backends.empty())
+        throw std::invalid_argument("runBatch needs at least one backend");
+
+    BatchStats stats;
+    stats.files.resize(items.size());
+    std::atomic<size_t> nextItem{0};
+    auto tStart = Clock::now();
+
+    // One job per backend; each pulls the next file until none are left
+    std::vector<std::thread> jobs;
+    for (PreprocessBackend *backend : backends)
+    {
+        jobs.emplace_back([&, backend]
+                          {
+            for (size_t i = nextItem++; i < items.size(); i = nextItem++) {
+                stats.files[i] = transcodeItem(items[i], *backend, options);
+                if (options.onFileDone)
+                    options.onFileDone(stats.files[i]);
+            } });
+    }
+    for (std::thread &job : jobs)
+        job.join();
+    stats.totalSec = secondsBetween(tStart, Clock::now());
+
+    for (const BatchFileStats &file : stats.files)
+    {
+        if (!file.ok)
+        {
+            ++stats.failed;
+            continue;
+        }
+        stats.frames += file.frames;
+        stats.inBytes += file.inBytes;
+        stats.outBytes += file.outBytes;
+    }
+    return stats;
+}
@@ -0,0 +1,70 @@
+#include "color_space.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+ColorCoefficients coefficients(int32_t yR, int32_t yG, int32_t yB, int32_t yOffset,
+                               int32_t uR, int32_t uG, int32_t uB,
+                               int32_t vR, int32_t vG, int32_t vB)
+{
+    // Rounding terms folded into the biases: luma shifts by 14 bits, chroma
+    // by 16 (14 plus the four-pixel sum)
+    const int32_t yBias = (yOffset << COLOR_COEFF_BITS) + (1 << (COLOR_COEFF_BITS - 1));
+    const int32_t uvBias = (128 << (COLOR_COEFF_BITS + 2)) + (1 << (COLOR_COEFF_BITS + 1));
+    return {yR, yG, yB, yBias, uR, uG, uB, vR, vG, vB, uvBias};
+}
+
+// Rounded from Kr/Kb of each matrix, scaled by 219/255 (luma) and 224/255
+// (chroma) for limited range; G takes the rounding residual
+const ColorCoefficients BT601_LIMITED = coefficients(4207, 8260, 1604, 16, -2428, -4768, 7196, 7196, -6026, -1170);
+const ColorCoefficients BT601_FULL = coefficients(4899, 9617, 1868, 0, -2765, -5427, 8192, 8192, -6860, -1332);
+const ColorCoefficients BT709_LIMITED = coefficients(2991, 10064, 1016, 16, -1649, -5547, 7196, 7196, -6536, -660);
+const ColorCoefficients BT709_FULL = coefficients(3483, 11718, 1183, 0, -1877, -6315, 8192, 8192, -7441, -751);
+} // namespace
+
+const char *colorMatrixName(ColorMatrix matrix)
+{
+    return matrix == ColorMatrix::BT709 ? "bt709" : "bt601";
+}
+
+const char *colorRangeName(ColorRange range)
+{
+    return range == ColorRange::Full ? "full" : "limited";
+}
+
+ColorMatrix parseColorMatrix(const std::string &name)
+{
+    if (name == "bt601")
+        return ColorMatrix::BT601;
+    if (name == "bt709")
+        return ColorMatrix::BT709;
+    throw std::invalid_argument("Unknown color matrix '" + name + "' (expected bt601 or bt709)");
+}
+
+ColorRange parseColorRange(const std::string &name)
+{
+    if (name == "limited" || name == "tv")
+        return ColorRange::Limited;
+    if (name == "full" || name == "pc")
+        return ColorRange::Full;
+    throw std::invalid_argument("Unknown color range '" + name + "' (expected limited or full)");
+}
+
+const ColorCoefficients &colorCoefficients(ColorSpace space)
+{
+    bool full = space.range == ColorRange::Full;
+    if (space.matrix == ColorMatrix::BT709)
+        return full ? BT709_FULL : BT709_LIMITED;
+    return full ? BT601_FULL : BT601_LIMITED;
+}
+
+std::string colorBuildOptions(ColorSpace space)
+{
+    std::string options;
+    if (space.matrix == ColorMatrix::BT709)
+        options += "-D COLOR_MATRIX_BT709";
+    if (space.range == ColorRange::Full)
+        options += std::string(options.empty() ? "" : " ") + "-D COLOR_RANGE_FULL";
+    return options;
+}
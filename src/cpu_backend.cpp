@@ -0,0 +1,546 @@
+#include "cpu_backend.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(CPU_BACKEND_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+const CpuKernelTable &kernelsFor(CpuIsa isa)
+{
+    switch (isa)
+    {
+#ifdef CPU_BACKEND_X86
+    case CpuIsa::AVX512:
+        return cpuKernelsAVX512();
+    case CpuIsa::AVX2:
+        return cpuKernelsAVX2();
+    case CpuIsa::SSE41:
+        return cpuKernelsSSE41();
+#endif
+    default:
+        return cpuKernelsScalar();
+    }
+}
+
+// Polyphase sum back to a pixel, rounded like resize_round() in the kernel
+inline uint8_t roundWeighted(int32_t acc)
+{
+    int32_t v = (acc + (1 << (RESIZE_WEIGHT_BITS - 1))) >> RESIZE_WEIGHT_BITS;
+    return (uint8_t)std::min(std::max(v, 0), 255);
+}
+
+// Higher means wider; used to reject ISAs the CPU does not have
+int isaRank(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CpuIsa::AVX512:
+        return 3;
+    case CpuIsa::AVX2:
+        return 2;
+    case CpuIsa::SSE41:
+        return 1;
+    default:
+        return 0;
+    }
+}
+} // namespace
+
+CpuIsa CpuBackend::detectIsa()
+{
+#if defined(CPU_BACKEND_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return CpuIsa::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return CpuIsa::AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return CpuIsa::SSE41;
+#elif defined(CPU_BACKEND_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        // The OS must also save the wider register state on context switch
+        avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    }
+    if (avx512)
+        return CpuIsa::AVX512;
+    if (avx2)
+        return CpuIsa::AVX2;
+    if (sse41)
+        return CpuIsa::SSE41;
+#endif
+    return CpuIsa::Scalar;
+}
+
+const char *CpuBackend::isaName(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CpuIsa::AVX512:
+        return "avx512";
+    case CpuIsa::AVX2:
+        return "avx2";
+    case CpuIsa::SSE41:
+        return "sse4.1";
+    case CpuIsa::Scalar:
+        return "scalar";
+    default:
+        return "auto";
+    }
+}
+
+CpuBackend::CpuBackend(size_t threads, CpuIsa isa, size_t slots)
+    : slots_(slots > 0 ? slots : 1)
+{
+    CpuIsa available = detectIsa();
+    if (isa == CpuIsa::Auto)
+        isa = available;
+    else if (isaRank(isa) > isaRank(available))
+        throw std::runtime_error(std::string("CPU does not support ") + isaName(isa));
+    kernels_ = &kernelsFor(isa);
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    scratch_.resize(threads);
+    for (size_t i = 1; i < threads; ++i)
+        workers_.emplace_back(&CpuBackend::workerLoop, this, i);
+}
+
+CpuBackend::~CpuBackend()
+{
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        stopping_ = true;
+    }
+    poolWake_.notify_all();
+    for (std::thread &worker : workers_)
+        worker.join();
+}
+
+std::string CpuBackend::name() const
+{
+    return std::string("cpu-") + isaName(kernels_->isa);
+}
+
+void CpuBackend::fillTables(ResizeTables &t, int srcW, int srcH, int dstW, int dstH, ResizeFilter filter)
+{
+    t.srcW = srcW;
+    t.srcH = srcH;
+    t.dstW = dstW;
+    t.dstH = dstH;
+    t.filter = filter;
+    if (filter != ResizeFilter::Fast)
+    {
+        t.h = computeResizeCoefficients(srcW, dstW, filter);
+        t.v = computeResizeCoefficients(srcH, dstH, filter);
+        return;
+    }
+
+    // Same ratios and tap selection as resize_bgr_to_i420; a one-sample
+    // chroma plane reads the first source column or row, as resize_plane does
+    float xRatio = dstW > 1 ? (float)(srcW - 1) / (dstW - 1) : 0.0f;
+    float yRatio = dstH > 1 ? (float)(srcH - 1) / (dstH - 1) : 0.0f;
+
+    t.x0.resize(dstW);
+    t.x1.resize(dstW);
+    t.fx.resize(dstW);
+    for (int dx = 0; dx < dstW; ++dx)
+    {
+        float sx = xRatio * dx;
+        int x = (int)sx;
+        t.x0[dx] = x;
+        t.x1[dx] = std::min(x + 1, srcW - 1);
+        t.fx[dx] = sx - x;
+    }
+
+    t.y0.resize(dstH);
+    t.y1.resize(dstH);
+    t.fy.resize(dstH);
+    for (int dy = 0; dy < dstH; ++dy)
+    {
+        float sy = yRatio * dy;
+        int y = (int)sy;
+        t.y0[dy] = y;
+        t.y1[dy] = std::min(y + 1, srcH - 1);
+        t.fy[dy] = sy - y;
+    }
+}
+
+void CpuBackend::ensureTables(int srcW, int srcH, int dstW, int dstH, ResizeFilter filter, bool planar)
+{
+    ResizeTables &t = tables_;
+    if (t.srcW == srcW && t.srcH == srcH && t.dstW == dstW && t.dstH == dstH && t.filter == filter &&
+        t.planar == planar)
+        return;
+
+    fillTables(t, srcW, srcH, dstW, dstH, filter);
+    t.planar = planar;
+    if (planar)
+        fillTables(chromaTables_, srcW / 2, srcH / 2, dstW / 2, dstH / 2, filter);
+
+    // Buffers sized for BGR also cover the planar passes
+    if (filter != ResizeFilter::Fast)
+        horizontal_.resize((size_t)dstW * srcH * 3);
+    for (Scratch &s : scratch_)
+    {
+        if (filter != ResizeFilter::Fast)
+            s.accum.resize((size_t)dstW * 3);
+        else
+            s.vertical.resize((size_t)srcW * 3);
+        for (auto &row : s.planes)
+            for (auto &plane : row)
+                plane.resize(dstW);
+    }
+}
+
+void CpuBackend::horizontalRows(const cv::Mat &src, int rowBegin, int rowEnd)
+{
+    const ResizeTables &t = tables_;
+    const int taps = t.h.taps;
+    for (int y = rowBegin; y < rowEnd; ++y)
+    {
+        const uint8_t *row = src.ptr<uint8_t>(y);
+        uint8_t *out = horizontal_.data() + (size_t)y * t.dstW * 3;
+        for (int dx = 0; dx < t.dstW; ++dx)
+        {
+            const uint8_t *p = row + (size_t)t.h.offsets[dx] * 3;
+            const int16_t *w = &t.h.weights[(size_t)dx * taps];
+            int32_t b = 0, g = 0, r = 0;
+            for (int k = 0; k < taps; ++k, p += 3)
+            {
+                b += p[0] * w[k];
+                g += p[1] * w[k];
+                r += p[2] * w[k];
+            }
+            out[dx * 3 + 0] = roundWeighted(b);
+            out[dx * 3 + 1] = roundWeighted(g);
+            out[dx * 3 + 2] = roundWeighted(r);
+        }
+    }
+}
+
+void CpuBackend::verticalRow(int dy, Scratch &scratch, int row)
+{
+    const ResizeTables &t = tables_;
+    const size_t n = (size_t)t.dstW * 3;
+    int32_t *acc = scratch.accum.data();
+    std::fill(acc, acc + n, 0);
+    // Row by row rather than pixel by pixel, so every read is sequential
+    const int16_t *w = &t.v.weights[(size_t)dy * t.v.taps];
+    for (int k = 0; k < t.v.taps; ++k)
+    {
+        const uint8_t *src = horizontal_.data() + (size_t)(t.v.offsets[dy] + k) * n;
+        const int32_t wk = w[k];
+        for (size_t i = 0; i < n; ++i)
+            acc[i] += src[i] * wk;
+    }
+
+    float *out[3] = {scratch.planes[row][0].data(), scratch.planes[row][1].data(), scratch.planes[row][2].data()};
+    for (int dx = 0; dx < t.dstW; ++dx)
+        for (int c = 0; c < 3; ++c)
+            out[c][dx] = roundWeighted(acc[dx * 3 + c]);
+}
+
+void CpuBackend::resampleRow(const cv::Mat &src, int dy, Scratch &scratch, int row)
+{
+    const ResizeTables &t = tables_;
+    if (t.filter != ResizeFilter::Fast)
+    {
+        verticalRow(dy, scratch, row);
+        return;
+    }
+    float *vertical = scratch.vertical.data();
+    kernels_->blendRows(src.ptr<uint8_t>(t.y0[dy]), src.ptr<uint8_t>(t.y1[dy]), t.fy[dy], vertical, t.srcW * 3);
+
+    float *out[3] = {scratch.planes[row][0].data(), scratch.planes[row][1].data(), scratch.planes[row][2].data()};
+    int done = kernels_->lerpColumns(vertical, t.x0.data(), t.x1.data(), t.fx.data(), t.dstW, out[0], out[1], out[2]);
+    if (done < t.dstW)
+        cpuKernelsScalar().lerpColumns(vertical, t.x0.data() + done, t.x1.data() + done, t.fx.data() + done,
+                                       t.dstW - done, out[0] + done, out[1] + done, out[2] + done);
+}
+
+void CpuBackend::processRows(const cv::Mat &src, uint8_t *dst, int blockRowBegin, int blockRowEnd, Scratch &scratch)
+{
+    const int dstW = tables_.dstW;
+    const int dstH = tables_.dstH;
+    const int blocks = dstW / 2;
+    const int uvW = dstW / 2;
+    const int uvH = dstH / 2;
+    uint8_t *dstY = dst;
+    uint8_t *dstU = dst + (size_t)dstW * dstH;
+    uint8_t *dstV = dstU + (size_t)uvW * uvH;
+    const ColorCoefficients &k = colorCoefficients(colorSpace_);
+
+    for (int by = blockRowBegin; by < blockRowEnd; ++by)
+    {
+        int py = by * 2;
+        int rows = std::min(2, dstH - py);
+        for (int r = 0; r < rows; ++r)
+            resampleRow(src, py + r, scratch, r);
+
+        uint8_t *y0 = dstY + (size_t)py * dstW;
+        if (rows < 2)
+        {
+            // Trailing odd row: luma only, as in the kernel
+            cpuLumaRow(scratch.planes[0][0].data(), scratch.planes[0][1].data(), scratch.planes[0][2].data(), dstW, k, y0);
+            continue;
+        }
+
+        uint8_t *y1 = y0 + dstW;
+        uint8_t *u = dstU + (size_t)by * uvW;
+        uint8_t *v = dstV + (size_t)by * uvW;
+        PlanarRowPair pair = {{scratch.planes[0][0].data(), scratch.planes[1][0].data()},
+                              {scratch.planes[0][1].data(), scratch.planes[1][1].data()},
+                              {scratch.planes[0][2].data(), scratch.planes[1][2].data()}};
+        int done = kernels_->convertBlocks(pair, blocks, k, y0, y1, u, v);
+        if (done < blocks)
+        {
+            int px = done * 2;
+            PlanarRowPair tail = {{pair.b[0] + px, pair.b[1] + px},
+                                  {pair.g[0] + px, pair.g[1] + px},
+                                  {pair.r[0] + px, pair.r[1] + px}};
+            cpuKernelsScalar().convertBlocks(tail, blocks - done, k, y0 + px, y1 + px, u + done, v + done);
+        }
+        if (dstW & 1)
+        {
+            // Trailing odd column: luma only
+            int px = dstW - 1;
+            for (int r = 0; r < 2; ++r)
+                cpuLumaRow(pair.b[r] + px, pair.g[r] + px, pair.r[r] + px, 1, k, (r ? y1 : y0) + px);
+        }
+    }
+}
+
+int CpuBackend::planeOfRow(int &row, int lumaRows) const
+{
+    // Rows of the Y, U and V planes stacked in that order
+    if (row < lumaRows)
+        return 0;
+    row -= lumaRows;
+    int chromaRows = lumaRows / 2;
+    if (row < chromaRows)
+        return 1;
+    row -= chromaRows;
+    return 2;
+}
+
+void CpuBackend::planeHorizontalRows(const cv::Mat &src, int rowBegin, int rowEnd)
+{
+    for (int row = rowBegin; row < rowEnd; ++row)
+    {
+        int y = row;
+        int p = planeOfRow(y, tables_.srcH);
+        const ResizeTables &t = p == 0 ? tables_ : chromaTables_;
+        const uint8_t *in = src.data + i420Plane(tables_.srcW, tables_.srcH, p).offset + (size_t)y * t.srcW;
+        uint8_t *out = horizontal_.data() + i420Plane(tables_.dstW, tables_.srcH, p).offset + (size_t)y * t.dstW;
+        const int taps = t.h.taps;
+        for (int dx = 0; dx < t.dstW; ++dx)
+        {
+            const uint8_t *q = in + t.h.offsets[dx];
+            const int16_t *w = &t.h.weights[(size_t)dx * taps];
+            int32_t acc = 0;
+            for (int k = 0; k < taps; ++k)
+                acc += q[k] * w[k];
+            out[dx] = roundWeighted(acc);
+        }
+    }
+}
+
+void CpuBackend::planeRows(const cv::Mat &src, uint8_t *dst, int rowBegin, int rowEnd, Scratch &scratch)
+{
+    for (int row = rowBegin; row < rowEnd; ++row)
+    {
+        int dy = row;
+        int p = planeOfRow(dy, tables_.dstH);
+        const ResizeTables &t = p == 0 ? tables_ : chromaTables_;
+        uint8_t *out = dst + i420Plane(tables_.dstW, tables_.dstH, p).offset + (size_t)dy * t.dstW;
+
+        if (t.filter != ResizeFilter::Fast)
+        {
+            // Vertical polyphase pass over the plane's intermediate rows
+            const uint8_t *tmp = horizontal_.data() + i420Plane(tables_.dstW, tables_.srcH, p).offset;
+            int32_t *acc = scratch.accum.data();
+            std::fill(acc, acc + t.dstW, 0);
+            const int16_t *w = &t.v.weights[(size_t)dy * t.v.taps];
+            for (int k = 0; k < t.v.taps; ++k)
+            {
+                const uint8_t *in = tmp + (size_t)(t.v.offsets[dy] + k) * t.dstW;
+                const int32_t wk = w[k];
+                for (int dx = 0; dx < t.dstW; ++dx)
+                    acc[dx] += in[dx] * wk;
+            }
+            for (int dx = 0; dx < t.dstW; ++dx)
+                out[dx] = roundWeighted(acc[dx]);
+            continue;
+        }
+
+        // Bilinear like resize_plane: vertical blend, horizontal lerp, round
+        const uint8_t *plane = src.data + i420Plane(tables_.srcW, tables_.srcH, p).offset;
+        float *vertical = scratch.vertical.data();
+        kernels_->blendRows(plane + (size_t)t.y0[dy] * t.srcW, plane + (size_t)t.y1[dy] * t.srcW, t.fy[dy], vertical,
+                            t.srcW);
+        for (int dx = 0; dx < t.dstW; ++dx)
+        {
+            float fx = t.fx[dx];
+            float pixel = vertical[t.x0[dx]] * (1 - fx) + vertical[t.x1[dx]] * fx;
+            out[dx] = (uint8_t)(std::min(std::max(pixel, 0.0f), 255.0f) + 0.5f);
+        }
+    }
+}
+
+void CpuBackend::processBand(int band, Scratch &scratch)
+{
+    // Planar frames are split by rows of the stacked Y, U and V planes
+    const bool planar = tables_.planar;
+    if (bandPass_ == BandPass::Horizontal)
+    {
+        int rows = planar ? tables_.srcH + 2 * chromaTables_.srcH : tables_.srcH;
+        int begin = (int)((int64_t)rows * band / bandCount_);
+        int end = (int)((int64_t)rows * (band + 1) / bandCount_);
+        if (planar)
+            planeHorizontalRows(*bandInput_, begin, end);
+        else
+            horizontalRows(*bandInput_, begin, end);
+        return;
+    }
+    int rows = planar ? tables_.dstH + 2 * chromaTables_.dstH : (tables_.dstH + 1) / 2;
+    int begin = (int)((int64_t)rows * band / bandCount_);
+    int end = (int)((int64_t)rows * (band + 1) / bandCount_);
+    if (planar)
+        planeRows(*bandInput_, bandOutput_, begin, end, scratch);
+    else
+        processRows(*bandInput_, bandOutput_, begin, end, scratch);
+}
+
+void CpuBackend::drainBands(Scratch &scratch)
+{
+    for (int band = nextBand_.fetch_add(1); band < bandCount_; band = nextBand_.fetch_add(1))
+        processBand(band, scratch);
+}
+
+void CpuBackend::runBands(const cv::Mat &input, uint8_t *output, int bands, BandPass pass)
+{
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        bandInput_ = &input;
+        bandOutput_ = output;
+        bandCount_ = bands;
+        bandPass_ = pass;
+        nextBand_ = 0;
+        busyWorkers_ = (int)workers_.size();
+        ++generation_;
+    }
+    poolWake_.notify_all();
+
+    drainBands(scratch_[0]);
+
+    std::unique_lock<std::mutex> lock(poolMutex_);
+    poolDone_.wait(lock, [this]
+                   { return busyWorkers_ == 0; });
+}
+
+void CpuBackend::workerLoop(size_t index)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(poolMutex_);
+            poolWake_.wait(lock, [&]
+                           { return stopping_ || generation_ != seen; });
+            if (stopping_)
+                return;
+            seen = generation_;
+        }
+
+        drainBands(scratch_[index]);
+
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (--busyWorkers_ == 0)
+            poolDone_.notify_one();
+    }
+}
+
+PreprocessBackend::FrameTicket CpuBackend::submitFrame(const cv::Mat &input,
+                                                       int targetWidth,
+                                                       int targetHeight)
+{
+    const bool planar = isI420Frame(input);
+    if (!planar && input.type() != CV_8UC3)
+        throw std::runtime_error("CpuBackend: expected a BGR24 or I420 frame");
+    if (planar && (!input.isContinuous() || input.cols % 2 != 0 || input.rows % 3 != 0 || sourceHeight(input) % 2 != 0))
+        throw std::runtime_error("CpuBackend: I420 frames must be contiguous with an even size");
+
+    FrameTicket ticket = nextTicket_;
+    FrameSlot &slot = slots_[ticket % slots_.size()];
+    {
+        std::unique_lock<std::mutex> lock(slotMutex_);
+        if (slot.state == SlotState::Done)
+            throw std::runtime_error("CpuBackend: all frame slots are in flight");
+        slotReleased_.wait(lock, [&]
+                           { return slot.state == SlotState::Free; });
+    }
+
+    const int srcH = sourceHeight(input);
+    ResizeFilter filter = resolveResizeFilter(resizeFilter_, input.cols, srcH, targetWidth, targetHeight);
+    ensureTables(input.cols, srcH, targetWidth, targetHeight, filter, planar);
+
+    size_t ySize = (size_t)targetWidth * targetHeight;
+    size_t uvSize = (size_t)(targetWidth / 2) * (targetHeight / 2);
+    slot.yuv.resize(ySize + 2 * uvSize);
+
+    // A few bands per thread keeps the load balanced. Source rows of a
+    // planar frame are the stacked planes, input.rows of them.
+    int outputRows = planar ? targetHeight + 2 * (targetHeight / 2) : (targetHeight + 1) / 2;
+    int bands = std::min(outputRows, (int)scratch_.size() * 4);
+    if (filter != ResizeFilter::Fast)
+        runBands(input, slot.yuv.data(), std::min(input.rows, (int)scratch_.size() * 4), BandPass::Horizontal);
+    runBands(input, slot.yuv.data(), bands, BandPass::Output);
+
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        slot.state = SlotState::Done;
+    }
+    ++nextTicket_;
+    return ticket;
+}
+
+YuvFrame CpuBackend::waitMappedFrame(FrameTicket ticket)
+{
+    if (ticket >= nextTicket_)
+        throw std::runtime_error("CpuBackend: ticket " + std::to_string(ticket) + " was never submitted");
+    if (ticket != nextWait_)
+        throw std::runtime_error("CpuBackend: frames must be waited on in submission order");
+
+    size_t slotIndex = ticket % slots_.size();
+    FrameSlot &slot = slots_[slotIndex];
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        slot.state = SlotState::Mapped;
+    }
+    ++nextWait_;
+    return YuvFrame(this, slotIndex, slot.yuv.data(), slot.yuv.size());
+}
+
+void CpuBackend::releaseFrame(size_t slotIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        slots_[slotIndex].state = SlotState::Free;
+    }
+    slotReleased_.notify_all();
+}
@@ -0,0 +1,127 @@
+#include "cpu_kernels.hpp"
+
+#include <immintrin.h>
+
+// AVX2 row kernels: 8 floats per vector. Built with -mavx2.
+
+namespace
+{
+inline __m256 loadBytes8(const uint8_t *p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+}
+
+// Saturate to 0..255 and store 8 bytes
+inline void storeBytes8(uint8_t *p, __m256i i32)
+{
+    __m128i u16 = _mm_packus_epi32(_mm256_castsi256_si128(i32), _mm256_extracti128_si256(i32, 1));
+    __m128i u8 = _mm_packus_epi16(u16, u16);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(p), u8);
+}
+
+// Sums of adjacent pairs of a (8 values) followed by those of b, in order
+inline __m256i pairSums(__m256i a, __m256i b)
+{
+    // hadd works per 128-bit lane; swap the middle 64-bit chunks back
+    return _mm256_permute4x64_epi64(_mm256_hadd_epi32(a, b), 0xD8);
+}
+
+// Whole-number floats to int32, exactly
+inline __m256i loadInts8(const float *p)
+{
+    return _mm256_cvttps_epi32(_mm256_loadu_ps(p));
+}
+
+inline __m256i dot3(__m256i b, __m256i g, __m256i r, int32_t kb, int32_t kg, int32_t kr)
+{
+    return _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b, _mm256_set1_epi32(kb)),
+                                             _mm256_mullo_epi32(g, _mm256_set1_epi32(kg))),
+                            _mm256_mullo_epi32(r, _mm256_set1_epi32(kr)));
+}
+
+void blendRowsAVX2(const uint8_t *a, const uint8_t *b, float fy, float *dst, int n)
+{
+    const __m256 wa = _mm256_set1_ps(1.0f - fy);
+    const __m256 wb = _mm256_set1_ps(fy);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 va = loadBytes8(a + i);
+        __m256 vb = loadBytes8(b + i);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(va, wa), _mm256_mul_ps(vb, wb)));
+    }
+    for (; i < n; ++i)
+        dst[i] = a[i] * (1.0f - fy) + b[i] * fy;
+}
+
+int lerpColumnsAVX2(const float *row, const int *x0, const int *x1, const float *fx, int n,
+                    float *b, float *g, float *r)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 lo = _mm256_setzero_ps();
+    const __m256 hi = _mm256_set1_ps(255.0f);
+    const __m256i three = _mm256_set1_epi32(3);
+    float *out[3] = {b, g, r};
+    int dx = 0;
+    for (; dx + 8 <= n; dx += 8)
+    {
+        // Element offsets of the taps' blue samples in the interleaved row
+        __m256i i0 = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(x0 + dx)), three);
+        __m256i i1 = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(x1 + dx)), three);
+        const __m256 w1 = _mm256_loadu_ps(fx + dx);
+        const __m256 w0 = _mm256_sub_ps(one, w1);
+        for (int c = 0; c < 3; ++c)
+        {
+            __m256 a = _mm256_i32gather_ps(row + c, i0, 4);
+            __m256 z = _mm256_i32gather_ps(row + c, i1, 4);
+            __m256 pixel = _mm256_add_ps(_mm256_mul_ps(a, w0), _mm256_mul_ps(z, w1));
+            pixel = _mm256_min_ps(_mm256_max_ps(pixel, lo), hi);
+            _mm256_storeu_ps(out[c] + dx, _mm256_round_ps(pixel, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+        }
+    }
+    return dx;
+}
+
+int convertBlocksAVX2(const PlanarRowPair &rows, int blocks, const ColorCoefficients &k,
+                      uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+    const __m256i yBias = _mm256_set1_epi32(k.yBias);
+    const __m256i uvBias = _mm256_set1_epi32(k.uvBias);
+    uint8_t *dstY[2] = {y0, y1};
+
+    // 8 blocks (16 pixels per row) per iteration
+    int bx = 0;
+    for (; bx + 8 <= blocks; bx += 8)
+    {
+        __m256i pairU[2], pairV[2]; // per-pixel chroma terms summed over both rows
+        for (int half = 0; half < 2; ++half)
+        {
+            int px = bx * 2 + half * 8;
+            __m256i su = _mm256_setzero_si256(), sv = _mm256_setzero_si256();
+            for (int row = 0; row < 2; ++row)
+            {
+                __m256i b = loadInts8(rows.b[row] + px);
+                __m256i g = loadInts8(rows.g[row] + px);
+                __m256i r = loadInts8(rows.r[row] + px);
+                __m256i y = _mm256_srai_epi32(_mm256_add_epi32(dot3(b, g, r, k.yB, k.yG, k.yR), yBias), COLOR_COEFF_BITS);
+                storeBytes8(dstY[row] + px, y);
+                su = _mm256_add_epi32(su, dot3(b, g, r, k.uB, k.uG, k.uR));
+                sv = _mm256_add_epi32(sv, dot3(b, g, r, k.vB, k.vG, k.vR));
+            }
+            pairU[half] = su;
+            pairV[half] = sv;
+        }
+        __m256i blockU = _mm256_add_epi32(pairSums(pairU[0], pairU[1]), uvBias);
+        __m256i blockV = _mm256_add_epi32(pairSums(pairV[0], pairV[1]), uvBias);
+        storeBytes8(u + bx, _mm256_srai_epi32(blockU, COLOR_COEFF_BITS + 2));
+        storeBytes8(v + bx, _mm256_srai_epi32(blockV, COLOR_COEFF_BITS + 2));
+    }
+    return bx;
+}
+} // namespace
+
+const CpuKernelTable &cpuKernelsAVX2()
+{
+    static const CpuKernelTable table = {CpuIsa::AVX2, blendRowsAVX2, lerpColumnsAVX2, convertBlocksAVX2};
+    return table;
+}
@@ -0,0 +1,127 @@
+#include "cpu_kernels.hpp"
+
+#include <immintrin.h>
+
+// AVX-512 row kernels: 16 floats per vector. Built with -mavx512f.
+
+namespace
+{
+inline __m512 loadBytes16(const uint8_t *p)
+{
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))));
+}
+
+// Saturate to 0..255 and store 16 bytes
+inline void storeBytes16(uint8_t *p, __m512i i32)
+{
+    i32 = _mm512_min_epi32(_mm512_max_epi32(i32, _mm512_setzero_si512()), _mm512_set1_epi32(255));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm512_cvtepi32_epi8(i32));
+}
+
+// Sums of adjacent pairs of a (16 values) followed by those of b, in order
+inline __m512i pairSums(__m512i a, __m512i b)
+{
+    const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    return _mm512_add_epi32(_mm512_permutex2var_epi32(a, even, b), _mm512_permutex2var_epi32(a, odd, b));
+}
+
+// Whole-number floats to int32, exactly
+inline __m512i loadInts16(const float *p)
+{
+    return _mm512_cvttps_epi32(_mm512_loadu_ps(p));
+}
+
+inline __m512i dot3(__m512i b, __m512i g, __m512i r, int32_t kb, int32_t kg, int32_t kr)
+{
+    return _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(b, _mm512_set1_epi32(kb)),
+                                             _mm512_mullo_epi32(g, _mm512_set1_epi32(kg))),
+                            _mm512_mullo_epi32(r, _mm512_set1_epi32(kr)));
+}
+
+void blendRowsAVX512(const uint8_t *a, const uint8_t *b, float fy, float *dst, int n)
+{
+    const __m512 wa = _mm512_set1_ps(1.0f - fy);
+    const __m512 wb = _mm512_set1_ps(fy);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 va = loadBytes16(a + i);
+        __m512 vb = loadBytes16(b + i);
+        _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_mul_ps(va, wa), _mm512_mul_ps(vb, wb)));
+    }
+    for (; i < n; ++i)
+        dst[i] = a[i] * (1.0f - fy) + b[i] * fy;
+}
+
+int lerpColumnsAVX512(const float *row, const int *x0, const int *x1, const float *fx, int n,
+                      float *b, float *g, float *r)
+{
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 lo = _mm512_setzero_ps();
+    const __m512 hi = _mm512_set1_ps(255.0f);
+    const __m512i three = _mm512_set1_epi32(3);
+    float *out[3] = {b, g, r};
+    int dx = 0;
+    for (; dx + 16 <= n; dx += 16)
+    {
+        // Element offsets of the taps' blue samples in the interleaved row
+        __m512i i0 = _mm512_mullo_epi32(_mm512_loadu_si512(x0 + dx), three);
+        __m512i i1 = _mm512_mullo_epi32(_mm512_loadu_si512(x1 + dx), three);
+        const __m512 w1 = _mm512_loadu_ps(fx + dx);
+        const __m512 w0 = _mm512_sub_ps(one, w1);
+        for (int c = 0; c < 3; ++c)
+        {
+            __m512 a = _mm512_i32gather_ps(i0, row + c, 4);
+            __m512 z = _mm512_i32gather_ps(i1, row + c, 4);
+            __m512 pixel = _mm512_add_ps(_mm512_mul_ps(a, w0), _mm512_mul_ps(z, w1));
+            pixel = _mm512_min_ps(_mm512_max_ps(pixel, lo), hi);
+            _mm512_storeu_ps(out[c] + dx, _mm512_roundscale_ps(pixel, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+        }
+    }
+    return dx;
+}
+
+int convertBlocksAVX512(const PlanarRowPair &rows, int blocks, const ColorCoefficients &k,
+                        uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+    const __m512i yBias = _mm512_set1_epi32(k.yBias);
+    const __m512i uvBias = _mm512_set1_epi32(k.uvBias);
+    uint8_t *dstY[2] = {y0, y1};
+
+    // 16 blocks (32 pixels per row) per iteration
+    int bx = 0;
+    for (; bx + 16 <= blocks; bx += 16)
+    {
+        __m512i pairU[2], pairV[2]; // per-pixel chroma terms summed over both rows
+        for (int half = 0; half < 2; ++half)
+        {
+            int px = bx * 2 + half * 16;
+            __m512i su = _mm512_setzero_si512(), sv = _mm512_setzero_si512();
+            for (int row = 0; row < 2; ++row)
+            {
+                __m512i b = loadInts16(rows.b[row] + px);
+                __m512i g = loadInts16(rows.g[row] + px);
+                __m512i r = loadInts16(rows.r[row] + px);
+                __m512i y = _mm512_srai_epi32(_mm512_add_epi32(dot3(b, g, r, k.yB, k.yG, k.yR), yBias), COLOR_COEFF_BITS);
+                storeBytes16(dstY[row] + px, y);
+                su = _mm512_add_epi32(su, dot3(b, g, r, k.uB, k.uG, k.uR));
+                sv = _mm512_add_epi32(sv, dot3(b, g, r, k.vB, k.vG, k.vR));
+            }
+            pairU[half] = su;
+            pairV[half] = sv;
+        }
+        __m512i blockU = _mm512_add_epi32(pairSums(pairU[0], pairU[1]), uvBias);
+        __m512i blockV = _mm512_add_epi32(pairSums(pairV[0], pairV[1]), uvBias);
+        storeBytes16(u + bx, _mm512_srai_epi32(blockU, COLOR_COEFF_BITS + 2));
+        storeBytes16(v + bx, _mm512_srai_epi32(blockV, COLOR_COEFF_BITS + 2));
+    }
+    return bx;
+}
+} // namespace
+
+const CpuKernelTable &cpuKernelsAVX512()
+{
+    static const CpuKernelTable table = {CpuIsa::AVX512, blendRowsAVX512, lerpColumnsAVX512, convertBlocksAVX512};
+    return table;
+}
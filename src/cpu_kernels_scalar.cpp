@@ -0,0 +1,83 @@
+#include "cpu_kernels.hpp"
+
+// Reference row kernels. The arithmetic mirrors resize_bgr_to_i420 in
+// opencl_preprocess.cl term for term, so this path is also the fallback for
+// SIMD tails and for non-x86 hosts.
+
+namespace
+{
+inline uint8_t clampByte(int v)
+{
+    return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// The planes hold whole numbers, so the conversion to int is exact
+inline uint8_t luma(const ColorCoefficients &k, int b, int g, int r)
+{
+    return clampByte((k.yR * r + k.yG * g + k.yB * b + k.yBias) >> COLOR_COEFF_BITS);
+}
+
+void blendRowsScalar(const uint8_t *a, const uint8_t *b, float fy, float *dst, int n)
+{
+    const float wa = 1.0f - fy;
+    for (int i = 0; i < n; ++i)
+        dst[i] = a[i] * wa + b[i] * fy;
+}
+
+int lerpColumnsScalar(const float *row, const int *x0, const int *x1, const float *fx, int n,
+                      float *b, float *g, float *r)
+{
+    float *out[3] = {b, g, r};
+    for (int dx = 0; dx < n; ++dx)
+    {
+        const float *p0 = row + x0[dx] * 3;
+        const float *p1 = row + x1[dx] * 3;
+        for (int c = 0; c < 3; ++c)
+        {
+            float pixel = p0[c] * (1 - fx[dx]) + p1[c] * fx[dx];
+            pixel = pixel < 0.0f ? 0.0f : (pixel > 255.0f ? 255.0f : pixel);
+            out[c][dx] = (float)(int)pixel; // quantize like the kernel's uchar intermediate
+        }
+    }
+    return n;
+}
+
+int convertBlocksScalar(const PlanarRowPair &rows, int blocks, const ColorCoefficients &k,
+                        uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+    uint8_t *dstY[2] = {y0, y1};
+    for (int bx = 0; bx < blocks; ++bx)
+    {
+        int sumB = 0, sumG = 0, sumR = 0;
+        for (int dy = 0; dy < 2; ++dy)
+        {
+            for (int dx = 0; dx < 2; ++dx)
+            {
+                int px = bx * 2 + dx;
+                int b = static_cast<int>(rows.b[dy][px]);
+                int g = static_cast<int>(rows.g[dy][px]);
+                int r = static_cast<int>(rows.r[dy][px]);
+                dstY[dy][px] = luma(k, b, g, r);
+                sumB += b;
+                sumG += g;
+                sumR += r;
+            }
+        }
+        u[bx] = clampByte((k.uR * sumR + k.uG * sumG + k.uB * sumB + k.uvBias) >> (COLOR_COEFF_BITS + 2));
+        v[bx] = clampByte((k.vR * sumR + k.vG * sumG + k.vB * sumB + k.uvBias) >> (COLOR_COEFF_BITS + 2));
+    }
+    return blocks;
+}
+} // namespace
+
+const CpuKernelTable &cpuKernelsScalar()
+{
+    static const CpuKernelTable table = {CpuIsa::Scalar, blendRowsScalar, lerpColumnsScalar, convertBlocksScalar};
+    return table;
+}
+
+void cpuLumaRow(const float *b, const float *g, const float *r, int n, const ColorCoefficients &k, uint8_t *y)
+{
+    for (int i = 0; i < n; ++i)
+        y[i] = luma(k, static_cast<int>(b[i]), static_cast<int>(g[i]), static_cast<int>(r[i]));
+}
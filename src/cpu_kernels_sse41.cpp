@@ -0,0 +1,124 @@
+#include "cpu_kernels.hpp"
+
+#include <cstring>
+#include <smmintrin.h>
+
+// SSE4.1 row kernels: 4 floats per vector. Built with -msse4.1.
+
+namespace
+{
+inline __m128 loadBytes4(const uint8_t *p)
+{
+    int32_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(word)));
+}
+
+// Saturate to 0..255 and store 4 bytes
+inline void storeBytes4(uint8_t *p, __m128i i32)
+{
+    __m128i u16 = _mm_packus_epi32(i32, i32);
+    __m128i u8 = _mm_packus_epi16(u16, u16);
+    int32_t word = _mm_cvtsi128_si32(u8);
+    std::memcpy(p, &word, sizeof(word));
+}
+
+// Whole-number floats to int32, exactly
+inline __m128i loadInts4(const float *p)
+{
+    return _mm_cvttps_epi32(_mm_loadu_ps(p));
+}
+
+inline __m128i dot3(__m128i b, __m128i g, __m128i r, int32_t kb, int32_t kg, int32_t kr)
+{
+    return _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(b, _mm_set1_epi32(kb)), _mm_mullo_epi32(g, _mm_set1_epi32(kg))),
+                         _mm_mullo_epi32(r, _mm_set1_epi32(kr)));
+}
+
+void blendRowsSSE41(const uint8_t *a, const uint8_t *b, float fy, float *dst, int n)
+{
+    const __m128 wa = _mm_set1_ps(1.0f - fy);
+    const __m128 wb = _mm_set1_ps(fy);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 va = loadBytes4(a + i);
+        __m128 vb = loadBytes4(b + i);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(va, wa), _mm_mul_ps(vb, wb)));
+    }
+    for (; i < n; ++i)
+        dst[i] = a[i] * (1.0f - fy) + b[i] * fy;
+}
+
+// No gather before AVX2: the taps are loaded one by one and blended four
+// columns at a time
+int lerpColumnsSSE41(const float *row, const int *x0, const int *x1, const float *fx, int n,
+                     float *b, float *g, float *r)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 lo = _mm_setzero_ps();
+    const __m128 hi = _mm_set1_ps(255.0f);
+    float *out[3] = {b, g, r};
+    int dx = 0;
+    for (; dx + 4 <= n; dx += 4)
+    {
+        const float *p0[4] = {row + x0[dx] * 3, row + x0[dx + 1] * 3, row + x0[dx + 2] * 3, row + x0[dx + 3] * 3};
+        const float *p1[4] = {row + x1[dx] * 3, row + x1[dx + 1] * 3, row + x1[dx + 2] * 3, row + x1[dx + 3] * 3};
+        const __m128 w1 = _mm_loadu_ps(fx + dx);
+        const __m128 w0 = _mm_sub_ps(one, w1);
+        for (int c = 0; c < 3; ++c)
+        {
+            __m128 a = _mm_setr_ps(p0[0][c], p0[1][c], p0[2][c], p0[3][c]);
+            __m128 z = _mm_setr_ps(p1[0][c], p1[1][c], p1[2][c], p1[3][c]);
+            __m128 pixel = _mm_add_ps(_mm_mul_ps(a, w0), _mm_mul_ps(z, w1));
+            pixel = _mm_min_ps(_mm_max_ps(pixel, lo), hi);
+            _mm_storeu_ps(out[c] + dx, _mm_round_ps(pixel, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+        }
+    }
+    return dx;
+}
+
+int convertBlocksSSE41(const PlanarRowPair &rows, int blocks, const ColorCoefficients &k,
+                       uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+    const __m128i yBias = _mm_set1_epi32(k.yBias);
+    const __m128i uvBias = _mm_set1_epi32(k.uvBias);
+    uint8_t *dstY[2] = {y0, y1};
+
+    // 4 blocks (8 pixels per row) per iteration
+    int bx = 0;
+    for (; bx + 4 <= blocks; bx += 4)
+    {
+        __m128i pairU[2], pairV[2]; // per-pixel chroma terms summed over both rows
+        for (int half = 0; half < 2; ++half)
+        {
+            int px = bx * 2 + half * 4;
+            __m128i su = _mm_setzero_si128(), sv = _mm_setzero_si128();
+            for (int row = 0; row < 2; ++row)
+            {
+                __m128i b = loadInts4(rows.b[row] + px);
+                __m128i g = loadInts4(rows.g[row] + px);
+                __m128i r = loadInts4(rows.r[row] + px);
+                __m128i y = _mm_srai_epi32(_mm_add_epi32(dot3(b, g, r, k.yB, k.yG, k.yR), yBias), COLOR_COEFF_BITS);
+                storeBytes4(dstY[row] + px, y);
+                su = _mm_add_epi32(su, dot3(b, g, r, k.uB, k.uG, k.uR));
+                sv = _mm_add_epi32(sv, dot3(b, g, r, k.vB, k.vG, k.vR));
+            }
+            pairU[half] = su;
+            pairV[half] = sv;
+        }
+        // Horizontal pairs -> one value per 2x2 block
+        __m128i blockU = _mm_add_epi32(_mm_hadd_epi32(pairU[0], pairU[1]), uvBias);
+        __m128i blockV = _mm_add_epi32(_mm_hadd_epi32(pairV[0], pairV[1]), uvBias);
+        storeBytes4(u + bx, _mm_srai_epi32(blockU, COLOR_COEFF_BITS + 2));
+        storeBytes4(v + bx, _mm_srai_epi32(blockV, COLOR_COEFF_BITS + 2));
+    }
+    return bx;
+}
+} // namespace
+
+const CpuKernelTable &cpuKernelsSSE41()
+{
+    static const CpuKernelTable table = {CpuIsa::SSE41, blendRowsSSE41, lerpColumnsSSE41, convertBlocksSSE41};
+    return table;
+}
@@ -1,6 +1,11 @@
 #include "../include/encoder.hpp"
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
 
 /*
 The CRF (Constant Rate Factor) in x264 can range from 0 (lossless, very large files) up to 51 (lowest quality, smallest files). In practice you’ll typically pick something between about 18 (visually lossless) and 28 (high compression) depending on your needs.
@@ -30,45 +35,199 @@ The built-in x264 presets trade off encoding speed vs. compression efficiency. F
 So, for example, if you want quickest encoding with larger files you’d use -preset ultrafast, whereas for best file‐size reduction (at the cost of CPU time) you’d choose -preset veryslow (or even placebo). A common balance is -preset veryfast or -preset fast.
 */
 
-Encoder::Encoder(const std::string &outputPath, int w, int h, double f)
-    : ffmpegPipe(nullptr), width(w), height(h), fps(f)
+#ifdef HAVE_LIBAV
+std::unique_ptr<EncoderBackend> createLibavEncoder(const std::string &outputPath, int width, int height,
+                                                   double fps, const EncoderOptions &options);
+#endif
+
+#ifdef _WIN32
+std::string shellQuote(const std::string &arg)
+{
+    return "\"" + arg + "\"";
+}
+#else
+// Single-quote for the shell so paths with spaces, quotes or $ survive
+std::string shellQuote(const std::string &arg)
 {
-    std::string cmd =
-        "ffmpeg -y -f rawvideo -pix_fmt yuv420p "
-        "-s " +
-        std::to_string(width) + "x" + std::to_string(height) +
-        " -r " + std::to_string(fps) +
-        " -i - -c:v libx264 -preset ultrafast -crf 23 \"" +
-        outputPath + "\"";
-
-    ffmpegPipe = popen(cmd.c_str(), "w");
-    if (!ffmpegPipe)
+    std::string quoted = "'";
+    for (char c : arg)
     {
-        throw std::runtime_error("Failed to open FFmpeg pipe");
+        if (c == '\'')
+            quoted += "'\\''";
+        else
+            quoted += c;
     }
+    return quoted + "'";
+}
+#endif
+
+namespace
+{
+#ifdef _WIN32
+FILE *openPipe(const char *cmd) { return _popen(cmd, "wb"); }
+// Exit code of the child, or -1 if it could not be waited for
+int closePipe(FILE *pipe) { return _pclose(pipe); }
+#else
+FILE *openPipe(const char *cmd) { return popen(cmd, "w"); }
+int closePipe(FILE *pipe)
+{
+    int status = pclose(pipe);
+    if (status == -1)
+        return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+#endif
 
-    std::cout << "Encoder initialized: " << outputPath << std::endl;
+// ffmpeg options describing frames in this color space. BT.601 is tagged
+// as SMPTE 170M, the 525-line variant players assume for SD.
+std::string colorArgs(ColorSpace color)
+{
+    const char *matrix = color.matrix == ColorMatrix::BT709 ? "bt709" : "smpte170m";
+    return std::string(" -colorspace ") + matrix + " -color_primaries " + matrix + " -color_trc " + matrix +
+           " -color_range " + (color.range == ColorRange::Full ? "pc" : "tv");
 }
 
-void Encoder::encodeFrame(const std::vector<uint8_t> &yuvFrame)
+// Feeds raw I420 to an ffmpeg child process
+class PipeEncoder : public EncoderBackend
 {
-    size_t written = fwrite(yuvFrame.data(), 1, yuvFrame.size(), ffmpegPipe);
-    if (written != yuvFrame.size())
+public:
+    PipeEncoder(const std::string &outputPath, int width, int height, double fps, const EncoderOptions &options)
+    {
+        std::string cmd =
+            "ffmpeg -y -f rawvideo -pix_fmt yuv420p "
+            "-s " +
+            std::to_string(width) + "x" + std::to_string(height) +
+            " -r " + std::to_string(fps) + colorArgs(options.color) +
+            " -i - -c:v libx264 -preset " + options.preset +
+            " -crf " + std::to_string(options.crf) + colorArgs(options.color);
+        if (options.threads > 0)
+            cmd += " -threads " + std::to_string(options.threads);
+        if (!options.container.empty())
+            cmd += " -f " + shellQuote(options.container);
+        cmd += " " + shellQuote(outputPath);
+
+        ffmpegPipe = openPipe(cmd.c_str());
+        if (!ffmpegPipe)
+        {
+            throw std::runtime_error("Failed to open FFmpeg pipe");
+        }
+    }
+
+    ~PipeEncoder() override
+    {
+        if (ffmpegPipe)
+            closePipe(ffmpegPipe);
+    }
+
+    const char *name() const override { return "pipe"; }
+
+    void encodeFrame(const uint8_t *data, size_t size, EncodedFrameInfo &) override
+    {
+        size_t written = fwrite(data, 1, size, ffmpegPipe);
+        if (written != size)
+        {
+            throw std::runtime_error("Failed to write frame to FFmpeg");
+        }
+    }
+
+    void finish(EncodedFrameInfo &) override
     {
-        throw std::runtime_error("Failed to write frame to FFmpeg");
+        if (ffmpegPipe)
+        {
+            int status = closePipe(ffmpegPipe);
+            ffmpegPipe = nullptr;
+            // ffmpeg only reports a bad output path or a failed encode
+            // through its exit code
+            if (status != 0)
+                throw std::runtime_error("FFmpeg exited with status " + std::to_string(status));
+        }
     }
+
+private:
+    FILE *ffmpegPipe = nullptr;
+};
+} // namespace
+
+const std::vector<std::string> &encoderPresets()
+{
+    static const std::vector<std::string> presets = {
+        "ultrafast", "superfast", "veryfast", "faster", "fast",
+        "medium", "slow", "slower", "veryslow", "placebo"};
+    return presets;
 }
 
-void Encoder::finish()
+Encoder::Encoder(const std::string &outputPath, int w, int h, double f, const EncoderOptions &options)
+    : options_(options)
 {
-    if (ffmpegPipe)
+    // The preset ends up on a command line in pipe mode, so only known
+    // names are accepted
+    const std::vector<std::string> &presets = encoderPresets();
+    if (std::find(presets.begin(), presets.end(), options_.preset) == presets.end())
+        throw std::invalid_argument("Unknown encoder preset '" + options_.preset + "'");
+    options_.crf = std::clamp(options_.crf, 0, 51);
+
+#ifdef HAVE_LIBAV
+    if (options_.backend != EncoderOptions::Backend::Pipe)
     {
-        pclose(ffmpegPipe);
-        ffmpegPipe = nullptr;
+        try
+        {
+            backend_ = createLibavEncoder(outputPath, w, h, f, options_);
+        }
+        catch (const std::exception &ex)
+        {
+            if (options_.backend == EncoderOptions::Backend::Libav)
+                throw;
+            std::cerr << "libav encoder unavailable (" << ex.what() << "), using ffmpeg pipe\n";
+        }
     }
+#else
+    if (options_.backend == EncoderOptions::Backend::Libav)
+        throw std::runtime_error("Built without libav support");
+#endif
+    if (!backend_)
+        backend_ = std::make_unique<PipeEncoder>(outputPath, w, h, f, options_);
+
+    std::cout << "Encoder initialized (" << backend_->name() << "): " << outputPath << std::endl;
+}
+
+void Encoder::encodeFrame(const std::vector<uint8_t> &yuvFrame)
+{
+    encodeFrame(yuvFrame.data(), yuvFrame.size());
+}
+
+void Encoder::encodeFrame(const uint8_t *data, size_t size)
+{
+    EncodedFrameInfo info;
+    info.frameIndex = stats_.frames;
+    auto t0 = std::chrono::steady_clock::now();
+    backend_->encodeFrame(data, size, info);
+    info.encodeSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    ++stats_.frames;
+    stats_.packets += info.packets;
+    stats_.bytes += info.packetBytes;
+    stats_.encodeSec += info.encodeSec;
+    stats_.maxFrameSec = std::max(stats_.maxFrameSec, info.encodeSec);
+    if (options_.onFrameEncoded)
+        options_.onFrameEncoded(info);
+}
+
+void Encoder::finish()
+{
+    EncodedFrameInfo flushed;
+    backend_->finish(flushed);
+    stats_.packets += flushed.packets;
+    stats_.bytes += flushed.packetBytes;
 }
 
 Encoder::~Encoder()
 {
-    finish();
+    try
+    {
+        finish();
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Encoder: " << ex.what() << "\n";
+    }
 }
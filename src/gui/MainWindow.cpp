@@ -1,4 +1,5 @@
 #include "MainWindow.hpp"
+#include "encoder.hpp"
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
@@ -137,9 +138,17 @@ void MainWindow::setupUi()
 
     // Preset + CRF
     presetBox = new QComboBox;
-    presetBox->addItems({"preset-1", "preset-2", "preset-3"});
+    for (const std::string &preset : encoderPresets())
+        presetBox->addItem(QString::fromStdString(preset));
     mainLayout->addWidget(presetBox);
 
+    // Output size: target height, width follows the input's aspect ratio
+    sizeBox = new QComboBox;
+    sizeBox->addItem("Half size", 0);
+    for (int height : {1080, 720, 480, 360})
+        sizeBox->addItem(QString("%1p").arg(height), height);
+    mainLayout->addWidget(sizeBox);
+
     auto *crfLayout = new QHBoxLayout;
     crfLayout->addWidget(new QLabel("CRF:"));
     crfSlider = new QSlider(Qt::Horizontal);
@@ -264,7 +273,8 @@ void MainWindow::onStartCompression()
                       {
     QString err;
     task->compress(inputFilePath, outputFilePath,
-                   crfSlider->value(), presetBox->currentIndex(), &err); });
+                   crfSlider->value(), presetBox->currentIndex(),
+                   sizeBox->currentData().toInt(), &err); });
 }
 
 void MainWindow::onCompressionProgress(double pct, double el, double eta)
@@ -1,15 +1,121 @@
 #include "VideoCompressorTask.hpp"
 #include "video_reader.hpp"
-#include "opencl_driver.hpp"
+#include "preprocess_backend.hpp"
 #include "encoder.hpp"
-#include "bounded_queue.hpp"
+#include "pipeline.hpp"
+#include "pipeline_tuning.hpp"
+#include "resize_filter.hpp"
 
+#include <QtConcurrent>
 #include <opencv2/opencv.hpp>
-#include <thread>
 #include <chrono>
+#include <iostream>
+#include <mutex>
 #include <vector>
+#include <memory>
 #include <stdexcept>
 
+namespace
+{
+// Backend shared by successive jobs; only one job runs at a time. The mutex
+// is held while building, so a job started during pre-warm waits for it
+// instead of building a second one.
+std::mutex backendMutex;
+std::unique_ptr<PreprocessBackend> idleBackend;
+bool backendInUse = false;
+
+std::unique_ptr<PreprocessBackend> acquireBackend()
+{
+  std::lock_guard<std::mutex> lock(backendMutex);
+  if (!idleBackend)
+    idleBackend = createBackend("auto");
+  backendInUse = true;
+  return std::move(idleBackend);
+}
+
+void returnBackend(std::unique_ptr<PreprocessBackend> backend)
+{
+  std::lock_guard<std::mutex> lock(backendMutex);
+  idleBackend = std::move(backend);
+  backendInUse = false;
+}
+
+// The shared backend for one job. Hands it back when the job ends however
+// it ends, unless a call into the backend itself threw; then it is dropped
+// and the next job builds a fresh one. Reader and encoder errors keep it.
+class BackendLease : public PreprocessBackend
+{
+public:
+  BackendLease() : backend_(acquireBackend())
+  {
+    resizeFilter_ = backend_->resizeFilter();
+    colorSpace_ = backend_->colorSpace();
+  }
+  ~BackendLease() override { returnBackend(failed_ ? nullptr : std::move(backend_)); }
+
+  std::string name() const override { return backend_->name(); }
+  size_t slotCount() const override { return backend_->slotCount(); }
+  void setResizeFilter(ResizeFilter filter) override
+  {
+    track([&] { backend_->setResizeFilter(filter); });
+    resizeFilter_ = filter;
+  }
+  void setColorSpace(ColorSpace space) override
+  {
+    track([&] { backend_->setColorSpace(space); });
+    colorSpace_ = space;
+  }
+  FrameTicket submitFrame(const cv::Mat &input, int targetWidth, int targetHeight) override
+  {
+    return track([&] { return backend_->submitFrame(input, targetWidth, targetHeight); });
+  }
+  YuvFrame waitMappedFrame(FrameTicket ticket) override
+  {
+    return track([&] { return backend_->waitMappedFrame(ticket); });
+  }
+  StageLatencies stageLatencies() const override { return backend_->stageLatencies(); }
+
+private:
+  template <typename Call>
+  auto track(Call call) -> decltype(call())
+  {
+    try
+    {
+      return call();
+    }
+    catch (...)
+    {
+      failed_ = true;
+      throw;
+    }
+  }
+
+  std::unique_ptr<PreprocessBackend> backend_;
+  bool failed_ = false;
+};
+} // namespace
+
+void VideoCompressorTask::prewarmBackend()
+{
+  QtConcurrent::run([]
+                    {
+    std::lock_guard<std::mutex> lock(backendMutex);
+    if (idleBackend || backendInUse)
+      return;
+    try {
+      idleBackend = createBackend("auto");
+    } catch (const std::exception &ex) {
+      // The first job retries and reports the error
+      std::cerr << "Backend pre-warm failed: " << ex.what() << "\n";
+    } });
+}
+
+void VideoCompressorTask::shutdownBackend()
+{
+  std::lock_guard<std::mutex> lock(backendMutex);
+  idleBackend.reset();
+}
+
 VideoCompressorTask::VideoCompressorTask(QObject *parent)
     : QObject(parent)
 {
@@ -20,6 +126,7 @@ void VideoCompressorTask::compress(const QString &inPathQs,
                                    const QString &outPathQs,
                                    int crf,
                                    int preset,
+                                   int targetHeight,
                                    QString *errorMsg)
 {
   // Convert Qt strings to std::string
@@ -28,59 +135,44 @@ void VideoCompressorTask::compress(const QString &inPathQs,
 
   try
   {
-    VideoReader reader(inPath);
-    OpenCLDriver processor;
+    // Decode ahead of the pipeline so the backend is not left waiting
+    VideoReader::Options readerOptions;
+    readerOptions.readAhead = 4;
+    VideoReader reader(inPath, readerOptions);
+    BackendLease processor;
     int inW = reader.getWidth();
     int inH = reader.getHeight();
     double fps = reader.getFPS();
-    int outW = (inW / 2) & ~1, outH = (inH / 2) & ~1;
-    Encoder encoder(outPath, outW, outH, fps);
+    int outW, outH;
+    computeOutputSize(inW, inH, 0, targetHeight, true, outW, outH);
+    EncoderOptions encoderOptions;
+    encoderOptions.crf = crf;
+    const std::vector<std::string> &presets = encoderPresets();
+    if (preset >= 0 && static_cast<size_t>(preset) < presets.size())
+      encoderOptions.preset = presets[preset];
+    Encoder encoder(outPath, outW, outH, fps, encoderOptions);
 
-    const size_t QUEUE_CAP = 4;
-    BoundedQueue<cv::Mat> frameQ(QUEUE_CAP);
-    BoundedQueue<std::vector<uint8_t>> yuvQ(QUEUE_CAP);
-
-    size_t processed = 0;
     auto t0 = std::chrono::high_resolution_clock::now();
 
-    // Reader
-    std::thread r([&]()
-                  {
-            cv::Mat f;
-            while(reader.getNextFrame(f)) {
-                if (!frameQ.push(f)) break;
-            }
-            frameQ.close(); });
-
-    // Processor
-    std::thread p([&]()
-                  {
-            cv::Mat f; std::vector<uint8_t> yuv;
-            while(frameQ.pop(f)) {
-                processor.processFrame(f, yuv, outW, outH);
-                if (!yuvQ.push(yuv)) break;
-            }
-            yuvQ.close(); });
-
-    // Encoder
-    std::thread e([&]()
-                  {
-            std::vector<uint8_t> yuv;
-            while(yuvQ.pop(yuv)) {
-                encoder.encodeFrame(yuv);
-                ++processed;
-                auto now = std::chrono::high_resolution_clock::now();
-                double elapsed = std::chrono::duration<double>(now - t0).count();
-                double percent = (100.0 * processed) / reader.getFPS() /*approx frames*/;
-                double eta     = elapsed * (1.0/percent*100 - 1.0);
-                emit progress(percent, elapsed, eta);
-                // emit progressStatsUpdateRequested();
-            }
-            encoder.finish(); });
-
-    r.join();
-    p.join();
-    e.join();
+    // Queue depth the CLI's --autotune found for this kind of job, if any;
+    // the GUI runs a single worker on its shared backend
+    PipelineTuning tuning;
+    loadTuning(tuningProfilePath(), tuningKey("auto", inW, inH, outW, outH, readerOptions.format), tuning);
+    PipelineOptions options;
+    options.outWidth = outW;
+    options.outHeight = outH;
+    options.queueCapacity = tuning.queueCapacity;
+    options.onFrameEncoded = [&](size_t processed)
+    {
+      auto now = std::chrono::high_resolution_clock::now();
+      double elapsed = std::chrono::duration<double>(now - t0).count();
+      double percent = (100.0 * processed) / reader.getFPS() /*approx frames*/;
+      double eta = elapsed * (1.0 / percent * 100 - 1.0);
+      emit progress(percent, elapsed, eta);
+      // emit progressStatsUpdateRequested();
+    };
+    runPipeline(reader, processor, encoder, options);
+
     emit finished(true, QString());
   }
   catch (const std::exception &ex)
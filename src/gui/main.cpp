@@ -2,6 +2,7 @@
 // main.cpp for GUI. No changes needed for backend integration, but comment added for clarity (2025-07-05)
 #include <QApplication>
 #include "MainWindow.hpp"
+#include "VideoCompressorTask.hpp"
 
 
 #include "TimerEventFilter.hpp"
@@ -14,5 +15,9 @@ int main(int argc, char *argv[])
     app.installEventFilter(filter);
     MainWindow w;
     w.show();
-    return app.exec();
+    // Initialize OpenCL and build kernels while the user picks a file
+    VideoCompressorTask::prewarmBackend();
+    int result = app.exec();
+    VideoCompressorTask::shutdownBackend();
+    return result;
 }
@@ -0,0 +1,586 @@
+#include "job_server.hpp"
+#include "preprocess_backend.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+// How long a new connection may take to send its request, and the least
+// time between two progress updates to one client
+const int REQUEST_TIMEOUT_MS = 5000;
+const std::chrono::milliseconds PROGRESS_INTERVAL(250);
+
+std::vector<std::string> splitFields(const std::string &line)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true)
+    {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (tab == std::string::npos)
+            return fields;
+        start = tab + 1;
+    }
+}
+
+// Whole-string number, or std::invalid_argument naming the field
+template <typename T>
+T parseNumber(const std::string &text, const char *field)
+{
+    std::istringstream stream(text);
+    T value{};
+    if (text.empty() || !(stream >> value) || !stream.eof())
+        throw std::invalid_argument(std::string("Bad ") + field + " '" + text + "'");
+    return value;
+}
+
+std::string checkedField(const std::string &value, const char *field)
+{
+    if (value.find_first_of("\t\r\n") != std::string::npos)
+        throw std::invalid_argument(std::string("Job ") + field + " contains a tab or newline");
+    return value;
+}
+
+const char *kindName(JobUpdate::Kind kind)
+{
+    switch (kind)
+    {
+    case JobUpdate::Kind::Queued:
+        return "queued";
+    case JobUpdate::Kind::Started:
+        return "started";
+    case JobUpdate::Kind::Progress:
+        return "progress";
+    case JobUpdate::Kind::Done:
+        return "done";
+    case JobUpdate::Kind::Failed:
+        return "failed";
+    }
+    return "";
+}
+} // namespace
+
+std::string formatJobRequest(const JobRequest &job)
+{
+    std::string line = "submit\tinput=" + checkedField(job.input, "input") +
+                       "\toutput=" + checkedField(job.output, "output");
+    line += "\twidth=" + std::to_string(job.width) + "\theight=" + std::to_string(job.height);
+    line += "\tcrf=" + std::to_string(job.crf);
+    if (!job.preset.empty())
+        line += "\tpreset=" + checkedField(job.preset, "preset");
+    line += "\tpriority=" + std::to_string(job.priority);
+    return line;
+}
+
+JobRequest parseJobRequest(const std::string &line)
+{
+    std::vector<std::string> fields = splitFields(line);
+    if (fields[0] != "submit")
+        throw std::invalid_argument("Unknown command '" + fields[0] + "'");
+    JobRequest job;
+    for (size_t i = 1; i < fields.size(); ++i)
+    {
+        size_t equals = fields[i].find('=');
+        std::string key = fields[i].substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : fields[i].substr(equals + 1);
+        if (key == "input")
+            job.input = value;
+        else if (key == "output")
+            job.output = value;
+        else if (key == "width")
+            job.width = parseNumber<int>(value, "width");
+        else if (key == "height")
+            job.height = parseNumber<int>(value, "height");
+        else if (key == "crf")
+            job.crf = parseNumber<int>(value, "crf");
+        else if (key == "preset")
+            job.preset = value;
+        else if (key == "priority")
+            job.priority = parseNumber<int>(value, "priority");
+        else
+            throw std::invalid_argument("Unknown job field '" + key + "'");
+    }
+    if (job.input.empty() || job.output.empty())
+        throw std::invalid_argument("A job needs an input and an output");
+    if (job.width < 0 || job.height < 0)
+        throw std::invalid_argument("Negative output size");
+    if (job.crf < -1 || job.crf > 51)
+        throw std::invalid_argument("CRF must be 0..51");
+    if (!job.preset.empty() &&
+        std::find(encoderPresets().begin(), encoderPresets().end(), job.preset) == encoderPresets().end())
+        throw std::invalid_argument("Unknown preset '" + job.preset + "'");
+    return job;
+}
+
+std::string formatJobUpdate(const JobUpdate &update)
+{
+    std::string line = std::string(kindName(update.kind)) + "\t" + std::to_string(update.id);
+    switch (update.kind)
+    {
+    case JobUpdate::Kind::Queued:
+        line += "\t" + std::to_string(update.position);
+        break;
+    case JobUpdate::Kind::Started:
+        break;
+    case JobUpdate::Kind::Progress:
+        line += "\t" + std::to_string(update.frames);
+        break;
+    case JobUpdate::Kind::Done:
+    {
+        std::ostringstream seconds;
+        seconds << update.seconds;
+        line += "\t" + std::to_string(update.frames) + "\t" + seconds.str() + "\t" +
+                std::to_string(update.inBytes) + "\t" + std::to_string(update.outBytes);
+        break;
+    }
+    case JobUpdate::Kind::Failed:
+    {
+        // Errors quote ffmpeg and the OS; keep them on one line
+        std::string error = update.error;
+        std::replace_if(error.begin(), error.end(), [](char c) { return c == '\t' || c == '\r' || c == '\n'; }, ' ');
+        line += "\t" + error;
+        break;
+    }
+    }
+    return line;
+}
+
+JobUpdate parseJobUpdate(const std::string &line)
+{
+    std::vector<std::string> fields = splitFields(line);
+    JobUpdate update;
+    const size_t ALL_KINDS = 5;
+    size_t kind = 0;
+    while (kind < ALL_KINDS && fields[0] != kindName(static_cast<JobUpdate::Kind>(kind)))
+        ++kind;
+    if (kind == ALL_KINDS || fields.size() < 2)
+        throw std::invalid_argument("Bad job update '" + line + "'");
+    update.kind = static_cast<JobUpdate::Kind>(kind);
+    update.id = parseNumber<uint64_t>(fields[1], "job id");
+
+    const size_t expected[ALL_KINDS] = {3, 2, 3, 6, 3};
+    if (fields.size() != expected[kind])
+        throw std::invalid_argument("Bad job update '" + line + "'");
+    switch (update.kind)
+    {
+    case JobUpdate::Kind::Queued:
+        update.position = parseNumber<size_t>(fields[2], "queue position");
+        break;
+    case JobUpdate::Kind::Started:
+        break;
+    case JobUpdate::Kind::Progress:
+        update.frames = parseNumber<size_t>(fields[2], "frame count");
+        break;
+    case JobUpdate::Kind::Done:
+        update.frames = parseNumber<size_t>(fields[2], "frame count");
+        update.seconds = parseNumber<double>(fields[3], "seconds");
+        update.inBytes = parseNumber<uintmax_t>(fields[4], "input size");
+        update.outBytes = parseNumber<uintmax_t>(fields[5], "output size");
+        break;
+    case JobUpdate::Kind::Failed:
+        update.error = fields[2];
+        break;
+    }
+    return update;
+}
+
+#ifndef _WIN32
+
+namespace
+{
+// Not every platform has MSG_NOSIGNAL; the daemon also ignores SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Longest request or update line accepted
+const size_t MAX_LINE = 64 * 1024;
+
+std::string systemError(const std::string &what)
+{
+    return what + ": " + std::strerror(errno);
+}
+
+sockaddr_un socketAddress(const std::string &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Bad socket path '" + path + "'");
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// Connected stream socket, or -1 with errno set
+int connectTo(const std::string &path)
+{
+    sockaddr_un address = socketAddress(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+// Best effort: a client that has gone away just stops getting updates
+bool sendLine(int fd, const std::string &line)
+{
+    std::string data = line + "\n";
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Newline-terminated lines from a socket
+class LineReader
+{
+public:
+    explicit LineReader(int fd) : fd_(fd) {}
+
+    // False on end of stream, error or an over-long line
+    bool next(std::string &line)
+    {
+        size_t newline;
+        while ((newline = buffer_.find('\n')) == std::string::npos)
+        {
+            if (buffer_.size() > MAX_LINE)
+                return false;
+            char chunk[4096];
+            ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            buffer_.append(chunk, static_cast<size_t>(n));
+        }
+        line = buffer_.substr(0, newline);
+        buffer_.erase(0, newline + 1);
+        return true;
+    }
+
+private:
+    int fd_;
+    std::string buffer_;
+};
+} // namespace
+
+JobServer::JobServer(const std::string &socketPath, const std::vector<PreprocessBackend *> &backends,
+                     JobServerOptions options)
+    : socketPath_(socketPath), backends_(backends), options_(std::move(options))
+{
+    if (backends_.empty())
+        throw std::invalid_argument("JobServer needs at least one backend");
+    sockaddr_un address = socketAddress(socketPath_);
+
+    // Never delete anything but a socket, e.g. for --serve out.mp4
+    struct stat info;
+    if (::lstat(socketPath_.c_str(), &info) == 0 && !S_ISSOCK(info.st_mode))
+        throw std::runtime_error(socketPath_ + " exists and is not a socket");
+
+    // A socket file nobody accepts on is left over from a server that died
+    int probe = connectTo(socketPath_);
+    if (probe >= 0)
+    {
+        ::close(probe);
+        throw std::runtime_error("A server is already listening on " + socketPath_);
+    }
+    if (errno == ECONNREFUSED)
+        ::unlink(socketPath_.c_str());
+
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0)
+        throw std::runtime_error(systemError("Cannot create socket"));
+    if (::bind(listenFd_, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd_, 16) != 0)
+    {
+        std::string error = systemError("Cannot listen on " + socketPath_);
+        ::close(listenFd_);
+        throw std::runtime_error(error);
+    }
+}
+
+JobServer::~JobServer()
+{
+    closeSocket();
+}
+
+void JobServer::closeSocket()
+{
+    if (listenFd_ < 0)
+        return;
+    ::close(listenFd_); // connections not yet accepted see the server hang up
+    ::unlink(socketPath_.c_str());
+    listenFd_ = -1;
+}
+
+void JobServer::run()
+{
+    for (PreprocessBackend *backend : backends_)
+        workers_.emplace_back([this, backend] { worker(*backend); });
+
+    // Wake up now and then to notice stop(). Request lines are read as
+    // they arrive, so a client that is slow to send one holds up no one.
+    std::vector<Connection> connections;
+    while (!stopping_)
+    {
+        std::vector<pollfd> pollers{{listenFd_, POLLIN, 0}};
+        for (const Connection &connection : connections)
+            pollers.push_back({connection.fd, POLLIN, 0});
+        int ready = ::poll(pollers.data(), pollers.size(), 200);
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        auto now = Clock::now();
+        for (size_t i = connections.size(); i-- > 0;)
+        {
+            Connection &connection = connections[i];
+            bool readable = ready > 0 && pollers[i + 1].revents != 0;
+            if (!(readable && readRequest(connection)) && now < connection.deadline)
+                continue;
+            if (connection.fd >= 0)
+                ::close(connection.fd);
+            connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+
+        if (ready > 0 && (pollers[0].revents & POLLIN))
+        {
+            int fd = ::accept(listenFd_, nullptr, nullptr);
+            if (fd >= 0)
+                connections.push_back({fd, std::string(), now + std::chrono::milliseconds(REQUEST_TIMEOUT_MS)});
+        }
+    }
+    closeSocket();
+    for (const Connection &connection : connections)
+        ::close(connection.fd);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    jobReady_.notify_all();
+    for (std::thread &worker : workers_)
+        worker.join();
+    workers_.clear();
+
+    for (Job &job : queue_)
+    {
+        JobUpdate failed;
+        failed.kind = JobUpdate::Kind::Failed;
+        failed.id = job.id;
+        failed.error = "server shutting down";
+        send(job, failed);
+        ::close(job.fd);
+    }
+    queue_.clear();
+}
+
+bool JobServer::readRequest(Connection &connection)
+{
+    char chunk[4096];
+    ssize_t n = ::recv(connection.fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR)
+        return false;
+    if (n <= 0)
+        return true;
+    connection.received.append(chunk, static_cast<size_t>(n));
+    size_t newline = connection.received.find('\n');
+    if (newline == std::string::npos)
+        return connection.received.size() > MAX_LINE;
+    acceptJob(connection.fd, connection.received.substr(0, newline));
+    connection.fd = -1; // now the job's
+    return true;
+}
+
+void JobServer::acceptJob(int fd, const std::string &line)
+{
+    Job job;
+    job.fd = fd;
+    JobUpdate update;
+    std::unique_lock<std::mutex> lock(mutex_);
+    job.id = nextId_++;
+    update.id = job.id;
+    try
+    {
+        job.request = parseJobRequest(line);
+        if (queue_.size() >= options_.maxQueued)
+            throw std::runtime_error("queue full (" + std::to_string(queue_.size()) + " jobs waiting)");
+    }
+    catch (const std::exception &ex)
+    {
+        lock.unlock();
+        update.kind = JobUpdate::Kind::Failed;
+        update.error = ex.what();
+        send(job, update);
+        ::close(fd);
+        return;
+    }
+    update.kind = JobUpdate::Kind::Queued;
+    update.position = static_cast<size_t>(std::count_if(queue_.begin(), queue_.end(), [&](const Job &queued)
+                                                        { return runsLater(job, queued); }));
+    // Sent before a worker can see the job, so Queued arrives before Started
+    send(job, update);
+    queue_.push_back(std::move(job));
+    std::push_heap(queue_.begin(), queue_.end(), runsLater);
+    lock.unlock();
+    jobReady_.notify_one();
+}
+
+void JobServer::worker(PreprocessBackend &backend)
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            jobReady_.wait(lock, [&] { return closed_ || !queue_.empty(); });
+            if (closed_)
+                return;
+            std::pop_heap(queue_.begin(), queue_.end(), runsLater);
+            job = std::move(queue_.back());
+            queue_.pop_back();
+        }
+        try
+        {
+            runJob(job, backend);
+        }
+        catch (const std::exception &ex)
+        {
+            // Pipeline errors arrive as a Failed update from runJob; anything
+            // else (an onUpdate callback) must not end this worker
+            JobUpdate failed;
+            failed.kind = JobUpdate::Kind::Failed;
+            failed.id = job.id;
+            failed.error = ex.what();
+            sendLine(job.fd, formatJobUpdate(failed));
+        }
+        ::close(job.fd);
+    }
+}
+
+void JobServer::runJob(Job &job, PreprocessBackend &backend)
+{
+    JobUpdate update;
+    update.id = job.id;
+    update.kind = JobUpdate::Kind::Started;
+    send(job, update);
+
+    BatchOptions options = options_.defaults;
+    if (job.request.width > 0 || job.request.height > 0)
+    {
+        options.width = job.request.width;
+        options.height = job.request.height;
+    }
+    if (job.request.crf >= 0)
+        options.encoder.crf = job.request.crf;
+    if (!job.request.preset.empty())
+        options.encoder.preset = job.request.preset;
+    Clock::time_point lastProgress = Clock::now();
+    options.pipeline.onFrameEncoded = [&](size_t frames)
+    {
+        Clock::time_point now = Clock::now();
+        if (now - lastProgress < PROGRESS_INTERVAL)
+            return;
+        lastProgress = now;
+        update.kind = JobUpdate::Kind::Progress;
+        update.frames = frames;
+        send(job, update);
+    };
+
+    BatchFileStats file = transcodeItem({job.request.input, job.request.output}, backend, options);
+    update.kind = file.ok ? JobUpdate::Kind::Done : JobUpdate::Kind::Failed;
+    update.frames = file.frames;
+    update.seconds = file.totalSec;
+    update.inBytes = file.inBytes;
+    update.outBytes = file.outBytes;
+    update.error = file.error;
+    send(job, update);
+}
+
+void JobServer::send(const Job &job, const JobUpdate &update)
+{
+    sendLine(job.fd, formatJobUpdate(update));
+    if (options_.onUpdate)
+        options_.onUpdate(job.request, update);
+}
+
+JobUpdate submitJob(const std::string &socketPath, const JobRequest &job,
+                    const std::function<void(const JobUpdate &)> &onUpdate)
+{
+    std::string request = formatJobRequest(job);
+    int fd = connectTo(socketPath);
+    if (fd < 0)
+        throw std::runtime_error(systemError("Cannot connect to " + socketPath));
+    std::string line;
+    LineReader reader(fd);
+    bool ok = sendLine(fd, request);
+    while (ok && reader.next(line))
+    {
+        JobUpdate update;
+        try
+        {
+            update = parseJobUpdate(line);
+        }
+        catch (const std::invalid_argument &ex)
+        {
+            ::close(fd);
+            throw std::runtime_error(ex.what());
+        }
+        if (onUpdate)
+            onUpdate(update);
+        if (update.kind == JobUpdate::Kind::Done || update.kind == JobUpdate::Kind::Failed)
+        {
+            ::close(fd);
+            return update;
+        }
+    }
+    ::close(fd);
+    throw std::runtime_error("Server at " + socketPath + " hung up before the job ended");
+}
+
+#else // _WIN32
+
+JobServer::JobServer(const std::string &, const std::vector<PreprocessBackend *> &, JobServerOptions)
+{
+    throw std::runtime_error("The job server needs Unix domain sockets");
+}
+
+JobServer::~JobServer() {}
+
+void JobServer::run() {}
+
+JobUpdate submitJob(const std::string &, const JobRequest &, const std::function<void(const JobUpdate &)> &)
+{
+    throw std::runtime_error("The job server needs Unix domain sockets");
+}
+
+#endif // _WIN32
@@ -0,0 +1,269 @@
+#include "ladder.hpp"
+#include "video_reader.hpp"
+#include "preprocess_backend.hpp"
+#include "encoder.hpp"
+#include "bounded_queue.hpp"
+#include "frame_pool.hpp"
+#include "trace.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace
+{
+// Queue and host buffers between the processing thread and one
+// rendition's encoder
+struct RenditionLink
+{
+    RenditionLink(size_t buffers, size_t frameSize)
+        : pool(buffers, frameSize), queue(buffers) {}
+
+    YuvBufferPool pool;
+    BoundedQueue<YuvFrame> queue;
+};
+} // namespace
+
+std::vector<int> parseLadder(const std::string &spec)
+{
+    std::vector<int> heights;
+    std::stringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        size_t end = 0;
+        int height = 0;
+        try
+        {
+            height = std::stoi(item, &end);
+        }
+        catch (const std::exception &)
+        {
+            end = 0;
+        }
+        if (end == 0 || end != item.size() || height <= 0)
+            throw std::invalid_argument("Bad ladder height '" + item + "'");
+        if (std::find(heights.begin(), heights.end(), height) != heights.end())
+            throw std::invalid_argument("Ladder height " + item + " given twice");
+        heights.push_back(height);
+    }
+    if (heights.empty())
+        throw std::invalid_argument("Empty ladder");
+    return heights;
+}
+
+std::string renditionPath(const std::string &outPath, int height)
+{
+    std::filesystem::path out(outPath);
+    return (out.parent_path() / (out.stem().string() + "_" + std::to_string(height) + "p" +
+                                 out.extension().string()))
+        .string();
+}
+
+LadderStats runLadder(VideoReader &reader,
+                      PreprocessBackend &processor,
+                      const std::vector<LadderRendition> &renditions,
+                      const LadderOptions &options)
+{
+    const size_t count = renditions.size();
+    if (count == 0)
+        throw std::invalid_argument("runLadder needs at least one rendition");
+    const size_t depth = processor.renditionSlotCount(count);
+    if (depth == 0)
+        throw std::invalid_argument("Backend " + processor.name() + " has " + std::to_string(processor.slotCount()) +
+                                    " frame slots, too few for " + std::to_string(count) + " renditions");
+
+    std::vector<PreprocessBackend::OutputSize> sizes(count);
+    std::vector<std::unique_ptr<RenditionLink>> links;
+    for (size_t i = 0; i < count; ++i)
+    {
+        sizes[i].width = renditions[i].width;
+        sizes[i].height = renditions[i].height;
+        size_t frameSize = (size_t)sizes[i].width * sizes[i].height +
+                           2 * (size_t)(sizes[i].width / 2) * (sizes[i].height / 2);
+        links.push_back(std::make_unique<RenditionLink>(options.renditionBuffer, frameSize));
+    }
+
+    // Source buffers as in runPipeline(): enough for the queue and every
+    // ladder in flight, plus one being read
+    size_t poolSize = options.framePoolSize > 0 ? options.framePoolSize : options.queueCapacity + depth + 1;
+    if (poolSize < depth + 1)
+        poolSize = depth + 1;
+    FramePool framePool(poolSize, reader.frameRows(), reader.getWidth(), reader.frameType());
+    BoundedQueue<PooledFrame> frameQueue(options.queueCapacity);
+
+    LadderStats stats;
+    stats.renditions.resize(count);
+    auto tStart = Clock::now();
+
+    // As in runPipeline(), the first error from any stage is kept and
+    // rethrown after the join; closing the pools and queues stops the rest
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+    auto fail = [&]
+    {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        failed = true;
+        framePool.close();
+        frameQueue.close();
+        for (const std::unique_ptr<RenditionLink> &link : links)
+        {
+            link->pool.close();
+            link->queue.close();
+        }
+    };
+
+    // Reader thread
+    std::thread readerThread([&]
+                             {
+        setTraceThreadName("reader");
+        try {
+            for (size_t n = 0; !failed && (options.maxFrames == 0 || n < options.maxFrames); ++n) {
+                PooledFrame frame = framePool.acquire();
+                if (!frame) break;
+                {
+                    TraceScope trace("decode", static_cast<int64_t>(n));
+                    if (!reader.getNextFrame(frame.mat())) break;
+                }
+                TraceScope trace("queue_push", static_cast<int64_t>(n));
+                if (!frameQueue.push(std::move(frame))) break;
+                ++stats.framesRead;
+            }
+        } catch (...) {
+            fail();
+        }
+        frameQueue.close(); });
+
+    // Encoder thread per rendition
+    std::vector<std::thread> encoderThreads;
+    for (size_t i = 0; i < count; ++i)
+    {
+        encoderThreads.emplace_back([&, i]
+                                    {
+            setTraceThreadName("encoder " + std::to_string(renditions[i].height) + "p");
+            RenditionStats &rendition = stats.renditions[i];
+            Encoder &encoder = *renditions[i].encoder;
+            auto tEncoder = Clock::now();
+            try {
+                YuvFrame yuv;
+                while (!failed && links[i]->queue.pop(yuv)) {
+                    auto t0 = Clock::now();
+                    TraceScope trace("encode", static_cast<int64_t>(rendition.frames));
+                    encoder.encodeFrame(yuv.data(), yuv.size());
+                    yuv.release(); // buffer back to the rendition's pool
+                    rendition.encSec += secondsBetween(t0, Clock::now());
+                    ++rendition.frames;
+                }
+                if (!failed)
+                    encoder.finish();
+            } catch (...) {
+                fail();
+            }
+            rendition.wallSec = secondsBetween(tEncoder, Clock::now()); });
+    }
+
+    // Processing: up to `depth` ladders queued on the backend. Each
+    // finished output is copied into its rendition's buffers and handed
+    // back at once, so the device slot does not wait for the slowest
+    // encoder.
+    {
+        struct InFlightLadder
+        {
+            PreprocessBackend::FrameTicket ticket = 0;
+            PooledFrame input;
+        };
+        std::vector<InFlightLadder> inFlight(depth); // ring, oldest first
+        std::vector<YuvFrame> outputs(count);
+        size_t oldest = 0, inFlightCount = 0;
+        size_t submitted = 0, retired = 0; // ladders, for the trace
+
+        auto retireOldest = [&]
+        {
+            InFlightLadder &entry = inFlight[oldest];
+            auto t0 = Clock::now();
+            {
+                TraceScope trace("complete", static_cast<int64_t>(retired));
+                processor.waitRenditions(entry.ticket, count, outputs);
+            }
+            stats.procSec += secondsBetween(t0, Clock::now());
+            ++retired;
+            entry.input.release(); // back to the reader
+            oldest = (oldest + 1) % depth;
+            --inFlightCount;
+            for (size_t i = 0; i < count; ++i)
+            {
+                YuvFrame copy = links[i]->pool.copyIn(outputs[i].data(), outputs[i].size());
+                outputs[i].release();
+                links[i]->queue.push(std::move(copy));
+            }
+        };
+
+        try
+        {
+            PooledFrame frame;
+            while (!failed && frameQueue.pop(frame))
+            {
+                if (inFlightCount == depth)
+                    retireOldest();
+                InFlightLadder &entry = inFlight[(oldest + inFlightCount) % depth];
+                auto t0 = Clock::now();
+                {
+                    TraceScope trace("submit", static_cast<int64_t>(submitted++));
+                    entry.ticket = processor.submitRenditions(frame.mat(), sizes);
+                }
+                stats.procSec += secondsBetween(t0, Clock::now());
+                entry.input = std::move(frame);
+                ++inFlightCount;
+            }
+            while (inFlightCount > 0)
+                retireOldest();
+        }
+        catch (...)
+        {
+            // Redeem what is still queued on the backend so its slots are
+            // free for the next job; with the rendition pools closed the
+            // copies are skipped
+            fail();
+            try
+            {
+                while (inFlightCount > 0)
+                    retireOldest();
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+    for (const std::unique_ptr<RenditionLink> &link : links)
+        link->queue.close();
+
+    readerThread.join();
+    for (std::thread &encoderThread : encoderThreads)
+        encoderThread.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        stats.renditions[i].width = sizes[i].width;
+        stats.renditions[i].height = sizes[i].height;
+        stats.renditions[i].stallSec = links[i]->pool.waitSec();
+    }
+    stats.totalSec = secondsBetween(tStart, Clock::now());
+    return stats;
+}
@@ -0,0 +1,197 @@
+// In-process H.264 encoding and muxing with libavcodec/libavformat; only
+// built when CMake finds libav (HAVE_LIBAV).
+#include "encoder.hpp"
+
+#include <stdexcept>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+}
+
+namespace
+{
+std::string avError(int err)
+{
+    char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(err, buf, sizeof(buf));
+    return buf;
+}
+
+void check(int err, const char *what)
+{
+    if (err < 0)
+        throw std::runtime_error(std::string(what) + " failed: " + avError(err));
+}
+
+class LibavEncoder : public EncoderBackend
+{
+public:
+    LibavEncoder(const std::string &outputPath, int width, int height, double fps, const EncoderOptions &options)
+        : width_(width), height_(height)
+    {
+        try
+        {
+            open(outputPath, fps, options);
+        }
+        catch (...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    ~LibavEncoder() override { release(); }
+
+    const char *name() const override { return "libav"; }
+
+    void encodeFrame(const uint8_t *data, size_t size, EncodedFrameInfo &info) override
+    {
+        const int chromaW = width_ / 2, chromaH = height_ / 2;
+        const size_t ySize = static_cast<size_t>(width_) * height_;
+        const size_t uvSize = static_cast<size_t>(chromaW) * chromaH;
+        if (size < ySize + 2 * uvSize)
+            throw std::runtime_error("Frame too small for encoder geometry");
+
+        // Reuse the one frame buffer unless the codec still holds a
+        // reference to it; this copy replaces the pipe write.
+        check(av_frame_make_writable(frame_), "av_frame_make_writable");
+        av_image_copy_plane(frame_->data[0], frame_->linesize[0], data, width_, width_, height_);
+        av_image_copy_plane(frame_->data[1], frame_->linesize[1], data + ySize, chromaW, chromaW, chromaH);
+        av_image_copy_plane(frame_->data[2], frame_->linesize[2], data + ySize + uvSize, chromaW, chromaW, chromaH);
+        frame_->pts = nextPts_++;
+        send(frame_, info);
+    }
+
+    void finish(EncodedFrameInfo &info) override
+    {
+        if (!format_ || finished_)
+            return;
+        finished_ = true;
+        send(nullptr, info); // drain delayed frames
+        check(av_write_trailer(format_), "av_write_trailer");
+        release();
+    }
+
+private:
+    int width_;
+    int height_;
+    int64_t nextPts_ = 0;
+    bool finished_ = false;
+    AVFormatContext *format_ = nullptr;
+    AVCodecContext *codec_ = nullptr;
+    AVStream *stream_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    AVPacket *packet_ = nullptr;
+
+    void open(const std::string &outputPath, double fps, const EncoderOptions &options)
+    {
+        const char *container = options.container.empty() ? nullptr : options.container.c_str();
+        check(avformat_alloc_output_context2(&format_, nullptr, container, outputPath.c_str()),
+              "avformat_alloc_output_context2");
+
+        const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+        if (!codec)
+            codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+        if (!codec)
+            throw std::runtime_error("No H.264 encoder in libavcodec");
+
+        codec_ = avcodec_alloc_context3(codec);
+        if (!codec_)
+            throw std::runtime_error("avcodec_alloc_context3 failed");
+        AVRational rate = av_d2q(fps > 0.0 ? fps : 30.0, 100000);
+        codec_->width = width_;
+        codec_->height = height_;
+        codec_->pix_fmt = AV_PIX_FMT_YUV420P;
+        codec_->framerate = rate;
+        codec_->time_base = av_inv_q(rate);
+        codec_->thread_count = options.threads;
+        // Tag the stream so players decode with the matrix and range the
+        // frames were converted with
+        bool bt709 = options.color.matrix == ColorMatrix::BT709;
+        codec_->colorspace = bt709 ? AVCOL_SPC_BT709 : AVCOL_SPC_SMPTE170M;
+        codec_->color_primaries = bt709 ? AVCOL_PRI_BT709 : AVCOL_PRI_SMPTE170M;
+        codec_->color_trc = bt709 ? AVCOL_TRC_BT709 : AVCOL_TRC_SMPTE170M;
+        codec_->color_range = options.color.range == ColorRange::Full ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+        if (format_->oformat->flags & AVFMT_GLOBALHEADER)
+            codec_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        // Private options the encoder does not know (e.g. crf on a
+        // non-x264 encoder) are left in the dictionary and ignored
+        AVDictionary *codecOptions = nullptr;
+        av_dict_set(&codecOptions, "preset", options.preset.c_str(), 0);
+        av_dict_set(&codecOptions, "crf", std::to_string(options.crf).c_str(), 0);
+        int err = avcodec_open2(codec_, codec, &codecOptions);
+        av_dict_free(&codecOptions);
+        check(err, "avcodec_open2");
+
+        stream_ = avformat_new_stream(format_, nullptr);
+        if (!stream_)
+            throw std::runtime_error("avformat_new_stream failed");
+        check(avcodec_parameters_from_context(stream_->codecpar, codec_), "avcodec_parameters_from_context");
+        stream_->time_base = codec_->time_base;
+
+        if (!(format_->oformat->flags & AVFMT_NOFILE))
+            check(avio_open(&format_->pb, outputPath.c_str(), AVIO_FLAG_WRITE), "avio_open");
+        check(avformat_write_header(format_, nullptr), "avformat_write_header");
+
+        frame_ = av_frame_alloc();
+        packet_ = av_packet_alloc();
+        if (!frame_ || !packet_)
+            throw std::runtime_error("Out of memory");
+        frame_->format = codec_->pix_fmt;
+        frame_->width = width_;
+        frame_->height = height_;
+        frame_->colorspace = codec_->colorspace;
+        frame_->color_primaries = codec_->color_primaries;
+        frame_->color_trc = codec_->color_trc;
+        frame_->color_range = codec_->color_range;
+        check(av_frame_get_buffer(frame_, 0), "av_frame_get_buffer");
+    }
+
+    // Send a frame (nullptr flushes) and mux every packet that comes out
+    void send(const AVFrame *frame, EncodedFrameInfo &info)
+    {
+        check(avcodec_send_frame(codec_, frame), "avcodec_send_frame");
+        for (;;)
+        {
+            int err = avcodec_receive_packet(codec_, packet_);
+            if (err == AVERROR(EAGAIN) || err == AVERROR_EOF)
+                return;
+            check(err, "avcodec_receive_packet");
+
+            ++info.packets;
+            info.packetBytes += static_cast<size_t>(packet_->size);
+            // The muxer may have picked its own stream time base in
+            // avformat_write_header()
+            av_packet_rescale_ts(packet_, codec_->time_base, stream_->time_base);
+            packet_->stream_index = stream_->index;
+            check(av_interleaved_write_frame(format_, packet_), "av_interleaved_write_frame");
+        }
+    }
+
+    void release()
+    {
+        av_packet_free(&packet_);
+        av_frame_free(&frame_);
+        avcodec_free_context(&codec_);
+        if (format_)
+        {
+            if (!(format_->oformat->flags & AVFMT_NOFILE))
+                avio_closep(&format_->pb);
+            avformat_free_context(format_);
+            format_ = nullptr;
+        }
+        stream_ = nullptr;
+    }
+};
+} // namespace
+
+std::unique_ptr<EncoderBackend> createLibavEncoder(const std::string &outputPath, int width, int height,
+                                                   double fps, const EncoderOptions &options)
+{
+    return std::make_unique<LibavEncoder>(outputPath, width, height, fps, options);
+}
@@ -1,91 +1,790 @@
 // src/main.cpp
 #include "video_reader.hpp"
-#include "opencl_driver.hpp"
+#include "preprocess_backend.hpp"
 #include "encoder.hpp"
-#include "bounded_queue.hpp"
+#include "pipeline.hpp"
+#include "multi_device_driver.hpp"
+#include "segmented_transcode.hpp"
+#include "batch.hpp"
+#include "ladder.hpp"
+#include "cpu_backend.hpp"
+#include "resize_filter.hpp"
+#include "run_report.hpp"
+#include "trace.hpp"
+#include "job_server.hpp"
+#include "pipeline_tuning.hpp"
 
-#include <thread>
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
 #include <filesystem>
-#include <chrono>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
 
-int main(int argc, char **argv)
+static void printUsage(const char *prog)
+{
+    std::cerr << "Usage: " << prog
+              << " [options] <input.mp4> <output.mp4>\n"
+              << "       " << prog << " [options] --batch <manifest|dir|glob> <output-dir>\n"
+              << "       " << prog << " [options] --serve <socket>\n"
+              << "       " << prog << " [options] --submit <socket> <input.mp4> <output.mp4>\n"
+              << "Options:\n"
+              << "  --backend <auto|opencl|multi|cpu>  preprocessing backend (default: auto)\n"
+              << "  --queue <mutex|spsc>               stage queue implementation (default: mutex)\n"
+              << "  --workers <n>                      processing workers, one backend each (default: 1)\n"
+              << "  --width <px>, --height <px>        output size; one alone keeps the aspect ratio\n"
+              << "                                     (default: half the input size)\n"
+              << "  --keep-aspect                      with both sizes, fit inside them instead of stretching\n"
+              << "  --filter <name>                    auto|fast|bilinear|bicubic|lanczos|area (default: auto)\n"
+              << "  --color-matrix <bt601|bt709>       Y'CbCr matrix, tagged on the output (default: bt601)\n"
+              << "  --color-range <limited|full>       Y'CbCr range, tagged on the output (default: limited)\n"
+              << "  --decode <bgr|yuv>                 decoder output: BGR, or the source's planar YUV\n"
+              << "                                     (needs ffmpeg; keeps its colour space) (default: bgr)\n"
+              << "  --decode-threads <n>               decoder threads, 0 = decoder default (default: 0)\n"
+              << "  --read-ahead <n>                   frames decoded ahead on a separate thread,\n"
+              << "                                     0 = decode on the reader thread (default: 4)\n"
+              << "  --encoder <auto|libav|pipe>        in-process libav or ffmpeg pipe (default: auto)\n"
+              << "  --crf <0-51>                       x264 quality (default: 23)\n"
+              << "  --preset <name>                    x264 preset, ultrafast..placebo (default: ultrafast)\n"
+              << "  --encoder-threads <n>              encoder threads, 0 = codec default (default: 0)\n"
+              << "  --segments <n>                     split at keyframes and transcode n segments\n"
+              << "                                     in parallel, then join them (default: 1)\n"
+              << "  --batch <spec>                     transcode every file of a manifest, directory\n"
+              << "                                     or quoted glob into <output-dir>\n"
+              << "  --jobs <n>                         files transcoded at once in batch mode\n"
+              << "                                     (default: from cores and GPUs)\n"
+              << "  --ladder <h1,h2,...>               decode once and encode one rendition per output\n"
+              << "                                     height, written as <output stem>_<h>p<ext>\n"
+              << "  --ladder-buffer <n>                frames a rendition buffers before a slow encoder\n"
+              << "                                     holds up the others (default: 8)\n"
+              << "  --serve <socket>                   run as a daemon: keep --jobs backends initialized and\n"
+              << "                                     transcode jobs sent to the Unix socket, highest\n"
+              << "                                     priority first, until SIGINT/SIGTERM\n"
+              << "  --submit <socket>                  send the job to a daemon and wait for it; --width,\n"
+              << "                                     --height, --crf and --preset apply to the job\n"
+              << "  --priority <n>                     job priority for --submit, higher first (default: 0)\n"
+              << "  --autotune                         pick queue depth and --workers from a short\n"
+              << "                                     calibration run, saved per host and reused\n"
+              << "                                     (single-file runs only)\n"
+              << "  --tune-memory <MiB>                frame buffer budget for --autotune (default: 1024)\n"
+              << "  --report <file.json>               also write the run summary and per-stage latency\n"
+              << "                                     percentiles as JSON (single-file runs only)\n"
+              << "  --trace <file.json>                record a timeline of the reader, worker and encoder\n"
+              << "                                     threads as Chrome trace events (ui.perfetto.dev;\n"
+              << "                                     not with --serve)\n";
+}
+
+// Decoding, output geometry and resampling requested on the command line
+struct OutputOptions
+{
+    int width = 0;
+    int height = 0;
+    bool keepAspect = false;
+    ResizeFilter filter = ResizeFilter::Auto;
+    VideoReader::Options reader;
+};
+
+static size_t hardwareCores() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// Cores left to each of parts encoders or backends running side by side
+static size_t coreShare(size_t parts) { return std::max<size_t>(1, hardwareCores() / parts); }
+
+// A backend set up for the output's filter and color space; cpuThreads as
+// for createBackend()
+static std::unique_ptr<PreprocessBackend> makeBackend(const std::string &name, size_t cpuThreads,
+                                                      const OutputOptions &output, ColorSpace color)
 {
-    if (argc < 3)
+    std::unique_ptr<PreprocessBackend> backend = createBackend(name, cpuThreads);
+    backend->setResizeFilter(output.filter);
+    backend->setColorSpace(color);
+    return backend;
+}
+
+static void printReaderStats(const VideoReader &reader)
+{
+    VideoReader::Stats stats = reader.stats();
+    std::cout << "--- Decoder ---\n";
+    std::cout << " Decode / convert      : " << stats.decodeSec << " / " << stats.convertSec << " sec";
+    if (stats.frames > 0)
+        std::cout << " (avg " << 1000.0 * (stats.decodeSec + stats.convertSec) / stats.frames << " ms/frame)";
+    std::cout << "\n";
+    std::cout << " Stalled on decode     : " << stats.stallSec << " sec\n";
+    std::cout << " Read-ahead full       : " << stats.fullSec << " sec\n\n";
+}
+
+// Write the --trace file, if any, once the run is over
+static int finishTrace(const std::string &tracePath, int status)
+{
+    if (tracePath.empty())
+        return status;
+    writeTrace(tracePath);
+    std::cout << "\nTrace written to " << tracePath << "\n";
+    return status;
+}
+
+static void printLatencies(const StageLatencies &stages)
+{
+    std::cout << "--- Latency per frame (ms) ---\n";
+    std::cout << " " << std::left << std::setw(12) << "Stage" << std::right << std::setw(9) << "p50" << std::setw(9)
+              << "p90" << std::setw(9) << "p99" << std::setw(9) << "max" << "\n";
+    for (const auto &stage : stages)
+    {
+        const LatencyHistogram &latency = stage.second;
+        if (latency.count() == 0)
+            continue;
+        std::cout << " " << std::left << std::setw(12) << stage.first << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(9) << 1000.0 * latency.percentile(50) << std::setw(9)
+                  << 1000.0 * latency.percentile(90) << std::setw(9) << 1000.0 * latency.percentile(99)
+                  << std::setw(9) << 1000.0 * latency.max() << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+    std::cout << "\n";
+}
+
+// --segments: one full pipeline per segment, all running at once
+static int runSegmentedMain(const std::string &inPath, const std::string &outPath,
+                            const std::string &backendName, size_t workerCount, size_t segmentCount,
+                            QueueKind queueKind, EncoderOptions encoderOptions, const OutputOptions &output)
+{
+    int outW, outH;
+    {
+        VideoReader reader(inPath);
+        computeOutputSize(reader.getWidth(), reader.getHeight(), output.width, output.height, output.keepAspect,
+                          outW, outH);
+    }
+
+    // Segments share the cores, so each encoder and CPU backend gets its part
+    if (encoderOptions.threads == 0)
+        encoderOptions.threads = static_cast<int>(coreShare(segmentCount));
+    const size_t cpuThreads = coreShare(segmentCount * workerCount);
+
+    SegmentedOptions options;
+    options.segments = segmentCount;
+    options.pipeline.outWidth = outW;
+    options.pipeline.outHeight = outH;
+    options.pipeline.queueKind = queueKind;
+    options.encoder = encoderOptions;
+    options.reader = output.reader;
+    std::string processorName;
+    options.makeBackends = [&]
+    {
+        std::vector<std::unique_ptr<PreprocessBackend>> backends;
+        for (size_t i = 0; i < workerCount; ++i)
+            backends.push_back(makeBackend(backendName, cpuThreads, output, encoderOptions.color));
+        processorName = backends.front()->name();
+        return backends;
+    };
+    SegmentedStats stats = runSegmented(inPath, outPath, options);
+
+    uintmax_t inBytes = std::filesystem::file_size(inPath);
+    uintmax_t outBytes = std::filesystem::file_size(outPath);
+
+    std::cout << "\n=== Summary ===\n";
+    std::cout << "Backend               : " << processorName;
+    if (workerCount > 1)
+        std::cout << " x " << workerCount;
+    std::cout << " per segment\n";
+    std::cout << "Frames processed      : " << stats.framesProcessed << "\n";
+    std::cout << "Total runtime (sec)   : " << stats.totalSec << "\n";
+    std::cout << "Overall FPS           : " << (stats.framesProcessed / stats.totalSec) << "\n\n";
+    std::cout << "--- Segments (" << stats.segments.size() << ") ---\n";
+    for (size_t i = 0; i < stats.segments.size(); ++i)
+    {
+        const SegmentedStats::SegmentStats &segment = stats.segments[i];
+        std::cout << " Segment " << i << " : frames " << segment.segment.startFrame << "+"
+                  << segment.pipeline.framesProcessed << ", " << segment.pipeline.totalSec << " sec ("
+                  << (segment.pipeline.totalSec > 0.0 ? segment.pipeline.framesProcessed / segment.pipeline.totalSec : 0.0)
+                  << " FPS)\n";
+    }
+    std::cout << " Keyframe probe        : " << stats.probeSec << " sec\n";
+    std::cout << " Segments (parallel)   : " << stats.segmentsWallSec << " sec\n";
+    std::cout << " Segments (sum)        : " << stats.segmentSecSum << " sec\n";
+    std::cout << " Concat                : " << stats.concatSec << " sec\n";
+    std::cout << " Speedup               : " << stats.speedup() << "x (sum / parallel)\n\n";
+    std::cout << "--- Compression ---\n";
+    std::cout << " Input size  : " << inBytes << " bytes\n";
+    std::cout << " Output size : " << outBytes << " bytes\n";
+    std::cout << " Ratio (out/in): " << static_cast<double>(outBytes) / inBytes << "\n";
+    return 0;
+}
+
+// --batch: one warm backend per job, reused for every file the job takes
+static int runBatchMain(const std::string &spec, const std::string &outputDir, const std::string &backendName,
+                        size_t jobCount, QueueKind queueKind, EncoderOptions encoderOptions,
+                        const OutputOptions &output)
+{
+    std::vector<BatchItem> items = loadBatch(spec, outputDir);
+    if (jobCount == 0)
+        jobCount = defaultBatchJobs(backendName, items.size());
+    jobCount = std::min(jobCount, items.size());
+
+    if (encoderOptions.threads == 0)
+        encoderOptions.threads = static_cast<int>(coreShare(jobCount));
+    std::vector<std::unique_ptr<PreprocessBackend>> backends;
+    std::vector<PreprocessBackend *> processors;
+    for (size_t i = 0; i < jobCount; ++i)
+    {
+        backends.push_back(makeBackend(backendName, coreShare(jobCount), output, encoderOptions.color));
+        processors.push_back(backends.back().get());
+    }
+    std::cout << "Batch: " << items.size() << " files, " << jobCount << " at a time on "
+              << processors.front()->name() << "\n";
+
+    BatchOptions options;
+    options.pipeline.queueKind = queueKind;
+    options.encoder = encoderOptions;
+    options.width = output.width;
+    options.height = output.height;
+    options.keepAspect = output.keepAspect;
+    options.reader = output.reader;
+    options.onFileDone = [](const BatchFileStats &file)
+    {
+        if (!file.ok)
+            std::cerr << "FAILED " << file.item.input << ": " << file.error << "\n";
+    };
+#ifdef SIGPIPE
+    // An ffmpeg child that dies must fail its file, not end the batch
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    BatchStats stats = runBatch(items, processors, options);
+
+    std::cout << "\n=== Batch summary ===\n";
+    for (const BatchFileStats &file : stats.files)
+    {
+        std::cout << " " << file.item.input << " -> " << file.item.output << " : ";
+        if (!file.ok)
+        {
+            std::cout << "FAILED (" << file.error << ")\n";
+            continue;
+        }
+        std::cout << file.frames << " frames, " << file.totalSec << " sec ("
+                  << (file.totalSec > 0.0 ? file.frames / file.totalSec : 0.0) << " FPS), "
+                  << file.inBytes << " -> " << file.outBytes << " bytes\n";
+    }
+    std::cout << "\nFiles                 : " << (stats.files.size() - stats.failed) << " ok, "
+              << stats.failed << " failed\n";
+    std::cout << "Total runtime (sec)   : " << stats.totalSec << "\n";
+    std::cout << "Files per hour        : " << stats.filesPerHour() << "\n";
+    std::cout << "Frames                : " << stats.frames << " (" << stats.fps() << " FPS)\n";
+    std::cout << "Bytes in / out        : " << stats.inBytes << " / " << stats.outBytes;
+    if (stats.inBytes > 0)
+        std::cout << " (ratio " << static_cast<double>(stats.outBytes) / stats.inBytes << ")";
+    std::cout << "\n";
+    return stats.failed == 0 ? 0 : 1;
+}
+
+// --ladder: one decode and upload per frame, one encoder per output height
+static int runLadderMain(const std::string &inPath, const std::string &outPath, const std::string &backendName,
+                         const std::vector<int> &heights, size_t renditionBuffer, EncoderOptions encoderOptions,
+                         const OutputOptions &output)
+{
+    VideoReader reader(inPath, output.reader);
+    int inW = reader.getWidth();
+    int inH = reader.getHeight();
+
+    // The renditions' encoders share the cores
+    if (encoderOptions.threads == 0)
+        encoderOptions.threads = static_cast<int>(coreShare(heights.size()));
+
+    std::unique_ptr<PreprocessBackend> processor = createBackend(backendName);
+    // Backends without a native ladder need a slot per rendition
+    if (processor->renditionSlotCount(heights.size()) == 0 && dynamic_cast<CpuBackend *>(processor.get()))
+        processor = std::make_unique<CpuBackend>(0, CpuIsa::Auto, 2 * heights.size());
+    processor->setResizeFilter(output.filter);
+    processor->setColorSpace(encoderOptions.color);
+
+    std::vector<std::unique_ptr<Encoder>> encoders;
+    std::vector<LadderRendition> renditions;
+    std::vector<std::string> paths;
+    for (int height : heights)
+    {
+        LadderRendition rendition;
+        computeOutputSize(inW, inH, 0, height, false, rendition.width, rendition.height);
+        paths.push_back(renditionPath(outPath, height));
+        encoders.push_back(std::make_unique<Encoder>(paths.back(), rendition.width, rendition.height,
+                                                     reader.getFPS(), encoderOptions));
+        rendition.encoder = encoders.back().get();
+        renditions.push_back(rendition);
+    }
+
+    LadderOptions options;
+    options.renditionBuffer = renditionBuffer;
+    LadderStats stats = runLadder(reader, *processor, renditions, options);
+    encoders.clear(); // the pipe encoders' ffmpeg processes exit here
+
+    uintmax_t inBytes = std::filesystem::file_size(inPath);
+    std::cout << "\n=== Summary ===\n";
+    std::cout << "Backend               : " << processor->name() << "\n";
+    std::cout << "Color                 : " << colorMatrixName(encoderOptions.color.matrix) << ", "
+              << colorRangeName(encoderOptions.color.range) << " range\n";
+    std::cout << "Frames read           : " << stats.framesRead << "\n";
+    std::cout << "Total runtime (sec)   : " << stats.totalSec << "\n";
+    std::cout << "Overall FPS           : " << (stats.framesRead / stats.totalSec) << " (decode + "
+              << renditions.size() << " renditions)\n";
+    std::cout << "Preprocessing (sec)   : " << stats.procSec << "\n\n";
+    std::cout << "--- Renditions ---\n";
+    for (size_t i = 0; i < stats.renditions.size(); ++i)
+    {
+        const RenditionStats &rendition = stats.renditions[i];
+        uintmax_t outBytes = std::filesystem::file_size(paths[i]);
+        std::cout << " " << rendition.width << "x" << rendition.height << " -> " << paths[i] << " : "
+                  << rendition.frames << " frames, " << rendition.fps() << " FPS, " << outBytes << " bytes (ratio "
+                  << static_cast<double>(outBytes) / inBytes << "), stalled ladder " << rendition.stallSec
+                  << " sec\n";
+    }
+    std::cout << "\n";
+    printReaderStats(reader);
+    std::cout << " Input size  : " << inBytes << " bytes\n";
+    return 0;
+}
+
+// --autotune: the saved configuration for this kind of job if it fits the
+// memory budget, else a calibration run on the start of the input, saved
+// for the next run
+static PipelineTuning autotunePipeline(const std::string &inPath, const std::string &backendName, int inW, int inH,
+                                       int outW, int outH, QueueKind queueKind, const EncoderOptions &encoderOptions,
+                                       const OutputOptions &output, size_t memoryCapMiB)
+{
+    PipelineTuning tuning;
+    const std::string profilePath = tuningProfilePath();
+    const std::string key = tuningKey(backendName, inW, inH, outW, outH, output.reader.format);
+    if (loadTuning(profilePath, key, tuning))
+    {
+        if (tuning.memoryBytes <= (memoryCapMiB << 20))
+        {
+            std::cout << "Autotune: queue " << tuning.queueCapacity << ", workers " << tuning.workers
+                      << " (saved in " << profilePath << ")\n";
+            return tuning;
+        }
+        std::cout << "Autotune: the saved configuration needs " << (tuning.memoryBytes >> 20) << " MiB, over the "
+                  << memoryCapMiB << " MiB budget\n";
+    }
+
+    TuningOptions options;
+    options.workerCounts.erase(std::remove_if(options.workerCounts.begin(), options.workerCounts.end(),
+                                              [](size_t workers) { return workers > 1 && workers > hardwareCores(); }),
+                               options.workerCounts.end());
+    options.memoryCap = memoryCapMiB << 20;
+    options.reader = output.reader;
+    options.encoder = encoderOptions;
+    options.queueKind = queueKind;
+    options.onMeasured = [](const PipelineTuning &measured)
     {
-        std::cerr << "Usage: " << argv[0]
-                  << " <input.mp4> <output.mp4>\n";
+        std::cout << " queue " << measured.queueCapacity << ", workers " << measured.workers << ": ";
+        if (measured.fps > 0.0)
+            std::cout << measured.fps << " FPS\n";
+        else
+            std::cout << "over the memory budget\n";
+    };
+    std::cout << "Autotune: calibrating on the first " << options.calibrationSec << " sec of " << inPath << "\n";
+    tuning = calibratePipeline(inPath, outW, outH, [&](size_t workers)
+                               {
+        return makeBackend(backendName, workers > 1 ? coreShare(workers) : 0, output, encoderOptions.color); }, options);
+    saveTuning(profilePath, key, tuning);
+    std::cout << "Autotune: queue " << tuning.queueCapacity << ", workers " << tuning.workers << " (" << tuning.fps
+              << " FPS";
+    if (!profilePath.empty())
+        std::cout << ", saved in " << profilePath;
+    std::cout << ")\n\n";
+    return tuning;
+}
+
+// --serve: the server to stop on SIGINT/SIGTERM
+static JobServer *activeServer = nullptr;
+
+static void stopServer(int)
+{
+    if (activeServer)
+        activeServer->stop();
+}
+
+// --serve: warm backends shared by every submitted job
+static int runServerMain(const std::string &socketPath, const std::string &backendName, size_t jobCount,
+                         QueueKind queueKind, EncoderOptions encoderOptions, const OutputOptions &output)
+{
+    if (jobCount == 0)
+        jobCount = defaultBatchJobs(backendName, SIZE_MAX);
+    if (encoderOptions.threads == 0)
+        encoderOptions.threads = static_cast<int>(coreShare(jobCount));
+    std::vector<std::unique_ptr<PreprocessBackend>> backends;
+    std::vector<PreprocessBackend *> processors;
+    for (size_t i = 0; i < jobCount; ++i)
+    {
+        backends.push_back(makeBackend(backendName, coreShare(jobCount), output, encoderOptions.color));
+        processors.push_back(backends.back().get());
+    }
+
+    JobServerOptions options;
+    options.defaults.pipeline.queueKind = queueKind;
+    options.defaults.encoder = encoderOptions;
+    options.defaults.width = output.width;
+    options.defaults.height = output.height;
+    options.defaults.keepAspect = output.keepAspect;
+    options.defaults.reader = output.reader;
+    options.onUpdate = [](const JobRequest &job, const JobUpdate &update)
+    {
+        if (update.kind == JobUpdate::Kind::Queued)
+            std::cout << "Job " << update.id << " queued: " << job.input << " -> " << job.output << " (priority "
+                      << job.priority << ", " << update.position << " ahead)\n";
+        else if (update.kind == JobUpdate::Kind::Done)
+            std::cout << "Job " << update.id << " done: " << update.frames << " frames, " << update.seconds
+                      << " sec\n";
+        else if (update.kind == JobUpdate::Kind::Failed)
+            std::cerr << "Job " << update.id << " FAILED: " << update.error << "\n";
+    };
+    JobServer server(socketPath, processors, options);
+    std::cout << "Serving on " << socketPath << ": " << jobCount << " jobs at a time on " << processors.front()->name()
+              << "\n";
+
+    activeServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+#ifdef SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN); // clients that hang up must not kill the server
+#endif
+    server.run();
+    activeServer = nullptr;
+    std::cout << "Server stopped\n";
+    return 0;
+}
+
+// --submit: one job through a running --serve daemon
+static int runSubmitMain(const std::string &socketPath, JobRequest job)
+{
+    job.input = std::filesystem::absolute(job.input).string();
+    job.output = std::filesystem::absolute(job.output).string();
+    JobUpdate result = submitJob(socketPath, job, [](const JobUpdate &update)
+                                 {
+        if (update.kind == JobUpdate::Kind::Queued)
+            std::cout << "Queued as job " << update.id << " (" << update.position << " ahead)\n";
+        else if (update.kind == JobUpdate::Kind::Started)
+            std::cout << "Started\n";
+        else if (update.kind == JobUpdate::Kind::Progress)
+            std::cout << "\r Frames encoded: " << update.frames << std::flush; });
+    if (result.kind == JobUpdate::Kind::Failed)
+    {
+        std::cerr << "\nJob " << result.id << " FAILED: " << result.error << "\n";
+        return 1;
+    }
+    std::cout << "\r Frames encoded: " << result.frames << "\n";
+    std::cout << "Total runtime (sec)   : " << result.seconds << "\n";
+    std::cout << "Overall FPS           : " << (result.seconds > 0.0 ? result.frames / result.seconds : 0.0) << "\n";
+    std::cout << "Bytes in / out        : " << result.inBytes << " / " << result.outBytes;
+    if (result.inBytes > 0)
+        std::cout << " (ratio " << static_cast<double>(result.outBytes) / result.inBytes << ")";
+    std::cout << "\n";
+    return 0;
+}
+
+static int runMain(int argc, char **argv)
+{
+    std::string backendName = "auto";
+    QueueKind queueKind = QueueKind::Mutex;
+    size_t workerCount = 1;
+    size_t segmentCount = 1;
+    size_t jobCount = 0;
+    std::string batchSpec;
+    std::vector<int> ladderHeights;
+    size_t ladderBuffer = 8;
+    std::string reportPath;
+    std::string tracePath;
+    bool autotune = false;
+    size_t tuneMemoryMiB = 1024;
+    std::string serveSocket;
+    std::string submitSocket;
+    JobRequest job; // --submit; crf and preset only if given
+    OutputOptions output;
+    output.reader.readAhead = 4;
+    EncoderOptions encoderOptions;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--backend" && i + 1 < argc)
+            backendName = argv[++i];
+        else if (arg == "--queue" && i + 1 < argc)
+        {
+            std::string kind = argv[++i];
+            if (kind == "mutex")
+                queueKind = QueueKind::Mutex;
+            else if (kind == "spsc")
+                queueKind = QueueKind::Spsc;
+            else
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (arg == "--workers" && i + 1 < argc)
+        {
+            int n = std::atoi(argv[++i]);
+            if (n < 1)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+            workerCount = static_cast<size_t>(n);
+        }
+        else if (arg == "--segments" && i + 1 < argc)
+        {
+            int n = std::atoi(argv[++i]);
+            if (n < 1)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+            segmentCount = static_cast<size_t>(n);
+        }
+        else if (arg == "--width" && i + 1 < argc)
+            output.width = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--height" && i + 1 < argc)
+            output.height = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--keep-aspect")
+            output.keepAspect = true;
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            try
+            {
+                output.filter = parseResizeFilter(argv[++i]);
+            }
+            catch (const std::invalid_argument &)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if ((arg == "--color-matrix" || arg == "--color-range") && i + 1 < argc)
+        {
+            try
+            {
+                if (arg == "--color-matrix")
+                    encoderOptions.color.matrix = parseColorMatrix(argv[++i]);
+                else
+                    encoderOptions.color.range = parseColorRange(argv[++i]);
+            }
+            catch (const std::invalid_argument &)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (arg == "--decode" && i + 1 < argc)
+        {
+            std::string kind = argv[++i];
+            if (kind == "bgr")
+                output.reader.format = VideoReader::PixelFormat::BGR;
+            else if (kind == "yuv")
+                output.reader.format = VideoReader::PixelFormat::I420;
+            else
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (arg == "--decode-threads" && i + 1 < argc)
+            output.reader.decodeThreads = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--read-ahead" && i + 1 < argc)
+            output.reader.readAhead = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        else if (arg == "--batch" && i + 1 < argc)
+            batchSpec = argv[++i];
+        else if (arg == "--jobs" && i + 1 < argc)
+        {
+            int n = std::atoi(argv[++i]);
+            if (n < 1)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+            jobCount = static_cast<size_t>(n);
+        }
+        else if (arg == "--ladder" && i + 1 < argc)
+        {
+            try
+            {
+                ladderHeights = parseLadder(argv[++i]);
+            }
+            catch (const std::invalid_argument &)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (arg == "--ladder-buffer" && i + 1 < argc)
+        {
+            int n = std::atoi(argv[++i]);
+            if (n < 1)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+            ladderBuffer = static_cast<size_t>(n);
+        }
+        else if (arg == "--report" && i + 1 < argc)
+            reportPath = argv[++i];
+        else if (arg == "--serve" && i + 1 < argc)
+            serveSocket = argv[++i];
+        else if (arg == "--submit" && i + 1 < argc)
+            submitSocket = argv[++i];
+        else if (arg == "--priority" && i + 1 < argc)
+            job.priority = std::atoi(argv[++i]);
+        else if (arg == "--autotune")
+            autotune = true;
+        else if (arg == "--tune-memory" && i + 1 < argc)
+        {
+            int n = std::atoi(argv[++i]);
+            if (n < 1)
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+            tuneMemoryMiB = static_cast<size_t>(n);
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (arg == "--encoder" && i + 1 < argc)
+        {
+            std::string kind = argv[++i];
+            if (kind == "auto")
+                encoderOptions.backend = EncoderOptions::Backend::Auto;
+            else if (kind == "libav")
+                encoderOptions.backend = EncoderOptions::Backend::Libav;
+            else if (kind == "pipe")
+                encoderOptions.backend = EncoderOptions::Backend::Pipe;
+            else
+            {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (arg == "--crf" && i + 1 < argc)
+        {
+            encoderOptions.crf = std::atoi(argv[++i]);
+            job.crf = encoderOptions.crf;
+        }
+        else if (arg == "--preset" && i + 1 < argc)
+        {
+            encoderOptions.preset = argv[++i];
+            job.preset = encoderOptions.preset;
+        }
+        else if (arg == "--encoder-threads" && i + 1 < argc)
+            encoderOptions.threads = std::max(0, std::atoi(argv[++i]));
+        else if (arg.rfind("--", 0) == 0)
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+        else
+            positional.push_back(arg);
+    }
+    // The report and the tuning describe one pipeline run
+    const bool singleRun = serveSocket.empty() && submitSocket.empty() && batchSpec.empty() && ladderHeights.empty() &&
+                           segmentCount == 1;
+    if ((!reportPath.empty() || autotune) && !singleRun)
+    {
+        printUsage(argv[0]);
+        return -1;
+    }
+    // Every job thread of a daemon would keep its own trace buffer until exit
+    if (!tracePath.empty() && !serveSocket.empty())
+    {
+        printUsage(argv[0]);
+        return -1;
+    }
+    if (!tracePath.empty())
+        enableTracing();
+    setTraceThreadName("main");
+    if (!serveSocket.empty())
+    {
+        if (!positional.empty())
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+        return runServerMain(serveSocket, backendName, jobCount, queueKind, encoderOptions, output);
+    }
+    if (!submitSocket.empty())
+    {
+        if (positional.size() != 2)
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+        job.input = positional[0];
+        job.output = positional[1];
+        job.width = output.width;
+        job.height = output.height;
+        return runSubmitMain(submitSocket, job);
+    }
+    if (!batchSpec.empty())
+    {
+        if (positional.size() != 1)
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+        return finishTrace(tracePath, runBatchMain(batchSpec, positional[0], backendName, jobCount, queueKind,
+                                                   encoderOptions, output));
+    }
+    if (positional.size() != 2)
+    {
+        printUsage(argv[0]);
         return -1;
     }
 
-    const std::string inPath = argv[1];
-    const std::string outPath = argv[2];
+    const std::string inPath = positional[0];
+    const std::string outPath = positional[1];
+    if (!ladderHeights.empty())
+        return finishTrace(tracePath, runLadderMain(inPath, outPath, backendName, ladderHeights, ladderBuffer,
+                                                    encoderOptions, output));
+    if (segmentCount > 1)
+        return finishTrace(tracePath, runSegmentedMain(inPath, outPath, backendName, workerCount, segmentCount,
+                                                       queueKind, encoderOptions, output));
 
     // Init components
-    VideoReader reader(inPath);
-    OpenCLDriver processor;
+    VideoReader reader(inPath, output.reader);
     int inW = reader.getWidth();
     int inH = reader.getHeight();
     double fps = reader.getFPS();
-    int outW = (inW / 2) & ~1;
-    int outH = (inH / 2) & ~1;
-    Encoder encoder(outPath, outW, outH, fps);
-
-    // Queues for each stage
-    const size_t QUEUE_CAPACITY = 4;
-    BoundedQueue<cv::Mat> frameQueue(QUEUE_CAPACITY);
-    BoundedQueue<std::vector<uint8_t>> yuvQueue(QUEUE_CAPACITY);
-
-    // Metrics
-    size_t framesProcessed = 0;
-    double totalProcSec = 0.0;
-    double totalEncSec = 0.0;
-    auto tStart = std::chrono::high_resolution_clock::now();
-
-    // Reader thread
-    std::thread readerThread([&]
-                             {
-        cv::Mat frame;
-        while (reader.getNextFrame(frame)) {
-            if (!frameQueue.push(frame)) break;
-        }
-        frameQueue.close(); });
-
-    // Processor thread
-    std::thread procThread([&]
-                           {
-        cv::Mat frame;
-        std::vector<uint8_t> yuv;
-        while (frameQueue.pop(frame)) {
-            auto t0 = std::chrono::high_resolution_clock::now();
-            processor.processFrame(frame, yuv, outW, outH);
-            auto t1 = std::chrono::high_resolution_clock::now();
-            totalProcSec += std::chrono::duration<double>(t1 - t0).count();
-
-            if (!yuvQueue.push(yuv)) break;
-        }
-        yuvQueue.close(); });
-
-    // Encoder thread
-    std::thread encoderThread([&]
-                              {
-        std::vector<uint8_t> yuv;
-        while (yuvQueue.pop(yuv)) {
-            auto t2 = std::chrono::high_resolution_clock::now();
-            encoder.encodeFrame(yuv);
-            auto t3 = std::chrono::high_resolution_clock::now();
-            totalEncSec += std::chrono::duration<double>(t3 - t2).count();
-            ++framesProcessed;
-        }
-        encoder.finish(); });
-
-    // Wait for completion
-    readerThread.join();
-    procThread.join();
-    encoderThread.join();
-
-    auto tEnd = std::chrono::high_resolution_clock::now();
-    double totalSec = std::chrono::duration<double>(tEnd - tStart).count();
+    int outW, outH;
+    computeOutputSize(inW, inH, output.width, output.height, output.keepAspect, outW, outH);
+    size_t queueCapacity = 4;
+    if (autotune)
+    {
+        PipelineTuning tuning = autotunePipeline(inPath, backendName, inW, inH, outW, outH, queueKind, encoderOptions,
+                                                 output, tuneMemoryMiB);
+        queueCapacity = tuning.queueCapacity;
+        workerCount = tuning.workers;
+    }
+    // Each worker gets its own backend; CPU backends split the cores
+    size_t cpuThreads = 0;
+    if (workerCount > 1)
+        cpuThreads = coreShare(workerCount);
+    std::vector<std::unique_ptr<PreprocessBackend>> backends;
+    std::vector<PreprocessBackend *> processors;
+    for (size_t i = 0; i < workerCount; ++i)
+    {
+        backends.push_back(makeBackend(backendName, cpuThreads, output, encoderOptions.color));
+        processors.push_back(backends.back().get());
+    }
+    PreprocessBackend *processor = processors.front();
+    Encoder encoder(outPath, outW, outH, fps, encoderOptions);
+
+    PipelineOptions options;
+    options.outWidth = outW;
+    options.outHeight = outH;
+    options.queueCapacity = queueCapacity;
+    options.queueKind = queueKind;
+    PipelineStats stats = runPipeline(reader, processors, encoder, options);
+
+    size_t framesProcessed = stats.framesProcessed;
+    double totalSec = stats.totalSec;
+    double totalProcSec = stats.procSec;
+    double totalEncSec = stats.encSec;
 
     // File‐size metrics
     uintmax_t inBytes = std::filesystem::file_size(inPath);
@@ -94,20 +793,102 @@ int main(int argc, char **argv)
 
     // Print summary
     std::cout << "\n=== Summary ===\n";
+    std::cout << "Backend               : " << processor->name();
+    if (workerCount > 1)
+        std::cout << " x " << workerCount;
+    std::cout << "\n";
+    std::cout << "Resize                : " << inW << "x" << inH << " -> " << outW << "x" << outH << " ("
+              << resizeFilterName(resolveResizeFilter(output.filter, inW, inH, outW, outH)) << ")\n";
+    std::cout << "Color                 : " << colorMatrixName(encoderOptions.color.matrix) << ", "
+              << colorRangeName(encoderOptions.color.range) << " range\n";
     std::cout << "Frames processed      : " << framesProcessed << "\n";
     std::cout << "Total runtime (sec)   : " << totalSec << "\n";
     std::cout << "Overall FPS           : " << (framesProcessed / totalSec) << "\n\n";
     std::cout << "--- Stage timings ---\n";
-    std::cout << " Preprocessing (GPU)   : " << totalProcSec
+    std::cout << " Preprocessing         : " << totalProcSec
               << " sec (avg " << (totalProcSec / framesProcessed)
               << " sec/frame)\n";
     std::cout << " Encoding (CPU)        : " << totalEncSec
               << " sec (avg " << (totalEncSec / framesProcessed)
               << " sec/frame)\n\n";
+    printReaderStats(reader);
+    const EncoderStats &encStats = encoder.stats();
+    std::cout << "--- Encoder (" << encoder.backendName() << ") ---\n";
+    std::cout << " Preset / CRF          : " << encoderOptions.preset << " / " << encoderOptions.crf << "\n";
+    std::cout << " Frame encode (ms)     : avg " << (encStats.frames ? 1000.0 * encStats.encodeSec / encStats.frames : 0.0)
+              << ", max " << 1000.0 * encStats.maxFrameSec << "\n";
+    if (encStats.packets > 0)
+        std::cout << " Packets               : " << encStats.packets << " (avg "
+                  << encStats.bytes / encStats.packets << " bytes)\n";
+    std::cout << "\n";
+    if (stats.workers.size() > 1)
+    {
+        std::cout << "--- Workers ---\n";
+        for (size_t i = 0; i < stats.workers.size(); ++i)
+        {
+            const PipelineStats::WorkerStats &worker = stats.workers[i];
+            std::cout << " Worker " << i << " : " << worker.frames << " frames, "
+                      << (worker.wallSec > 0.0 ? worker.frames / worker.wallSec : 0.0) << " FPS ("
+                      << worker.busySec << " sec in backend)\n";
+        }
+        std::cout << "\n";
+    }
+    if (auto *multi = dynamic_cast<MultiDeviceDriver *>(processor))
+    {
+        std::cout << "--- Devices ---\n";
+        for (const MultiDeviceDriver::DeviceStats &device : multi->deviceStats())
+            std::cout << " " << device.name << " : " << device.frames
+                      << " frames (avg " << device.avgFrameMs << " ms/frame)\n";
+        std::cout << "\n";
+    }
+    // Host stages around the backends' own (device) stages
+    StageLatencies stages = {{"decode", stats.decodeLatency}, {"preprocess", stats.procLatency}};
+    for (PreprocessBackend *backend : processors)
+        mergeStageLatencies(stages, backend->stageLatencies());
+    stages.emplace_back("encode", stats.encodeLatency);
+    printLatencies(stages);
     std::cout << "--- Compression ---\n";
     std::cout << " Input size  : " << inBytes << " bytes\n";
     std::cout << " Output size : " << outBytes << " bytes\n";
     std::cout << " Ratio (out/in): " << compressionRatio << "\n";
 
-    return 0;
+    if (!reportPath.empty())
+    {
+        RunReport report;
+        report.set("input", inPath);
+        report.set("output", outPath);
+        report.set("backend", processor->name());
+        report.set("workers", static_cast<double>(workerCount));
+        report.set("queue_capacity", static_cast<double>(queueCapacity));
+        report.set("encoder", encoder.backendName());
+        report.set("width", static_cast<double>(outW));
+        report.set("height", static_cast<double>(outH));
+        report.set("filter", resizeFilterName(resolveResizeFilter(output.filter, inW, inH, outW, outH)));
+        report.set("frames", static_cast<double>(framesProcessed));
+        report.set("total_sec", totalSec);
+        report.set("fps", framesProcessed / totalSec);
+        report.set("preprocess_sec", totalProcSec);
+        report.set("encode_sec", totalEncSec);
+        report.set("input_bytes", static_cast<double>(inBytes));
+        report.set("output_bytes", static_cast<double>(outBytes));
+        for (const auto &stage : stages)
+            report.addStage(stage.first, stage.second);
+        report.write(reportPath);
+        std::cout << "\nReport written to " << reportPath << "\n";
+    }
+    return finishTrace(tracePath, 0);
+}
+
+int main(int argc, char **argv)
+{
+    // Backend, decoder and encoder failures surface as exceptions
+    try
+    {
+        return runMain(argc, argv);
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
 }
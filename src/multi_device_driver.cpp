@@ -0,0 +1,227 @@
+#include "multi_device_driver.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+// Weight of the newest sample in the per-device frame time average
+const double FRAME_TIME_SMOOTHING = 0.1;
+} // namespace
+
+MultiDeviceDriver::MultiDeviceDriver(size_t inFlightPerDevice)
+{
+    start(OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL), inFlightPerDevice);
+}
+
+MultiDeviceDriver::MultiDeviceDriver(const std::vector<cl_device_id> &devices, size_t inFlightPerDevice)
+{
+    start(devices, inFlightPerDevice);
+}
+
+void MultiDeviceDriver::start(const std::vector<cl_device_id> &devices, size_t inFlightPerDevice)
+{
+    for (cl_device_id id : devices)
+    {
+        auto device = std::make_unique<Device>();
+        device->name = OpenCLDriver::deviceName(id);
+        try
+        {
+            device->driver = std::make_unique<OpenCLDriver>(id, inFlightPerDevice);
+        }
+        catch (const std::exception &ex)
+        {
+            std::cerr << "Skipping OpenCL device " << device->name << ": " << ex.what() << "\n";
+            continue;
+        }
+        slotCount_ += device->driver->slotCount();
+        devices_.push_back(std::move(device));
+    }
+    if (devices_.empty())
+        throw std::runtime_error("no usable OpenCL device found");
+
+    // At most slotCount_ frames are outstanding, so neither the job queues
+    // nor the reorder window ever block the submitting thread.
+    reorder_ = std::make_unique<ReorderBuffer<Result>>(slotCount_);
+    for (auto &device : devices_)
+    {
+        device->jobs = std::make_unique<BoundedQueue<Job>>(slotCount_);
+        device->worker = std::thread(&MultiDeviceDriver::workerLoop, this, std::ref(*device));
+    }
+}
+
+MultiDeviceDriver::~MultiDeviceDriver()
+{
+    for (auto &device : devices_)
+        device->jobs->close();
+    for (auto &device : devices_)
+        device->worker.join();
+}
+
+std::string MultiDeviceDriver::name() const
+{
+    return "opencl-multi(" + std::to_string(devices_.size()) + ")";
+}
+
+size_t MultiDeviceDriver::pickDevice() const
+{
+    // Until a device has been measured, spread frames by queue length only
+    size_t best = 0;
+    double bestCost = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < devices_.size(); ++i)
+    {
+        const Device &device = *devices_[i];
+        double frameSec = device.frameSec.load();
+        double cost = static_cast<double>(device.pending.load() + 1) * (frameSec > 0.0 ? frameSec : 1e-3);
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            best = i;
+        }
+    }
+    return best;
+}
+
+MultiDeviceDriver::FrameTicket MultiDeviceDriver::submitFrame(const cv::Mat &input, int targetWidth, int targetHeight)
+{
+    if (nextTicket_ - nextWait_ >= slotCount_)
+        throw std::runtime_error("MultiDeviceDriver: more than slotCount() frames outstanding");
+
+    Device &device = *devices_[pickDevice()];
+    FrameTicket ticket = nextTicket_++;
+    Job job;
+    job.ticket = ticket;
+    job.input = input;
+    job.targetWidth = targetWidth;
+    job.targetHeight = targetHeight;
+    device.pending++;
+    device.jobs->push(std::move(job));
+    return ticket;
+}
+
+YuvFrame MultiDeviceDriver::waitMappedFrame(FrameTicket ticket)
+{
+    if (ticket != nextWait_)
+        throw std::runtime_error("MultiDeviceDriver: frames must be waited on in submission order");
+    Result result;
+    if (!reorder_->pop(result))
+        throw std::runtime_error("MultiDeviceDriver: frame " + std::to_string(ticket) + " was lost");
+    ++nextWait_;
+    if (result.error)
+        std::rethrow_exception(result.error);
+    return std::move(result.frame);
+}
+
+void MultiDeviceDriver::workerLoop(Device &device)
+{
+    struct InFlight
+    {
+        FrameTicket ticket = 0;
+        FrameTicket deviceTicket = 0;
+        Clock::time_point submitted;
+    };
+    OpenCLDriver &driver = *device.driver;
+    const size_t slots = driver.slotCount();
+    std::vector<InFlight> inFlight(slots); // ring, oldest first
+    size_t oldestIndex = 0, inFlightCount = 0;
+    Clock::time_point lastDone = Clock::now();
+
+    for (;;)
+    {
+        // Keep the device fed, but never block in submitFrame() while frames
+        // are still in flight: the slot it waits for may belong to a frame
+        // held in the reorder buffer behind one of ours.
+        Job job;
+        bool haveJob = false;
+        if (inFlightCount == 0)
+            haveJob = device.jobs->pop(job);
+        else if (inFlightCount < slots && driver.nextSlotFree())
+            haveJob = device.jobs->try_pop(job);
+
+        if (haveJob)
+        {
+            try
+            {
+                FrameTicket deviceTicket = driver.submitFrame(job.input, job.targetWidth, job.targetHeight);
+                inFlight[(oldestIndex + inFlightCount) % slots] = {job.ticket, deviceTicket, Clock::now()};
+                ++inFlightCount;
+            }
+            catch (...)
+            {
+                device.pending--;
+                reorder_->put(job.ticket, Result{YuvFrame(), std::current_exception()});
+            }
+            continue;
+        }
+        if (inFlightCount == 0)
+            break; // closed and drained
+
+        InFlight oldest = inFlight[oldestIndex];
+        oldestIndex = (oldestIndex + 1) % slots;
+        --inFlightCount;
+        Result result;
+        try
+        {
+            result.frame = driver.waitMappedFrame(oldest.deviceTicket);
+        }
+        catch (...)
+        {
+            device.pending--;
+            reorder_->put(oldest.ticket, Result{YuvFrame(), std::current_exception()});
+            continue;
+        }
+
+        // Device time for this frame: from when it could start (submitted,
+        // or the previous frame finished) until it was done.
+        Clock::time_point done = Clock::now();
+        double sample = secondsBetween(std::max(oldest.submitted, lastDone), done);
+        lastDone = done;
+        double previous = device.frameSec.load();
+        device.frameSec.store(previous > 0.0 ? previous + FRAME_TIME_SMOOTHING * (sample - previous) : sample);
+        device.frames++;
+        device.pending--;
+
+        reorder_->put(oldest.ticket, std::move(result));
+    }
+}
+
+std::vector<MultiDeviceDriver::DeviceStats> MultiDeviceDriver::deviceStats() const
+{
+    std::vector<DeviceStats> stats;
+    for (const auto &device : devices_)
+    {
+        DeviceStats s;
+        s.name = device->name;
+        s.frames = device->frames.load();
+        s.avgFrameMs = device->frameSec.load() * 1000.0;
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+StageLatencies MultiDeviceDriver::stageLatencies() const
+{
+    StageLatencies merged;
+    for (const auto &device : devices_)
+        mergeStageLatencies(merged, device->driver->stageLatencies());
+    return merged;
+}
+
+void MultiDeviceDriver::setResizeFilter(ResizeFilter filter)
+{
+    PreprocessBackend::setResizeFilter(filter);
+    for (const std::unique_ptr<Device> &device : devices_)
+        device->driver->setResizeFilter(filter);
+}
+
+void MultiDeviceDriver::setColorSpace(ColorSpace space)
+{
+    PreprocessBackend::setColorSpace(space);
+    for (const std::unique_ptr<Device> &device : devices_)
+        device->driver->setColorSpace(space);
+}
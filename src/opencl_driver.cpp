@@ -1,222 +1,964 @@
 #include "opencl_driver.hpp"
-#include <fstream>
-#include <sstream>
+#include "program_cache.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
 #include <vector>
-#include <cstdlib>
+#include <stdexcept>
 
-OpenCLDriver::OpenCLDriver()
+namespace
 {
-    initOpenCL();
-    loadKernel("../kernels/opencl_preprocess.cl");
-    std::cout << "OpenCL driver loaded." << std::endl;
-    resizeKernel_ = clCreateKernel(program_, "resize_bilinear", nullptr);
-    convertKernel_ = clCreateKernel(program_, "bgr_to_yuv420", nullptr);
+// Work-group shape of resize_bgr_to_i420_tiled; must match
+// kernels/opencl_preprocess.cl
+const int TILED_GROUP_W = 16;
+const int TILED_GROUP_H = 8;
+const int TILED_BLOCKS_PER_ITEM = 4;
+
+// Timed launches per work-group candidate, after one untimed warm-up; the
+// fastest counts
+const int TUNING_RUNS = 3;
+
+// Offsets and weights of one polyphase direction as read-only device
+// buffers; returns their size in bytes
+size_t uploadResizeTable(cl_context context, const ResizeCoefficients &table, cl_mem buffers[2])
+{
+    cl_int err, err2;
+    buffers[0] = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, table.offsets.size() * sizeof(int32_t),
+                                const_cast<int32_t *>(table.offsets.data()), &err);
+    buffers[1] = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, table.weights.size() * sizeof(int16_t),
+                                const_cast<int16_t *>(table.weights.data()), &err2);
+    if (err != CL_SUCCESS || err2 != CL_SUCCESS)
+        throw std::runtime_error("Failed to upload resize coefficients: " + std::to_string(err != CL_SUCCESS ? err : err2));
+    return table.offsets.size() * sizeof(int32_t) + table.weights.size() * sizeof(int16_t);
 }
 
-OpenCLDriver::~OpenCLDriver()
+// Device execution time of a finished command in seconds, or -1 if the
+// queue has no profiling information for it
+double commandSeconds(cl_event event)
 {
-    clReleaseKernel(resizeKernel_);
-    clReleaseKernel(convertKernel_);
-    clReleaseProgram(program_);
-    clReleaseCommandQueue(queue_);
-    clReleaseContext(context_);
+    cl_ulong start = 0, end = 0;
+    if (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) != CL_SUCCESS ||
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) != CL_SUCCESS ||
+        end < start)
+        return -1.0;
+    return (end - start) * 1e-9;
 }
 
-void OpenCLDriver::initOpenCL()
+// Names a launch in the work-group cache: kernel, the build options of its
+// program (colour matrix, coefficient space) and the global size
+std::string launchKey(cl_kernel kernel, cl_device_id device, const size_t *global)
+{
+    char name[128] = {};
+    clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name) - 1, name, nullptr);
+    cl_program program = nullptr;
+    clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, nullptr);
+    std::string options;
+    size_t size = 0;
+    if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_OPTIONS, 0, nullptr, &size) == CL_SUCCESS && size > 0)
+    {
+        options.resize(size);
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_OPTIONS, size, &options[0], nullptr);
+        while (!options.empty() && options.back() == '\0')
+            options.pop_back();
+    }
+    return std::string(name) + " " + options + " " + std::to_string(global[0]) + "x" + std::to_string(global[1]);
+}
+
+size_t kernelGroupLimit(cl_kernel kernel, cl_device_id device)
 {
+    size_t limit = 0;
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(limit), &limit, nullptr);
+    return limit;
+}
+
+// Local sizes worth timing for kernel over global: the runtime's choice
+// ({0, 0}) first, then widths in multiples of the preferred multiple and
+// power-of-two heights, with 32 to 512 items per group as far as the
+// kernel's limit allows. Groups much larger than the grid are skipped.
+std::vector<std::array<size_t, 2>> localSizeCandidates(cl_kernel kernel, cl_device_id device, const size_t *global)
+{
+    size_t multiple = 1;
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(multiple),
+                             &multiple, nullptr);
+    const size_t limit = kernelGroupLimit(kernel, device);
+    size_t maxItems[3] = {limit, limit, limit};
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(maxItems), maxItems, nullptr);
+    multiple = std::max<size_t>(multiple, 1);
+    const size_t minItems = std::min<size_t>(32, limit);
+    const size_t maxGroup = std::min<size_t>(512, limit);
+
+    std::vector<std::array<size_t, 2>> candidates = {{0, 0}};
+    for (size_t x = multiple; x <= maxGroup && x <= maxItems[0]; x *= 2)
+    {
+        if (x > (global[0] + multiple - 1) / multiple * multiple)
+            break;
+        for (size_t y = 1; x * y <= maxGroup && y <= maxItems[1] && y <= 16 && y <= global[1]; y *= 2)
+        {
+            if (x * y >= minItems)
+                candidates.push_back({x, y});
+        }
+    }
+    return candidates;
+}
+
+// The first GPU, else the first device of any type, so GPU-less hosts
+// (a CPU runtime such as pocl) still get the mapped zero-copy path
+cl_device_id defaultDevice()
+{
+    std::vector<cl_device_id> devices = OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_GPU);
+    if (devices.empty())
+        devices = OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL);
+    if (devices.empty())
+        throw std::runtime_error("no OpenCL device found");
+    return devices.front();
+}
+} // namespace
+
+OpenCLDriver::OpenCLDriver(size_t inFlightFrames)
+    : OpenCLDriver(defaultDevice(), inFlightFrames)
+{
+}
+
+OpenCLDriver::OpenCLDriver(cl_device_id device, size_t inFlightFrames)
+    : device_(device), slots_(inFlightFrames > 0 ? inFlightFrames : 1)
+{
+    try
+    {
+        initOpenCL();
+        clGetDeviceInfo(device_, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(maxConstantBytes_), &maxConstantBytes_, nullptr);
+        cl_device_local_mem_type localMemType = CL_GLOBAL;
+        clGetDeviceInfo(device_, CL_DEVICE_LOCAL_MEM_TYPE, sizeof(localMemType), &localMemType, nullptr);
+        clGetDeviceInfo(device_, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(localMemBytes_), &localMemBytes_, nullptr);
+        dedicatedLocalMem_ = localMemType == CL_LOCAL;
+        buildKernels();
+    }
+    catch (...)
+    {
+        releaseOpenCL();
+        throw;
+    }
+    std::cout << "OpenCL driver loaded: " << deviceName(device_) << std::endl;
+}
+
+void OpenCLDriver::buildKernels()
+{
+    program_ = buildProgramCached(context_, device_, openclPreprocessSource(), colorBuildOptions(colorSpace_));
+
+    // Output kernels are created per slot output on first use; this one
+    // only reports how large a work-group the tiled variant can run
     cl_int err;
-    cl_platform_id platform;
-    err = clGetPlatformIDs(1, &platform, nullptr);
+    cl_kernel probe = clCreateKernel(program_, "resize_bgr_to_i420_tiled", &err);
     if (err != CL_SUCCESS)
+        throw std::runtime_error("clCreateKernel failed: " + std::to_string(err));
+    clGetKernelWorkGroupInfo(probe, device_, CL_KERNEL_WORK_GROUP_SIZE, sizeof(tiledGroupLimit_), &tiledGroupLimit_,
+                             nullptr);
+    clReleaseKernel(probe);
+}
+
+void OpenCLDriver::releaseKernels()
+{
+    for (FrameSlot &slot : slots_)
+        releaseBuffers(slot);
+    if (program_)
+        clReleaseProgram(program_);
+    if (globalCoeffProgram_)
+        clReleaseProgram(globalCoeffProgram_);
+    program_ = globalCoeffProgram_ = nullptr;
+}
+
+void OpenCLDriver::setColorSpace(ColorSpace space)
+{
+    if (space == colorSpace_)
+        return;
     {
-        std::cerr << "clGetPlatformIDs failed\n";
-        std::exit(1);
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        for (const FrameSlot &slot : slots_)
+            if (slot.state != SlotState::Free)
+                throw std::runtime_error("OpenCLDriver: color space changed with frames in flight");
     }
+    // The matrix and range are compiled in, so every kernel is rebuilt;
+    // slots rebind their arguments on the next frame
+    clFinish(queue_);
+    clFinish(downloadQueue_);
+    releaseKernels();
+    PreprocessBackend::setColorSpace(space);
+    buildKernels();
+}
 
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device_, nullptr);
-    if (err != CL_SUCCESS)
+std::vector<cl_device_id> OpenCLDriver::enumerateDevices(cl_device_type type)
+{
+    std::vector<cl_device_id> devices;
+    cl_uint numPlatforms = 0;
+    if (clGetPlatformIDs(0, nullptr, &numPlatforms) != CL_SUCCESS || numPlatforms == 0)
+        return devices;
+    std::vector<cl_platform_id> platforms(numPlatforms);
+    clGetPlatformIDs(numPlatforms, platforms.data(), nullptr);
+
+    for (cl_platform_id platform : platforms)
+    {
+        cl_uint numDevices = 0;
+        if (clGetDeviceIDs(platform, type, 0, nullptr, &numDevices) != CL_SUCCESS || numDevices == 0)
+            continue;
+        std::vector<cl_device_id> platformDevices(numDevices);
+        clGetDeviceIDs(platform, type, numDevices, platformDevices.data(), nullptr);
+        devices.insert(devices.end(), platformDevices.begin(), platformDevices.end());
+    }
+    return devices;
+}
+
+void OpenCLDriver::tiledSourceTile(int srcW, int srcH, int dstW, int dstH, int &tileW, int &tileH)
+{
+    // Same float ratios as the kernel. A group's output span of n pixels
+    // starts at floor(ratio * first) and reads up to floor(ratio * last) + 1;
+    // one more pixel covers float rounding of the two products.
+    const int groupOutW = TILED_GROUP_W * TILED_BLOCKS_PER_ITEM * 2;
+    const int groupOutH = TILED_GROUP_H * 2;
+    float xRatio = (float)(srcW - 1) / (dstW - 1);
+    float yRatio = (float)(srcH - 1) / (dstH - 1);
+    tileW = std::min(srcW, (int)std::ceil(xRatio * (groupOutW - 1)) + 3);
+    tileH = std::min(srcH, (int)std::ceil(yRatio * (groupOutH - 1)) + 3);
+}
+
+bool OpenCLDriver::usesTiledKernel(int srcW, int srcH, int dstW, int dstH) const
+{
+    if (fastKernel_ == FastKernel::Direct || (fastKernel_ == FastKernel::Auto && !dedicatedLocalMem_))
+        return false;
+    if (tiledGroupLimit_ < (size_t)(TILED_GROUP_W * TILED_GROUP_H))
+        return false;
+    // Large downscales need a tile bigger than local memory
+    int tileW, tileH;
+    tiledSourceTile(srcW, srcH, dstW, dstH, tileW, tileH);
+    return (cl_ulong)tileW * tileH * 3 <= localMemBytes_;
+}
+
+std::string OpenCLDriver::deviceName(cl_device_id device)
+{
+    size_t size = 0;
+    clGetDeviceInfo(device, CL_DEVICE_NAME, 0, nullptr, &size);
+    std::string name(size, '\0');
+    clGetDeviceInfo(device, CL_DEVICE_NAME, size, &name[0], nullptr);
+    while (!name.empty() && name.back() == '\0')
+        name.pop_back();
+    return name;
+}
+
+OpenCLDriver::~OpenCLDriver()
+{
+    clFinish(uploadQueue_);
+    clFinish(queue_);
+    for (FrameSlot &slot : slots_)
     {
-        std::cerr << "clGetDeviceIDs failed\n";
-        std::exit(1);
+        // Frames submitted but never waited on are still mapped
+        for (SlotOutput &output : slot.outputs)
+        {
+            if (!output.mapped)
+                continue;
+            if (output.mapDone)
+                clWaitForEvents(1, &output.mapDone);
+            clEnqueueUnmapMemObject(downloadQueue_, output.yuvBuffer, output.mapped, 0, nullptr, nullptr);
+            output.mapped = nullptr;
+        }
     }
+    clFinish(downloadQueue_);
+    releaseOpenCL();
+}
 
+void OpenCLDriver::initOpenCL()
+{
+    cl_int err;
     context_ = clCreateContext(nullptr, 1, &device_, nullptr, nullptr, &err);
     if (err != CL_SUCCESS)
+        throw std::runtime_error("clCreateContext failed: " + std::to_string(err));
+
+    // Separate in-order queues for upload, compute and readback so that
+    // transfers of one frame overlap kernels of another; ordering within a
+    // frame is enforced with events. Profiling timestamps every command
+    // for stageLatencies().
+    cl_command_queue *queues[] = {&uploadQueue_, &queue_, &downloadQueue_};
+    for (cl_command_queue *queue : queues)
     {
-        std::cerr << "clCreateContext failed\n";
-        std::exit(1);
+        *queue = clCreateCommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE, &err);
+        if (err != CL_SUCCESS)
+            throw std::runtime_error("clCreateCommandQueue failed: " + std::to_string(err));
     }
+}
 
-    queue_ = clCreateCommandQueue(context_, device_, 0, &err);
-    if (err != CL_SUCCESS)
+void OpenCLDriver::releaseOpenCL()
+{
+    releaseKernels();
+    cl_command_queue queues[] = {uploadQueue_, queue_, downloadQueue_};
+    for (cl_command_queue queue : queues)
     {
-        std::cerr << "clCreateCommandQueue failed\n";
-        std::exit(1);
+        if (queue)
+            clReleaseCommandQueue(queue);
     }
+    if (context_)
+        clReleaseContext(context_);
+    uploadQueue_ = queue_ = downloadQueue_ = nullptr;
+    context_ = nullptr;
 }
 
-void OpenCLDriver::loadKernel(const std::string &filePath)
+void OpenCLDriver::releaseOutput(SlotOutput &output)
 {
-    std::ifstream file(filePath);
-    if (!file.is_open())
+    cl_event *events[] = {&output.mapDone, &output.unmapDone};
+    for (cl_event *event : events)
     {
-        std::cerr << "Cannot open " << filePath << "\n";
-        std::exit(1);
+        if (*event)
+        {
+            clWaitForEvents(1, event);
+            clReleaseEvent(*event);
+            *event = nullptr;
+        }
     }
-    std::string src((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    const char *source = src.c_str();
-    cl_int err;
-    program_ = clCreateProgramWithSource(context_, 1, &source, nullptr, &err);
-    if (err != CL_SUCCESS)
+    for (int i = 0; i < output.kernelEventCount; ++i)
+        clReleaseEvent(output.kernelEvents[i]);
+    output.kernelEventCount = 0;
+    output.tunedLaunches = 0;
+    cl_mem *buffers[] = {&output.yuvBuffer, &output.tmpBuffer, &output.coeffBuffers[0], &output.coeffBuffers[1],
+                         &output.coeffBuffers[2], &output.coeffBuffers[3], &output.chromaCoeffBuffers[0],
+                         &output.chromaCoeffBuffers[1], &output.chromaCoeffBuffers[2], &output.chromaCoeffBuffers[3]};
+    for (cl_mem *buffer : buffers)
     {
-        std::cerr << "clCreateProgramWithSource failed\n";
-        std::exit(1);
+        if (*buffer)
+        {
+            clReleaseMemObject(*buffer);
+            *buffer = nullptr;
+        }
     }
-    err = clBuildProgram(program_, 1, &device_, nullptr, nullptr, nullptr);
-    if (err != CL_SUCCESS)
+    cl_kernel *kernels[] = {&output.kernel, &output.hKernel, &output.vKernel,
+                            &output.planeKernels[0], &output.planeKernels[1], &output.planeKernels[2],
+                            &output.planeVKernels[0], &output.planeVKernels[1], &output.planeVKernels[2]};
+    for (cl_kernel *kernel : kernels)
     {
-        size_t logSize;
-        clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
-        std::vector<char> log(logSize);
-        clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, logSize, log.data(), nullptr);
-        std::cerr << log.data() << "\n";
-        std::exit(1);
+        if (*kernel)
+        {
+            clReleaseKernel(*kernel);
+            *kernel = nullptr;
+        }
     }
+    output.geometry = FrameGeometry();
+    output.yuvSize = 0;
+}
+
+void OpenCLDriver::releaseBuffers(FrameSlot &slot)
+{
+    // Outputs have the input buffer bound as a kernel argument, so they go
+    // with it
+    for (SlotOutput &output : slot.outputs)
+        releaseOutput(output);
+    if (slot.writeDone)
+        clReleaseEvent(slot.writeDone);
+    slot.writeDone = nullptr;
+    if (slot.inputBuffer)
+        clReleaseMemObject(slot.inputBuffer);
+    slot.inputBuffer = nullptr;
+    slot.inputSize = 0;
+}
+
+void OpenCLDriver::ensureInput(FrameSlot &slot, size_t inputSize)
+{
+    if (slot.inputBuffer && slot.inputSize == inputSize)
+        return;
+
+    // Input size changed (or first frame): drop the old set before allocating
+    releaseBuffers(slot);
+
+    cl_int err;
+    slot.inputBuffer = clCreateBuffer(context_,
+                                      CL_MEM_READ_ONLY,
+                                      inputSize,
+                                      nullptr,
+                                      &err);
+    if (err != CL_SUCCESS)
+        throw std::runtime_error("Failed to create inputBuffer: " + std::to_string(err));
+    slot.inputSize = inputSize;
 }
 
-void OpenCLDriver::processFrame(const cv::Mat &input,
-                                std::vector<uint8_t> &outputYUV,
-                                int targetWidth,
-                                int targetHeight)
+void OpenCLDriver::ensureOutput(FrameSlot &slot, SlotOutput &output, const FrameGeometry &geometry)
 {
+    if (output.yuvBuffer && output.geometry == geometry)
+        return;
+    releaseOutput(output);
+
     cl_int err;
 
     // Compute buffer sizes
-    size_t inputSize = input.total() * input.elemSize();    // BGR24
-    size_t resizedSize = targetWidth * targetHeight * 3;    // BGR24
-    size_t ySize = targetWidth * targetHeight;              // Y plane
-    size_t uvSize = (targetWidth / 2) * (targetHeight / 2); // U or V plane
-    size_t yuvSize = ySize + 2 * uvSize;                    // total YUV420
-
-    // Create OpenCL buffers
-    cl_mem inputBuffer = clCreateBuffer(context_,
-                                        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-                                        inputSize,
-                                        (void *)input.data,
-                                        &err);
+    size_t ySize = (size_t)geometry.dstW * geometry.dstH;              // Y plane
+    size_t uvSize = (size_t)(geometry.dstW / 2) * (geometry.dstH / 2); // U or V plane
+    size_t yuvSize = ySize + 2 * uvSize;                               // total YUV420
+
+    // Host-visible so the finished frame can be mapped instead of copied
+    output.yuvBuffer = clCreateBuffer(context_,
+                                      CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                      yuvSize,
+                                      nullptr,
+                                      &err);
     if (err != CL_SUCCESS)
+        throw std::runtime_error("Failed to create yuvBuffer: " + std::to_string(err));
+
+    if (geometry.planar)
+        ensurePlanar(slot, output, geometry);
+    else if (geometry.filter != ResizeFilter::Fast)
+        ensurePolyphase(slot, output, geometry);
+    else
     {
-        std::cerr << "Failed to create inputBuffer: " << err << "\n";
-        std::exit(1);
+        // One kernel object per output so each keeps its own bound
+        // arguments; they only depend on the buffers and the geometry, so
+        // they are set here once instead of on every frame.
+        output.kernel = clCreateKernel(program_, geometry.tiled ? "resize_bgr_to_i420_tiled" : "resize_bgr_to_i420", &err);
+        if (err != CL_SUCCESS)
+            throw std::runtime_error("Failed to create preprocess kernel: " + std::to_string(err));
+        err = clSetKernelArg(output.kernel, 0, sizeof(cl_mem), &slot.inputBuffer);
+        err |= clSetKernelArg(output.kernel, 1, sizeof(int), &geometry.srcW);
+        err |= clSetKernelArg(output.kernel, 2, sizeof(int), &geometry.srcH);
+        err |= clSetKernelArg(output.kernel, 3, sizeof(cl_mem), &output.yuvBuffer);
+        err |= clSetKernelArg(output.kernel, 4, sizeof(int), &geometry.dstW);
+        err |= clSetKernelArg(output.kernel, 5, sizeof(int), &geometry.dstH);
+        if (geometry.tiled)
+        {
+            int tileW, tileH;
+            tiledSourceTile(geometry.srcW, geometry.srcH, geometry.dstW, geometry.dstH, tileW, tileH);
+            err |= clSetKernelArg(output.kernel, 6, (size_t)tileW * tileH * 3, nullptr);
+            err |= clSetKernelArg(output.kernel, 7, sizeof(int), &tileW);
+            err |= clSetKernelArg(output.kernel, 8, sizeof(int), &tileH);
+        }
+        if (err != CL_SUCCESS)
+            throw std::runtime_error("Failed to set preprocess kernel args: " + std::to_string(err));
     }
 
-    cl_mem resizedBuffer = clCreateBuffer(context_,
-                                          CL_MEM_READ_WRITE,
-                                          resizedSize,
-                                          nullptr,
-                                          &err);
-    if (err != CL_SUCCESS)
+    output.geometry = geometry;
+    output.yuvSize = yuvSize;
+}
+
+cl_program OpenCLDriver::coeffProgram(size_t tableBytes)
+{
+    // Constant memory is small (64 KiB minimum); tables for very wide
+    // outputs with long filters fall back to the __global build
+    if (tableBytes <= maxConstantBytes_)
+        return program_;
+    if (!globalCoeffProgram_)
+        globalCoeffProgram_ = buildProgramCached(context_, device_, openclPreprocessSource(),
+                                                 colorBuildOptions(colorSpace_) + " -D RESIZE_COEFF_SPACE=__global");
+    return globalCoeffProgram_;
+}
+
+void OpenCLDriver::ensurePolyphase(FrameSlot &slot, SlotOutput &output, const FrameGeometry &geometry)
+{
+    if (tablesGeometry_ != geometry)
     {
-        std::cerr << "Failed to create resizedBuffer: " << err << "\n";
-        std::exit(1);
+        hTables_ = computeResizeCoefficients(geometry.srcW, geometry.dstW, geometry.filter);
+        vTables_ = computeResizeCoefficients(geometry.srcH, geometry.dstH, geometry.filter);
+        tablesGeometry_ = geometry;
     }
 
-    // Separate Y, U, V buffers
-    cl_mem yBuffer = clCreateBuffer(context_,
-                                    CL_MEM_WRITE_ONLY,
-                                    ySize,
-                                    nullptr,
-                                    &err);
+    cl_int err;
+    output.tmpBuffer = clCreateBuffer(context_, CL_MEM_READ_WRITE, (size_t)geometry.dstW * geometry.srcH * 3, nullptr, &err);
     if (err != CL_SUCCESS)
+        throw std::runtime_error("Failed to create resize buffer: " + std::to_string(err));
+
+    size_t tableBytes = std::max(uploadResizeTable(context_, hTables_, &output.coeffBuffers[0]),
+                                 uploadResizeTable(context_, vTables_, &output.coeffBuffers[2]));
+    cl_program program = coeffProgram(tableBytes);
+    output.hKernel = clCreateKernel(program, "resize_polyphase_h", &err);
+    cl_int err2;
+    output.vKernel = clCreateKernel(program, "resize_polyphase_v_to_i420", &err2);
+    if (err != CL_SUCCESS || err2 != CL_SUCCESS)
+        throw std::runtime_error("Failed to create resize kernels: " + std::to_string(err != CL_SUCCESS ? err : err2));
+
+    err = clSetKernelArg(output.hKernel, 0, sizeof(cl_mem), &slot.inputBuffer);
+    err |= clSetKernelArg(output.hKernel, 1, sizeof(int), &geometry.srcW);
+    err |= clSetKernelArg(output.hKernel, 2, sizeof(int), &geometry.srcH);
+    err |= clSetKernelArg(output.hKernel, 3, sizeof(cl_mem), &output.tmpBuffer);
+    err |= clSetKernelArg(output.hKernel, 4, sizeof(int), &geometry.dstW);
+    err |= clSetKernelArg(output.hKernel, 5, sizeof(int), &hTables_.taps);
+    err |= clSetKernelArg(output.hKernel, 6, sizeof(cl_mem), &output.coeffBuffers[0]);
+    err |= clSetKernelArg(output.hKernel, 7, sizeof(cl_mem), &output.coeffBuffers[1]);
+
+    err |= clSetKernelArg(output.vKernel, 0, sizeof(cl_mem), &output.tmpBuffer);
+    err |= clSetKernelArg(output.vKernel, 1, sizeof(cl_mem), &output.yuvBuffer);
+    err |= clSetKernelArg(output.vKernel, 2, sizeof(int), &geometry.dstW);
+    err |= clSetKernelArg(output.vKernel, 3, sizeof(int), &geometry.dstH);
+    err |= clSetKernelArg(output.vKernel, 4, sizeof(int), &vTables_.taps);
+    err |= clSetKernelArg(output.vKernel, 5, sizeof(cl_mem), &output.coeffBuffers[2]);
+    err |= clSetKernelArg(output.vKernel, 6, sizeof(cl_mem), &output.coeffBuffers[3]);
+    if (err != CL_SUCCESS)
+        throw std::runtime_error("Failed to set resize kernel args: " + std::to_string(err));
+}
+
+void OpenCLDriver::ensurePlanar(FrameSlot &slot, SlotOutput &output, const FrameGeometry &geometry)
+{
+    cl_int err;
+    const bool fast = geometry.filter == ResizeFilter::Fast;
+    cl_program program = program_;
+    ResizeCoefficients chromaH, chromaV;
+    if (!fast)
     {
-        std::cerr << "Failed to create yBuffer: " << err << "\n";
-        std::exit(1);
+        // Luma tables go through the shared cache; chroma planes are half
+        // size and get their own
+        if (tablesGeometry_ != geometry)
+        {
+            hTables_ = computeResizeCoefficients(geometry.srcW, geometry.dstW, geometry.filter);
+            vTables_ = computeResizeCoefficients(geometry.srcH, geometry.dstH, geometry.filter);
+            tablesGeometry_ = geometry;
+        }
+        chromaH = computeResizeCoefficients(geometry.srcW / 2, geometry.dstW / 2, geometry.filter);
+        chromaV = computeResizeCoefficients(geometry.srcH / 2, geometry.dstH / 2, geometry.filter);
+
+        // dstW x srcH intermediate per plane, laid out like an I420 frame
+        output.tmpBuffer = clCreateBuffer(context_, CL_MEM_READ_WRITE, (size_t)geometry.dstW * geometry.srcH * 3 / 2,
+                                          nullptr, &err);
+        if (err != CL_SUCCESS)
+            throw std::runtime_error("Failed to create resize buffer: " + std::to_string(err));
+        size_t tableBytes = std::max({uploadResizeTable(context_, hTables_, &output.coeffBuffers[0]),
+                                      uploadResizeTable(context_, vTables_, &output.coeffBuffers[2]),
+                                      uploadResizeTable(context_, chromaH, &output.chromaCoeffBuffers[0]),
+                                      uploadResizeTable(context_, chromaV, &output.chromaCoeffBuffers[2])});
+        program = coeffProgram(tableBytes);
     }
 
-    cl_mem uBuffer = clCreateBuffer(context_,
-                                    CL_MEM_WRITE_ONLY,
-                                    uvSize,
-                                    nullptr,
-                                    &err);
-    if (err != CL_SUCCESS)
+    for (int p = 0; p < 3; ++p)
     {
-        std::cerr << "Failed to create uBuffer: " << err << "\n";
-        std::exit(1);
+        I420Plane src = i420Plane(geometry.srcW, geometry.srcH, p);
+        I420Plane dst = i420Plane(geometry.dstW, geometry.dstH, p);
+        int srcOffset = (int)src.offset;
+        int dstOffset = (int)dst.offset;
+        cl_kernel &kernel = output.planeKernels[p];
+        if (fast)
+        {
+            kernel = clCreateKernel(program, "resize_plane", &err);
+            if (err != CL_SUCCESS)
+                throw std::runtime_error("Failed to create plane kernel: " + std::to_string(err));
+            err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &slot.inputBuffer);
+            err |= clSetKernelArg(kernel, 1, sizeof(int), &srcOffset);
+            err |= clSetKernelArg(kernel, 2, sizeof(int), &src.width);
+            err |= clSetKernelArg(kernel, 3, sizeof(int), &src.height);
+            err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &output.yuvBuffer);
+            err |= clSetKernelArg(kernel, 5, sizeof(int), &dstOffset);
+            err |= clSetKernelArg(kernel, 6, sizeof(int), &dst.width);
+            err |= clSetKernelArg(kernel, 7, sizeof(int), &dst.height);
+        }
+        else
+        {
+            const ResizeCoefficients &h = p == 0 ? hTables_ : chromaH;
+            const ResizeCoefficients &v = p == 0 ? vTables_ : chromaV;
+            cl_mem *coeff = p == 0 ? output.coeffBuffers : output.chromaCoeffBuffers;
+            int tmpOffset = (int)i420Plane(geometry.dstW, geometry.srcH, p).offset;
+            cl_kernel &vKernel = output.planeVKernels[p];
+            cl_int err2;
+            kernel = clCreateKernel(program, "resize_plane_polyphase_h", &err);
+            vKernel = clCreateKernel(program, "resize_plane_polyphase_v", &err2);
+            if (err != CL_SUCCESS || err2 != CL_SUCCESS)
+                throw std::runtime_error("Failed to create plane kernels: " + std::to_string(err != CL_SUCCESS ? err : err2));
+            err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &slot.inputBuffer);
+            err |= clSetKernelArg(kernel, 1, sizeof(int), &srcOffset);
+            err |= clSetKernelArg(kernel, 2, sizeof(int), &src.width);
+            err |= clSetKernelArg(kernel, 3, sizeof(int), &src.height);
+            err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &output.tmpBuffer);
+            err |= clSetKernelArg(kernel, 5, sizeof(int), &tmpOffset);
+            err |= clSetKernelArg(kernel, 6, sizeof(int), &dst.width);
+            err |= clSetKernelArg(kernel, 7, sizeof(int), &h.taps);
+            err |= clSetKernelArg(kernel, 8, sizeof(cl_mem), &coeff[0]);
+            err |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &coeff[1]);
+
+            err |= clSetKernelArg(vKernel, 0, sizeof(cl_mem), &output.tmpBuffer);
+            err |= clSetKernelArg(vKernel, 1, sizeof(int), &tmpOffset);
+            err |= clSetKernelArg(vKernel, 2, sizeof(cl_mem), &output.yuvBuffer);
+            err |= clSetKernelArg(vKernel, 3, sizeof(int), &dstOffset);
+            err |= clSetKernelArg(vKernel, 4, sizeof(int), &dst.width);
+            err |= clSetKernelArg(vKernel, 5, sizeof(int), &dst.height);
+            err |= clSetKernelArg(vKernel, 6, sizeof(int), &v.taps);
+            err |= clSetKernelArg(vKernel, 7, sizeof(cl_mem), &coeff[2]);
+            err |= clSetKernelArg(vKernel, 8, sizeof(cl_mem), &coeff[3]);
+        }
+        if (err != CL_SUCCESS)
+            throw std::runtime_error("Failed to set plane kernel args: " + std::to_string(err));
     }
+}
 
-    cl_mem vBuffer = clCreateBuffer(context_,
-                                    CL_MEM_WRITE_ONLY,
-                                    uvSize,
-                                    nullptr,
-                                    &err);
-    if (err != CL_SUCCESS)
+OpenCLDriver::FrameTicket OpenCLDriver::submitFrame(const cv::Mat &input,
+                                                    int targetWidth,
+                                                    int targetHeight)
+{
+    OutputSize size;
+    size.width = targetWidth;
+    size.height = targetHeight;
+    return submitOutputs(input, &size, 1);
+}
+
+OpenCLDriver::FrameTicket OpenCLDriver::submitRenditions(const cv::Mat &input, const std::vector<OutputSize> &sizes)
+{
+    if (sizes.empty())
+        throw std::invalid_argument("submitRenditions: no output sizes");
+    return submitOutputs(input, sizes.data(), sizes.size());
+}
+
+OpenCLDriver::FrameTicket OpenCLDriver::submitOutputs(const cv::Mat &input, const OutputSize *sizes, size_t count)
+{
+    FrameTicket ticket = nextTicket_;
+    size_t slotIndex = ticket % slots_.size();
+    FrameSlot &slot = slots_[slotIndex];
     {
-        std::cerr << "Failed to create vBuffer: " << err << "\n";
-        std::exit(1);
+        std::unique_lock<std::mutex> lock(slotMutex_);
+        if (slot.state == SlotState::Submitted)
+            throw std::runtime_error("OpenCLDriver: all frame slots are in flight");
+        // Wait for the encoder side to hand back the frames it still holds
+        slotReleased_.wait(lock, [&]
+                           { return slot.state == SlotState::Free; });
     }
 
-    // 1) Resize kernel
-    err = clSetKernelArg(resizeKernel_, 0, sizeof(cl_mem), &inputBuffer);
-    err |= clSetKernelArg(resizeKernel_, 1, sizeof(int), &input.cols);
-    err |= clSetKernelArg(resizeKernel_, 2, sizeof(int), &input.rows);
-    err |= clSetKernelArg(resizeKernel_, 3, sizeof(cl_mem), &resizedBuffer);
-    err |= clSetKernelArg(resizeKernel_, 4, sizeof(int), &targetWidth);
-    err |= clSetKernelArg(resizeKernel_, 5, sizeof(int), &targetHeight);
-    if (err != CL_SUCCESS)
+    cl_int err;
+
+    // BGR24, or I420 at half the bytes
+    const size_t inputSize = input.total() * input.elemSize();
+    const bool planar = isI420Frame(input);
+    const int srcH = sourceHeight(input);
+    ensureInput(slot, inputSize);
+    if (slot.outputs.size() < count)
+        slot.outputs.resize(count);
+    for (size_t i = 0; i < count; ++i)
     {
-        std::cerr << "Failed to set resize kernel args: " << err << "\n";
-        std::exit(1);
+        FrameGeometry geometry;
+        geometry.srcW = input.cols;
+        geometry.srcH = srcH;
+        geometry.dstW = sizes[i].width;
+        geometry.dstH = sizes[i].height;
+        geometry.filter = resolveResizeFilter(resizeFilter_, input.cols, srcH, geometry.dstW, geometry.dstH);
+        geometry.planar = planar;
+        geometry.tiled = !planar && geometry.filter == ResizeFilter::Fast &&
+                         usesTiledKernel(input.cols, srcH, geometry.dstW, geometry.dstH);
+        ensureOutput(slot, slot.outputs[i], geometry);
     }
 
-    size_t globalResize[2] = {(size_t)targetWidth, (size_t)targetHeight};
-    err = clEnqueueNDRangeKernel(queue_, resizeKernel_, 2, nullptr, globalResize, nullptr, 0, nullptr, nullptr);
+    slot.hostInput = input;
+
+    // 0) Non-blocking upload into the slot's input buffer, shared by every
+    //    output of the frame
+    err = clEnqueueWriteBuffer(uploadQueue_, slot.inputBuffer, CL_FALSE, 0, inputSize, slot.hostInput.data, 0, nullptr,
+                               &slot.writeDone);
     if (err != CL_SUCCESS)
+        throw std::runtime_error("Failed to upload input frame: " + std::to_string(err));
+
+    // 1) + 2) Kernels and map per output
+    for (size_t i = 0; i < count; ++i)
+        enqueueOutput(slot.outputs[i], slot.writeDone);
+
+    // Kick the queues so the device starts on this frame right away
+    clFlush(uploadQueue_);
+    clFlush(queue_);
+    clFlush(downloadQueue_);
+
     {
-        std::cerr << "Resize kernel launch failed: " << err << "\n";
-        std::exit(1);
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        slot.activeOutputs = count;
+        slot.state = SlotState::Submitted;
     }
+    ++nextTicket_;
+    return ticket;
+}
 
-    // 2) Convert BGR->YUV420 kernel
-    err = clSetKernelArg(convertKernel_, 0, sizeof(cl_mem), &resizedBuffer);
-    err |= clSetKernelArg(convertKernel_, 1, sizeof(int), &targetWidth);
-    err |= clSetKernelArg(convertKernel_, 2, sizeof(int), &targetHeight);
-    err |= clSetKernelArg(convertKernel_, 3, sizeof(cl_mem), &yBuffer);
-    err |= clSetKernelArg(convertKernel_, 4, sizeof(cl_mem), &uBuffer);
-    err |= clSetKernelArg(convertKernel_, 5, sizeof(cl_mem), &vBuffer);
-    if (err != CL_SUCCESS)
+void OpenCLDriver::enqueueOutput(SlotOutput &output, cl_event writeDone)
+{
+    const FrameGeometry &geometry = output.geometry;
+    cl_int err;
+
+    // 1) Fused resize + BGR->YUV420 kernel, one work-item per 2x2 block
+    //    (a row of them for the tiled kernel).
+    //    It must also wait for the previous frame's unmap of this output.
+    //    Polyphase filters run the horizontal pass first; the in-order
+    //    compute queue keeps it ahead of the vertical + colour pass.
+    cl_event kernelDeps[2] = {writeDone, output.unmapDone};
+    cl_uint numKernelDeps = output.unmapDone ? 2 : 1;
+    size_t globalBlocks[2] = {(size_t)(geometry.dstW + 1) / 2, (size_t)(geometry.dstH + 1) / 2};
+    if (geometry.planar)
+    {
+        // A launch per plane; the in-order queue keeps them in sequence, so
+        // only the first waits on the events. Polyphase filters run every
+        // horizontal pass before the vertical ones.
+        const bool fast = geometry.filter == ResizeFilter::Fast;
+        err = CL_SUCCESS;
+        for (int pass = fast ? 1 : 0; pass < 2 && err == CL_SUCCESS; ++pass)
+        {
+            for (int p = 0; p < 3 && err == CL_SUCCESS; ++p)
+            {
+                I420Plane plane = i420Plane(geometry.dstW, pass == 0 ? geometry.srcH : geometry.dstH, p);
+                size_t global[2] = {(size_t)plane.width, (size_t)plane.height};
+                cl_kernel kernel = pass == 0 || fast ? output.planeKernels[p] : output.planeVKernels[p];
+                const cl_event *deps = nullptr;
+                cl_uint numDeps = 0;
+                if (p == 0 && pass == 0)
+                {
+                    deps = &writeDone;
+                    numDeps = 1;
+                }
+                else if (p == 0)
+                {
+                    // Fast: upload and unmap; polyphase vertical: unmap only
+                    deps = fast ? kernelDeps : (output.unmapDone ? &output.unmapDone : nullptr);
+                    numDeps = fast ? numKernelDeps : numKernelDeps - 1;
+                }
+                DeviceStage stage = fast ? DeviceStage::Resize
+                                         : pass == 0 ? DeviceStage::HorizontalPass
+                                                     : DeviceStage::VerticalPass;
+                err = launchKernel(output, stage, kernel, global, nullptr, numDeps, deps);
+            }
+        }
+    }
+    else if (geometry.tiled)
     {
-        std::cerr << "Failed to set convert kernel args: " << err << "\n";
-        std::exit(1);
+        // Each work-item covers TILED_BLOCKS_PER_ITEM blocks of a row; the
+        // grid is rounded up to whole work-groups
+        size_t local[2] = {TILED_GROUP_W, TILED_GROUP_H};
+        size_t itemsX = (globalBlocks[0] + TILED_BLOCKS_PER_ITEM - 1) / TILED_BLOCKS_PER_ITEM;
+        size_t global[2] = {(itemsX + local[0] - 1) / local[0] * local[0],
+                            (globalBlocks[1] + local[1] - 1) / local[1] * local[1]};
+        err = launchKernel(output, DeviceStage::Resize, output.kernel, global, local, numKernelDeps, kernelDeps);
     }
+    else if (geometry.filter == ResizeFilter::Fast)
+        err = launchKernel(output, DeviceStage::Resize, output.kernel, globalBlocks, nullptr, numKernelDeps, kernelDeps);
+    else
+    {
+        size_t globalRows[2] = {(size_t)geometry.dstW, (size_t)geometry.srcH};
+        err = launchKernel(output, DeviceStage::HorizontalPass, output.hKernel, globalRows, nullptr, 1, &writeDone);
+        if (err == CL_SUCCESS)
+            err = launchKernel(output, DeviceStage::VerticalPass, output.vKernel, globalBlocks, nullptr,
+                               numKernelDeps - 1, output.unmapDone ? &output.unmapDone : nullptr);
+    }
+    if (err != CL_SUCCESS)
+        throw std::runtime_error("Preprocess kernel launch failed: " + std::to_string(err));
 
-    size_t globalConvert[2] = {(size_t)targetWidth, (size_t)targetHeight};
-    err = clEnqueueNDRangeKernel(queue_, convertKernel_, 2, nullptr, globalConvert, nullptr, 0, nullptr, nullptr);
+    // 2) Non-blocking map of the contiguous I420 frame for the host, after
+    //    the last kernel
+    cl_event kernelDone = output.kernelEvents[output.kernelEventCount - 1];
+    output.mapped = static_cast<uint8_t *>(clEnqueueMapBuffer(downloadQueue_, output.yuvBuffer, CL_FALSE, CL_MAP_READ,
+                                                              0, output.yuvSize, 1, &kernelDone, &output.mapDone, &err));
     if (err != CL_SUCCESS)
+        throw std::runtime_error("Failed to map YUV frame: " + std::to_string(err));
+    if (output.unmapDone)
     {
-        std::cerr << "Convert kernel launch failed: " << err << "\n";
-        std::exit(1);
-    }
-
-    // 3) Read back Y, U, V planes
-    std::vector<uint8_t> planeY(ySize), planeU(uvSize), planeV(uvSize);
-    clEnqueueReadBuffer(queue_, yBuffer, CL_TRUE, 0, ySize, planeY.data(), 0, nullptr, nullptr);
-    clEnqueueReadBuffer(queue_, uBuffer, CL_TRUE, 0, uvSize, planeU.data(), 0, nullptr, nullptr);
-    clEnqueueReadBuffer(queue_, vBuffer, CL_TRUE, 0, uvSize, planeV.data(), 0, nullptr, nullptr);
-
-    // 4) Stitch into single YUV420 buffer: Y plane, then U plane, then V plane
-    outputYUV.resize(yuvSize);
-    size_t offset = 0;
-    memcpy(outputYUV.data() + offset, planeY.data(), ySize);
-    offset += ySize;
-    memcpy(outputYUV.data() + offset, planeU.data(), uvSize);
-    offset += uvSize;
-    memcpy(outputYUV.data() + offset, planeV.data(), uvSize);
-
-    // 5) Cleanup
-    clReleaseMemObject(inputBuffer);
-    clReleaseMemObject(resizedBuffer);
-    clReleaseMemObject(yBuffer);
-    clReleaseMemObject(uBuffer);
-    clReleaseMemObject(vBuffer);
+        clReleaseEvent(output.unmapDone);
+        output.unmapDone = nullptr;
+    }
+}
+
+cl_int OpenCLDriver::launchKernel(SlotOutput &output, DeviceStage stage, cl_kernel kernel, const size_t *global,
+                                  const size_t *local, cl_uint numDeps, const cl_event *deps)
+{
+    const int index = output.kernelEventCount;
+    // Launches without a required work-group size take the tuned one, over
+    // a grid rounded up to whole groups; every kernel bounds-checks its
+    // work-items. A geometry launches the same kernels in the same order
+    // every frame, so the sizes are looked up once per slot output.
+    size_t paddedGlobal[2];
+    if (!local && tuneWorkGroups_)
+    {
+        if (index >= output.tunedLaunches)
+        {
+            tunedLocalSize(kernel, global, numDeps, deps, output.launchLocal[index]);
+            output.tunedLaunches = index + 1;
+        }
+        const size_t *tuned = output.launchLocal[index];
+        if (tuned[0])
+        {
+            for (int d = 0; d < 2; ++d)
+                paddedGlobal[d] = (global[d] + tuned[d] - 1) / tuned[d] * tuned[d];
+            global = paddedGlobal;
+            local = tuned;
+        }
+    }
+
+    cl_event *done = &output.kernelEvents[index];
+    output.kernelStages[index] = stage;
+    cl_int err = clEnqueueNDRangeKernel(queue_, kernel, 2, nullptr, global, local, numDeps, deps, done);
+    if (err == CL_SUCCESS)
+        ++output.kernelEventCount;
+    return err;
+}
+
+void OpenCLDriver::tunedLocalSize(cl_kernel kernel, const size_t *global, cl_uint numDeps, const cl_event *deps,
+                                  size_t local[2])
+{
+    std::string key = launchKey(kernel, device_, global);
+    auto it = tunedLocalSizes_.find(key);
+    if (it == tunedLocalSizes_.end())
+    {
+        std::array<size_t, 2> best;
+        // A cached size the kernel can no longer run (other build of the
+        // same driver version, say) is measured again
+        if (!loadCachedLocalSize(device_, openclPreprocessSource(), key, best.data()) ||
+            best[0] * best[1] > kernelGroupLimit(kernel, device_))
+        {
+            // The trial runs read this launch's inputs and overwrite its
+            // outputs, so they wait for the upload and the previous unmap
+            if (numDeps > 0)
+                clWaitForEvents(numDeps, deps);
+            best = benchmarkLocalSizes(kernel, global);
+            storeCachedLocalSize(device_, openclPreprocessSource(), key, best.data());
+        }
+        it = tunedLocalSizes_.emplace(key, best).first;
+    }
+    local[0] = it->second[0];
+    local[1] = it->second[1];
+}
+
+std::array<size_t, 2> OpenCLDriver::benchmarkLocalSizes(cl_kernel kernel, const size_t *global)
+{
+    std::array<size_t, 2> best = {0, 0};
+    double bestSeconds = -1.0;
+    for (const std::array<size_t, 2> &candidate : localSizeCandidates(kernel, device_, global))
+    {
+        size_t padded[2] = {global[0], global[1]};
+        if (candidate[0])
+        {
+            for (int d = 0; d < 2; ++d)
+                padded[d] = (global[d] + candidate[d] - 1) / candidate[d] * candidate[d];
+        }
+        double seconds = -1.0;
+        for (int run = 0; run <= TUNING_RUNS; ++run)
+        {
+            cl_event done;
+            if (clEnqueueNDRangeKernel(queue_, kernel, 2, nullptr, padded, candidate[0] ? candidate.data() : nullptr, 0,
+                                       nullptr, &done) != CL_SUCCESS)
+            {
+                seconds = -1.0; // out of resources at this size
+                break;
+            }
+            clWaitForEvents(1, &done);
+            double runSeconds = commandSeconds(done);
+            clReleaseEvent(done);
+            if (run > 0 && runSeconds >= 0.0 && (seconds < 0.0 || runSeconds < seconds))
+                seconds = runSeconds;
+        }
+        // Ties keep the earlier candidate, so the runtime's choice wins them
+        if (seconds >= 0.0 && (bestSeconds < 0.0 || seconds < bestSeconds))
+        {
+            best = candidate;
+            bestSeconds = seconds;
+        }
+    }
+    return best;
+}
+
+YuvFrame OpenCLDriver::waitMappedFrame(FrameTicket ticket)
+{
+    YuvFrame frame;
+    waitOutputs(ticket, &frame, 1);
+    return frame;
+}
+
+void OpenCLDriver::waitRenditions(FrameTicket ticket, size_t count, std::vector<YuvFrame> &frames)
+{
+    frames.resize(count);
+    waitOutputs(ticket, frames.data(), count);
+}
+
+void OpenCLDriver::waitOutputs(FrameTicket ticket, YuvFrame *frames, size_t count)
+{
+    if (ticket >= nextTicket_)
+        throw std::runtime_error("OpenCLDriver: ticket " + std::to_string(ticket) + " was never submitted");
+    if (ticket != nextWait_)
+        throw std::runtime_error("OpenCLDriver: frames must be waited on in submission order");
+
+    size_t slotIndex = ticket % slots_.size();
+    FrameSlot &slot = slots_[slotIndex];
+    if (count != slot.activeOutputs)
+        throw std::runtime_error("OpenCLDriver: ticket has " + std::to_string(slot.activeOutputs) + " outputs, " +
+                                 std::to_string(count) + " requested");
+    for (size_t i = 0; i < count; ++i)
+    {
+        SlotOutput &output = slot.outputs[i];
+        cl_int err = clWaitForEvents(1, &output.mapDone);
+        if (err != CL_SUCCESS)
+            throw std::runtime_error("Waiting for frame failed: " + std::to_string(err));
+    }
+    recordDeviceTimes(slot, count);
+    slot.hostInput.release();
+
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        slot.mappedOutputs = count;
+        slot.state = SlotState::Mapped;
+    }
+    ++nextWait_;
+    // Handles number outputs after the slots: output i of slot s is
+    // s + i * slotCount()
+    for (size_t i = 0; i < count; ++i)
+        frames[i] = YuvFrame(this, slotIndex + i * slots_.size(), slot.outputs[i].mapped, slot.outputs[i].yuvSize);
+}
+
+void OpenCLDriver::recordDeviceTimes(FrameSlot &slot, size_t count)
+{
+    // The map completed last, so every event of the frame has its times
+    auto record = [this](DeviceStage stage, cl_event &event)
+    {
+        double sec = commandSeconds(event);
+        if (sec >= 0.0)
+            deviceLatency_[static_cast<int>(stage)].record(sec);
+        clReleaseEvent(event);
+        event = nullptr;
+    };
+
+    record(DeviceStage::Upload, slot.writeDone);
+    for (size_t i = 0; i < count; ++i)
+    {
+        SlotOutput &output = slot.outputs[i];
+        // Launches of the same pass (one per plane) add up to one sample
+        double passSec[static_cast<int>(DeviceStage::Count)] = {};
+        bool ran[static_cast<int>(DeviceStage::Count)] = {};
+        for (int k = 0; k < output.kernelEventCount; ++k)
+        {
+            double sec = commandSeconds(output.kernelEvents[k]);
+            if (sec >= 0.0)
+            {
+                int stage = static_cast<int>(output.kernelStages[k]);
+                passSec[stage] += sec;
+                ran[stage] = true;
+            }
+            clReleaseEvent(output.kernelEvents[k]);
+        }
+        output.kernelEventCount = 0;
+        for (int stage = 0; stage < static_cast<int>(DeviceStage::Count); ++stage)
+            if (ran[stage])
+                deviceLatency_[stage].record(passSec[stage]);
+        record(DeviceStage::Readback, output.mapDone);
+    }
+}
+
+StageLatencies OpenCLDriver::stageLatencies() const
+{
+    static const char *const names[] = {"upload", "resize", "resize_h", "resize_v", "readback"};
+    StageLatencies stages;
+    for (int stage = 0; stage < static_cast<int>(DeviceStage::Count); ++stage)
+        if (deviceLatency_[stage].count() > 0)
+            stages.emplace_back(names[stage], deviceLatency_[stage]);
+    return stages;
+}
+
+bool OpenCLDriver::nextSlotFree()
+{
+    std::lock_guard<std::mutex> lock(slotMutex_);
+    return slots_[nextTicket_ % slots_.size()].state == SlotState::Free;
+}
+
+void OpenCLDriver::releaseFrame(size_t handle)
+{
+    FrameSlot &slot = slots_[handle % slots_.size()];
+    SlotOutput &output = slot.outputs[handle / slots_.size()];
+    cl_int err = clEnqueueUnmapMemObject(downloadQueue_, output.yuvBuffer, output.mapped, 0, nullptr, &output.unmapDone);
+    clFlush(downloadQueue_);
+    output.mapped = nullptr;
+
+    // The slot is handed back even if the unmap failed, so a submitter
+    // waiting on it sees the device error instead of blocking
+    bool slotFree;
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        slotFree = --slot.mappedOutputs == 0;
+        if (slotFree)
+            slot.state = SlotState::Free;
+    }
+    if (slotFree)
+        slotReleased_.notify_all();
+    if (err != CL_SUCCESS)
+        throw std::runtime_error("Failed to unmap YUV frame: " + std::to_string(err));
 }
@@ -0,0 +1,320 @@
+#include "pipeline.hpp"
+#include "video_reader.hpp"
+#include "preprocess_backend.hpp"
+#include "encoder.hpp"
+#include "bounded_queue.hpp"
+#include "spsc_ring.hpp"
+#include "frame_pool.hpp"
+#include "reorder_buffer.hpp"
+#include "trace.hpp"
+#include "timing.hpp"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace
+{
+// A source frame tagged with its position in the stream
+struct SequencedFrame
+{
+    uint64_t seq = 0;
+    PooledFrame frame;
+};
+
+// One processing worker: keeps up to slotCount() frames queued on its
+// backend and only blocks on the oldest one once every slot is in use.
+// Each source buffer is held until its ticket is redeemed; finished frames
+// go to deliver(seq, yuv) as handles (mapped device buffers for OpenCL),
+// not copies, in the order this worker took them.
+template <typename FrameQueue, typename Deliver>
+void processFrames(PreprocessBackend &processor, FrameQueue &frameQueue, const std::atomic<bool> &stop,
+                   int outW, int outH, PipelineStats::WorkerStats &workerStats, Deliver deliver)
+{
+    struct InFlightFrame
+    {
+        uint64_t seq = 0;
+        PreprocessBackend::FrameTicket ticket = 0;
+        PooledFrame input;
+        double submitSec = 0.0;
+    };
+    const size_t slots = processor.slotCount();
+    std::vector<InFlightFrame> inFlight(slots); // ring, oldest first
+    size_t oldest = 0, inFlightCount = 0;
+    SequencedFrame frame;
+    bool downstreamOpen = true;
+
+    auto retireOldest = [&]
+    {
+        // Taken off the ring first, so a wait that throws still uses up
+        // its ticket and the drain after an error goes on to the next one
+        InFlightFrame &entry = inFlight[oldest];
+        oldest = (oldest + 1) % slots;
+        --inFlightCount;
+        auto t0 = Clock::now();
+        YuvFrame yuv;
+        {
+            TraceScope trace("complete", static_cast<int64_t>(entry.seq));
+            yuv = processor.waitMappedFrame(entry.ticket);
+        }
+        double waitSec = secondsBetween(t0, Clock::now());
+        workerStats.busySec += waitSec;
+        workerStats.latency.record(entry.submitSec + waitSec);
+        entry.input.release(); // back to the reader
+        ++workerStats.frames;
+        TraceScope trace("queue_push", static_cast<int64_t>(entry.seq));
+        downstreamOpen = downstreamOpen && deliver(entry.seq, std::move(yuv));
+    };
+
+    // Blocking pop, traced as queue wait
+    auto nextFrame = [&]
+    {
+        TraceScope trace("queue_pop");
+        bool popped = frameQueue.pop(frame);
+        if (popped)
+            trace.setFrame(static_cast<int64_t>(frame.seq));
+        return popped;
+    };
+
+    try
+    {
+        while (downstreamOpen && !stop && nextFrame())
+        {
+            if (inFlightCount == slots)
+                retireOldest();
+
+            InFlightFrame &entry = inFlight[(oldest + inFlightCount) % slots];
+            auto t0 = Clock::now();
+            {
+                TraceScope trace("submit", static_cast<int64_t>(frame.seq));
+                entry.ticket = processor.submitFrame(frame.frame.mat(), outW, outH);
+            }
+            entry.submitSec = secondsBetween(t0, Clock::now());
+            workerStats.busySec += entry.submitSec;
+            entry.seq = frame.seq;
+            entry.input = std::move(frame.frame);
+            ++inFlightCount;
+        }
+        while (inFlightCount > 0)
+            retireOldest();
+    }
+    catch (...)
+    {
+        // Redeem the tickets still queued so the backend's slots are free
+        // for its next job, then report the first error
+        downstreamOpen = false;
+        while (inFlightCount > 0)
+        {
+            try
+            {
+                retireOldest();
+            }
+            catch (...)
+            {
+            }
+        }
+        throw;
+    }
+}
+
+template <template <typename> class Queue>
+PipelineStats runStages(VideoReader &reader,
+                        const std::vector<PreprocessBackend *> &processors,
+                        Encoder &encoder,
+                        const PipelineOptions &options)
+{
+    const int outW = options.outWidth;
+    const int outH = options.outHeight;
+    const size_t workerCount = processors.size();
+
+    size_t totalSlots = 0;
+    for (PreprocessBackend *processor : processors)
+        totalSlots += processor->slotCount();
+
+    // Source frames live in a fixed pool and move through the stages as
+    // handles; the reader only refills a buffer once a backend is done
+    // with it. One more buffer than the reader, the queue and the backend
+    // slots can hold at once would be idle, so the pool never needs to be
+    // bigger; it must exceed the total slot count or the reader starves
+    // the workers.
+    size_t poolSize = options.framePoolSize > 0 ? options.framePoolSize : options.queueCapacity + totalSlots + 1;
+    if (poolSize < totalSlots + 1)
+        poolSize = totalSlots + 1;
+    FramePool framePool(poolSize, reader.frameRows(), reader.getWidth(), reader.frameType());
+
+    // Queues for each stage. With several workers, results arrive out of
+    // order and go through a reorder buffer instead of a queue. A worker
+    // only ever waits in it with frames later than the one the encoder
+    // needs, and that frame is always either still queued or owned by a
+    // worker that is not waiting, so backpressure cannot deadlock.
+    Queue<SequencedFrame> frameQueue(options.queueCapacity);
+    Queue<YuvFrame> yuvQueue(options.queueCapacity);
+    ReorderBuffer<YuvFrame> reorder(workerCount > 1 ? options.queueCapacity + totalSlots : 1);
+
+    // Metrics
+    PipelineStats stats;
+    stats.workers.resize(workerCount);
+    auto tStart = Clock::now();
+
+    // The first error from any stage is kept and rethrown after the join.
+    // Closing every queue and the pool wakes the other stages, which then
+    // stop: the reader's pushes fail, the workers take no new frames and
+    // drop the ones they have in flight, and the encoder skips finish()
+    // and drops what is queued.
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+    auto fail = [&]
+    {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        failed = true;
+        framePool.close();
+        frameQueue.close();
+        yuvQueue.close();
+        reorder.close();
+    };
+
+    // Reader thread
+    std::thread readerThread([&]
+                             {
+        setTraceThreadName("reader");
+        try {
+            for (uint64_t seq = 0; !failed && (options.maxFrames == 0 || seq < options.maxFrames); ++seq) {
+                const int64_t traceSeq = static_cast<int64_t>(seq);
+                SequencedFrame frame;
+                frame.seq = seq;
+                {
+                    TraceScope trace("pool_wait", traceSeq);
+                    frame.frame = framePool.acquire();
+                }
+                if (!frame.frame) break;
+                auto t0 = Clock::now();
+                {
+                    TraceScope trace("decode", traceSeq);
+                    if (!reader.getNextFrame(frame.frame.mat())) break;
+                }
+                stats.decodeLatency.record(secondsBetween(t0, Clock::now()));
+                TraceScope trace("queue_push", traceSeq);
+                if (!frameQueue.push(std::move(frame))) break;
+            }
+        } catch (...) {
+            fail();
+        }
+        frameQueue.close(); });
+
+    // Processing workers, one backend each
+    std::atomic<size_t> activeWorkers{workerCount};
+    std::vector<std::thread> workerThreads;
+    for (size_t i = 0; i < workerCount; ++i)
+    {
+        workerThreads.emplace_back([&, i]
+                                   {
+            setTraceThreadName("worker " + std::to_string(i));
+            PipelineStats::WorkerStats &workerStats = stats.workers[i];
+            auto tWorker = Clock::now();
+            try {
+                processFrames(*processors[i], frameQueue, failed, outW, outH, workerStats,
+                              [&](uint64_t seq, YuvFrame &&yuv) {
+                                  return !failed && (workerCount > 1 ? reorder.put(seq, std::move(yuv))
+                                                                     : yuvQueue.push(std::move(yuv)));
+                              });
+            } catch (...) {
+                fail();
+            }
+            workerStats.wallSec = secondsBetween(tWorker, Clock::now());
+            if (--activeWorkers == 0) {
+                yuvQueue.close();
+                reorder.close();
+            } });
+    }
+
+    // Encoder thread
+    std::thread encoderThread([&]
+                              {
+        setTraceThreadName("encoder");
+        try {
+            YuvFrame yuv;
+            auto nextYuv = [&] {
+                TraceScope trace("queue_pop", static_cast<int64_t>(stats.framesProcessed));
+                return !failed && (workerCount > 1 ? reorder.pop(yuv) : yuvQueue.pop(yuv));
+            };
+            while (nextYuv()) {
+                auto t2 = Clock::now();
+                {
+                    TraceScope trace("encode", static_cast<int64_t>(stats.framesProcessed));
+                    encoder.encodeFrame(yuv.data(), yuv.size());
+                    yuv.release(); // hand the slot back to the backend
+                }
+                auto t3 = Clock::now();
+                stats.encSec += secondsBetween(t2, t3);
+                stats.encodeLatency.record(secondsBetween(t2, t3));
+                ++stats.framesProcessed;
+                if (options.onFrameEncoded)
+                    options.onFrameEncoded(stats.framesProcessed);
+            }
+            // A truncated stream is not finalized; the caller gets the error
+            if (!failed)
+                encoder.finish();
+        } catch (...) {
+            fail();
+        }
+        // After a failure, drop the frames still queued so their backend
+        // slots come back and the workers can retire what is in flight
+        if (failed) {
+            YuvFrame dropped;
+            while (workerCount > 1 ? reorder.pop(dropped) : yuvQueue.pop(dropped))
+                dropped.release();
+            reorder.clear();
+        } });
+
+    // Wait for completion
+    readerThread.join();
+    for (std::thread &worker : workerThreads)
+        worker.join();
+    encoderThread.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    for (const PipelineStats::WorkerStats &workerStats : stats.workers)
+    {
+        stats.procSec += workerStats.busySec;
+        stats.procLatency.merge(workerStats.latency);
+    }
+    stats.totalSec = secondsBetween(tStart, Clock::now());
+    return stats;
+}
+} // namespace
+
+PipelineStats runPipeline(VideoReader &reader,
+                          const std::vector<PreprocessBackend *> &processors,
+                          Encoder &encoder,
+                          const PipelineOptions &options)
+{
+    if (processors.empty())
+        throw std::invalid_argument("runPipeline needs at least one backend");
+
+    // Several workers share the source queue, which then needs the
+    // multi-consumer BoundedQueue
+    if (options.queueKind == QueueKind::Spsc && processors.size() == 1)
+        return runStages<SpscRing>(reader, processors, encoder, options);
+    return runStages<BoundedQueue>(reader, processors, encoder, options);
+}
+
+PipelineStats runPipeline(VideoReader &reader,
+                          PreprocessBackend &processor,
+                          Encoder &encoder,
+                          const PipelineOptions &options)
+{
+    return runPipeline(reader, std::vector<PreprocessBackend *>{&processor}, encoder, options);
+}
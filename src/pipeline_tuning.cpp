@@ -0,0 +1,198 @@
+#include "pipeline_tuning.hpp"
+#include "preprocess_backend.hpp"
+#include "program_cache.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+std::string hostName()
+{
+#ifdef _WIN32
+    if (const char *name = std::getenv("COMPUTERNAME"))
+        return name;
+#else
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) == 0 && name[0])
+        return name;
+#endif
+    return "localhost";
+}
+
+// Buffers a configuration keeps allocated: the read-ahead ring and source
+// pool as runPipeline() sizes it, plus one output per backend slot
+size_t pipelineMemoryBytes(size_t sourceFrameBytes, size_t outputFrameBytes, size_t readAhead, size_t queueCapacity,
+                           size_t totalSlots)
+{
+    size_t sourceFrames = readAhead + queueCapacity + totalSlots + 1;
+    return sourceFrames * sourceFrameBytes + totalSlots * outputFrameBytes;
+}
+
+// Frames per second once the stages are full, from the encoder's clock
+double measureSteadyFps(const std::string &inPath, int outW, int outH, const std::vector<PreprocessBackend *> &backends,
+                        size_t queueCapacity, size_t frames, size_t warmupFrames, const TuningOptions &options)
+{
+    VideoReader reader(inPath, options.reader);
+    EncoderOptions encoderOptions = options.encoder;
+    encoderOptions.container = "null";
+    Encoder encoder("-", outW, outH, reader.getFPS(), encoderOptions);
+
+    PipelineOptions pipelineOptions;
+    pipelineOptions.outWidth = outW;
+    pipelineOptions.outHeight = outH;
+    pipelineOptions.queueCapacity = queueCapacity;
+    pipelineOptions.queueKind = options.queueKind;
+    pipelineOptions.maxFrames = frames;
+    Clock::time_point tWarm, tLast;
+    size_t lastFrame = 0;
+    pipelineOptions.onFrameEncoded = [&](size_t encoded)
+    {
+        if (encoded == warmupFrames)
+            tWarm = Clock::now();
+        tLast = Clock::now();
+        lastFrame = encoded;
+    };
+    runPipeline(reader, backends, encoder, pipelineOptions);
+    if (lastFrame <= warmupFrames)
+        return 0.0;
+    double sec = secondsBetween(tWarm, tLast);
+    return sec > 0.0 ? (lastFrame - warmupFrames) / sec : 0.0;
+}
+} // namespace
+
+PipelineTuning calibratePipeline(const std::string &inPath, int outW, int outH,
+                                 const TuningBackendFactory &createBackend, const TuningOptions &options)
+{
+    size_t frames, sourceFrameBytes;
+    {
+        VideoReader probe(inPath, options.reader);
+        double fps = probe.getFPS() > 0.0 ? probe.getFPS() : 30.0;
+        frames = static_cast<size_t>(std::max(30.0, options.calibrationSec * fps));
+        if (probe.getFrameCount() > 0)
+            frames = std::min(frames, static_cast<size_t>(probe.getFrameCount()));
+        sourceFrameBytes = (size_t)probe.frameRows() * probe.getWidth() * CV_ELEM_SIZE(probe.frameType());
+    }
+    const size_t warmupFrames = static_cast<size_t>(frames * options.warmupShare);
+    const size_t outputFrameBytes = (size_t)outW * outH + 2 * (size_t)(outW / 2) * (outH / 2);
+
+    PipelineTuning best;
+    bool found = false;
+    for (size_t workers : options.workerCounts)
+    {
+        if (workers == 0)
+            continue;
+        std::vector<std::unique_ptr<PreprocessBackend>> backends;
+        std::vector<PreprocessBackend *> processors;
+        size_t totalSlots = 0;
+        for (size_t i = 0; i < workers; ++i)
+        {
+            backends.push_back(createBackend(workers));
+            processors.push_back(backends.back().get());
+            totalSlots += processors.back()->slotCount();
+        }
+        for (size_t depth : options.queueDepths)
+        {
+            PipelineTuning tuning;
+            tuning.queueCapacity = depth;
+            tuning.workers = workers;
+            tuning.memoryBytes = pipelineMemoryBytes(sourceFrameBytes, outputFrameBytes, options.reader.readAhead,
+                                                     depth, totalSlots);
+            if (depth > 0 && tuning.memoryBytes <= options.memoryCap)
+                tuning.fps = measureSteadyFps(inPath, outW, outH, processors, depth, frames, warmupFrames, options);
+            if (options.onMeasured)
+                options.onMeasured(tuning);
+            // Ties go to the smaller configuration, which was measured first
+            if (tuning.fps > 0.0 && (!found || tuning.fps > best.fps))
+            {
+                best = tuning;
+                found = true;
+            }
+        }
+    }
+    if (!found)
+        throw std::runtime_error("No pipeline configuration fits in " + std::to_string(options.memoryCap >> 20) +
+                                 " MiB");
+    return best;
+}
+
+std::string tuningProfilePath()
+{
+    std::string dir = programCacheDirectory();
+    if (dir.empty())
+        return std::string();
+    return (fs::path(dir) / ("pipeline-" + hostName() + ".tuning")).string();
+}
+
+std::string tuningKey(const std::string &backendName, int inW, int inH, int outW, int outH,
+                      VideoReader::PixelFormat format)
+{
+    std::ostringstream key;
+    key << backendName << "/" << inW << "x" << inH << "->" << outW << "x" << outH << "/"
+        << (format == VideoReader::PixelFormat::I420 ? "yuv" : "bgr");
+    return key.str();
+}
+
+// Profile lines: <key> <queue capacity> <workers> <fps> <memory bytes>.
+// Lines without the memory field, from before it was saved, read as no entry.
+bool loadTuning(const std::string &path, const std::string &key, PipelineTuning &tuning)
+{
+    if (path.empty())
+        return false;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string lineKey;
+        PipelineTuning entry;
+        if (fields >> lineKey >> entry.queueCapacity >> entry.workers >> entry.fps >> entry.memoryBytes &&
+            lineKey == key &&
+            entry.queueCapacity > 0 && entry.workers > 0)
+        {
+            tuning = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+void saveTuning(const std::string &path, const std::string &key, const PipelineTuning &tuning)
+{
+    if (path.empty())
+        return;
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            std::string lineKey;
+            if (fields >> lineKey && lineKey != key)
+                lines.push_back(line);
+        }
+    }
+    std::ostringstream entry;
+    entry << key << " " << tuning.queueCapacity << " " << tuning.workers << " " << tuning.fps << " "
+          << tuning.memoryBytes;
+    lines.push_back(entry.str());
+
+    std::string text;
+    for (const std::string &line : lines)
+        text += line + "\n";
+    storeFileAtomically(path, text.data(), text.size());
+}
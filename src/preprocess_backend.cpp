@@ -0,0 +1,55 @@
+#include "preprocess_backend.hpp"
+#include "opencl_driver.hpp"
+#include "multi_device_driver.hpp"
+#include "cpu_backend.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+PreprocessBackend::FrameTicket PreprocessBackend::submitRenditions(const cv::Mat &input,
+                                                                  const std::vector<OutputSize> &sizes)
+{
+    if (sizes.empty() || sizes.size() > slotCount())
+        throw std::invalid_argument("submitRenditions: " + std::to_string(sizes.size()) + " sizes for " +
+                                    std::to_string(slotCount()) + " frame slots");
+    FrameTicket first = submitFrame(input, sizes[0].width, sizes[0].height);
+    for (size_t i = 1; i < sizes.size(); ++i)
+        submitFrame(input, sizes[i].width, sizes[i].height);
+    return first;
+}
+
+void PreprocessBackend::waitRenditions(FrameTicket ticket, size_t count, std::vector<YuvFrame> &frames)
+{
+    frames.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        frames[i] = waitMappedFrame(ticket + i);
+}
+
+std::unique_ptr<PreprocessBackend> createBackend(const std::string &name, size_t cpuThreads)
+{
+    if (name == "opencl")
+        return std::make_unique<OpenCLDriver>();
+    if (name == "multi")
+        return std::make_unique<MultiDeviceDriver>();
+    if (name == "cpu")
+        return std::make_unique<CpuBackend>(cpuThreads);
+    if (name != "auto")
+        throw std::invalid_argument("Unknown backend '" + name + "' (expected auto, opencl, multi or cpu)");
+
+    // A GPU beats the CPU path; without one, native SIMD beats a CPU
+    // OpenCL runtime, so OpenCL is only used when a GPU is present. Any
+    // other devices next to it then take a throughput-weighted share.
+    try
+    {
+        if (OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_GPU).empty())
+            throw std::runtime_error("no OpenCL GPU found");
+        if (OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL).size() > 1)
+            return std::make_unique<MultiDeviceDriver>();
+        return std::make_unique<OpenCLDriver>();
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "OpenCL unavailable (" << ex.what() << "), using CPU backend\n";
+    }
+    return std::make_unique<CpuBackend>(cpuThreads);
+}
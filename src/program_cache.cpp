@@ -0,0 +1,219 @@
+#include "program_cache.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+std::string platformInfo(cl_platform_id platform, cl_platform_info param)
+{
+    size_t size = 0;
+    if (clGetPlatformInfo(platform, param, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        return std::string();
+    std::string value(size, '\0');
+    clGetPlatformInfo(platform, param, size, &value[0], nullptr);
+    return value;
+}
+
+std::string deviceInfo(cl_device_id device, cl_device_info param)
+{
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        return std::string();
+    std::string value(size, '\0');
+    clGetDeviceInfo(device, param, size, &value[0], nullptr);
+    return value;
+}
+
+// 64-bit FNV-1a; fields are separated by their terminating NULs
+void hashBytes(uint64_t &hash, const std::string &bytes)
+{
+    for (char c : bytes)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+}
+
+// File name for one cached artifact of device, source and options
+std::string cacheKey(cl_device_id device, const std::string &source, const std::string &options,
+                     const char *extension)
+{
+    cl_platform_id platform = nullptr;
+    clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, nullptr);
+
+    uint64_t hash = 14695981039346656037ull;
+    hashBytes(hash, platformInfo(platform, CL_PLATFORM_NAME));
+    hashBytes(hash, platformInfo(platform, CL_PLATFORM_VERSION));
+    hashBytes(hash, deviceInfo(device, CL_DEVICE_NAME));
+    hashBytes(hash, deviceInfo(device, CL_DEVICE_VENDOR));
+    hashBytes(hash, deviceInfo(device, CL_DEVICE_VERSION));
+    hashBytes(hash, deviceInfo(device, CL_DRIVER_VERSION));
+    hashBytes(hash, options);
+    hashBytes(hash, source);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(hash), extension);
+    return name;
+}
+
+cl_int buildForDevice(cl_program program, cl_device_id device, const std::string &options)
+{
+    return clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+}
+
+cl_program loadCachedProgram(cl_context context, cl_device_id device, const fs::path &path,
+                             const std::string &options)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return nullptr;
+    std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty())
+        return nullptr;
+
+    const unsigned char *data = binary.data();
+    size_t size = binary.size();
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int err;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, &data, &binaryStatus, &err);
+    if (err != CL_SUCCESS || binaryStatus != CL_SUCCESS)
+    {
+        if (program)
+            clReleaseProgram(program);
+        return nullptr;
+    }
+    // Binaries still need a (cheap) build step before kernels can be created
+    if (buildForDevice(program, device, options) != CL_SUCCESS)
+    {
+        clReleaseProgram(program);
+        return nullptr;
+    }
+    return program;
+}
+
+void storeProgram(cl_program program, const fs::path &path)
+{
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, nullptr) != CL_SUCCESS || size == 0)
+        return;
+    std::vector<unsigned char> binary(size);
+    unsigned char *data = binary.data();
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, nullptr) != CL_SUCCESS)
+        return;
+    storeFileAtomically(path.string(), reinterpret_cast<const char *>(binary.data()), binary.size());
+}
+} // namespace
+
+void storeFileAtomically(const std::string &path, const char *data, size_t size)
+{
+    // A private temporary, renamed into place
+    std::error_code ec;
+    fs::path target(path);
+    fs::create_directories(target.parent_path(), ec);
+    fs::path tmp = target;
+    tmp += ".tmp" + std::to_string(std::random_device{}());
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file.write(data, size))
+        {
+            file.close();
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    fs::rename(tmp, target, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+}
+
+std::string programCacheDirectory()
+{
+    if (const char *dir = std::getenv("VIDEO_RESIZER_CACHE_DIR"))
+        return dir;
+#ifdef _WIN32
+    if (const char *local = std::getenv("LOCALAPPDATA"))
+        return (fs::path(local) / "video_resizer" / "kernels").string();
+#else
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"))
+        if (*xdg)
+            return (fs::path(xdg) / "video_resizer" / "kernels").string();
+    if (const char *home = std::getenv("HOME"))
+        return (fs::path(home) / ".cache" / "video_resizer" / "kernels").string();
+#endif
+    return std::string();
+}
+
+cl_program buildProgramCached(cl_context context, cl_device_id device,
+                              const std::string &source, const std::string &options)
+{
+    std::string cacheDir = programCacheDirectory();
+    fs::path cachePath;
+    if (!cacheDir.empty())
+    {
+        cachePath = fs::path(cacheDir) / cacheKey(device, source, options, ".clbin");
+        if (cl_program program = loadCachedProgram(context, device, cachePath, options))
+            return program;
+    }
+
+    const char *src = source.c_str();
+    size_t length = source.size();
+    cl_int err;
+    cl_program program = clCreateProgramWithSource(context, 1, &src, &length, &err);
+    if (err != CL_SUCCESS)
+        throw std::runtime_error("clCreateProgramWithSource failed: " + std::to_string(err));
+    err = buildForDevice(program, device, options);
+    if (err != CL_SUCCESS)
+    {
+        size_t logSize = 0;
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+        std::vector<char> log(logSize + 1, '\0');
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, log.data(), nullptr);
+        std::cerr << log.data() << "\n";
+        clReleaseProgram(program);
+        throw std::runtime_error("clBuildProgram failed: " + std::to_string(err));
+    }
+
+    if (!cachePath.empty())
+        storeProgram(program, cachePath);
+    return program;
+}
+
+// Work-group files hold "<local x> <local y>"
+bool loadCachedLocalSize(cl_device_id device, const std::string &source, const std::string &launchKey,
+                         size_t local[2])
+{
+    std::string cacheDir = programCacheDirectory();
+    if (cacheDir.empty())
+        return false;
+    std::ifstream file(fs::path(cacheDir) / cacheKey(device, source, launchKey, ".wgs"));
+    size_t x = 0, y = 0;
+    if (!(file >> x >> y) || (x == 0) != (y == 0))
+        return false;
+    local[0] = x;
+    local[1] = y;
+    return true;
+}
+
+void storeCachedLocalSize(cl_device_id device, const std::string &source, const std::string &launchKey,
+                          const size_t local[2])
+{
+    std::string cacheDir = programCacheDirectory();
+    if (cacheDir.empty())
+        return;
+    std::string text = std::to_string(local[0]) + " " + std::to_string(local[1]) + "\n";
+    storeFileAtomically((fs::path(cacheDir) / cacheKey(device, source, launchKey, ".wgs")).string(), text.data(),
+                        text.size());
+}
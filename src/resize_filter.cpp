@@ -0,0 +1,201 @@
+#include "resize_filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+const double PI = 3.14159265358979323846;
+
+double triangle(double x)
+{
+    x = std::fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+double cubic(double x)
+{
+    const double a = -0.5;
+    x = std::fabs(x);
+    if (x < 1.0)
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    if (x < 2.0)
+        return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+    return 0.0;
+}
+
+double sinc(double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    x *= PI;
+    return std::sin(x) / x;
+}
+
+double lanczos3(double x)
+{
+    return std::fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+} // namespace
+
+const char *resizeFilterName(ResizeFilter filter)
+{
+    switch (filter)
+    {
+    case ResizeFilter::Fast:
+        return "fast";
+    case ResizeFilter::Bilinear:
+        return "bilinear";
+    case ResizeFilter::Bicubic:
+        return "bicubic";
+    case ResizeFilter::Lanczos:
+        return "lanczos";
+    case ResizeFilter::Area:
+        return "area";
+    default:
+        return "auto";
+    }
+}
+
+ResizeFilter parseResizeFilter(const std::string &name)
+{
+    for (ResizeFilter filter : {ResizeFilter::Auto, ResizeFilter::Fast, ResizeFilter::Bilinear,
+                                ResizeFilter::Bicubic, ResizeFilter::Lanczos, ResizeFilter::Area})
+        if (name == resizeFilterName(filter))
+            return filter;
+    throw std::invalid_argument("Unknown resize filter '" + name +
+                                "' (expected auto, fast, bilinear, bicubic, lanczos or area)");
+}
+
+ResizeFilter resolveResizeFilter(ResizeFilter filter, int srcW, int srcH, int dstW, int dstH)
+{
+    if (filter != ResizeFilter::Auto)
+        return filter;
+    // Four taps per pixel cover a 2x step; past that source pixels are
+    // skipped and the fast kernel starts to alias
+    bool heavyDownscale = srcW > 2 * dstW || srcH > 2 * dstH;
+    return heavyDownscale ? ResizeFilter::Area : ResizeFilter::Fast;
+}
+
+ResizeCoefficients computeResizeCoefficients(int srcSize, int dstSize, ResizeFilter filter)
+{
+    if (srcSize <= 0 || dstSize <= 0)
+        throw std::invalid_argument("Resize sizes must be positive");
+    if (filter == ResizeFilter::Auto || filter == ResizeFilter::Fast)
+        throw std::invalid_argument("No coefficient tables for the fast filter");
+
+    const double scale = (double)srcSize / dstSize;
+    if (filter == ResizeFilter::Area && scale <= 1.0)
+        filter = ResizeFilter::Bilinear; // nothing to average when upscaling
+
+    // Downscaling stretches the filter over the source so every source
+    // sample contributes; that is what removes the aliasing
+    const double stretch = std::max(1.0, scale);
+    double support;
+    switch (filter)
+    {
+    case ResizeFilter::Bicubic:
+        support = 2.0 * stretch;
+        break;
+    case ResizeFilter::Lanczos:
+        support = 3.0 * stretch;
+        break;
+    case ResizeFilter::Area:
+        support = 0.5 * scale;
+        break;
+    default:
+        support = stretch;
+        break;
+    }
+
+    ResizeCoefficients c;
+    c.taps = std::min(srcSize, (int)std::ceil(2.0 * support) + 1);
+    c.offsets.resize(dstSize);
+    c.weights.assign((size_t)dstSize * c.taps, 0);
+
+    std::vector<double> weights(c.taps);
+    for (int i = 0; i < dstSize; ++i)
+    {
+        // Pixel centers are at integer + 0.5 in both grids
+        const double center = (i + 0.5) * scale;
+        const int lo = std::max((int)std::floor(center - support), 0);
+        const int hi = std::min((int)std::ceil(center + support), srcSize) - 1;
+        const int offset = std::max(0, std::min(lo, srcSize - c.taps));
+        std::fill(weights.begin(), weights.end(), 0.0);
+
+        double sum = 0.0;
+        for (int s = (int)std::floor(center - support); s <= (int)std::ceil(center + support); ++s)
+        {
+            double w;
+            if (filter == ResizeFilter::Area)
+            {
+                // Overlap of source pixel [s, s + 1) with this output pixel's footprint
+                double overlap = std::min(s + 1.0, center + support) - std::max((double)s, center - support);
+                w = std::max(overlap, 0.0);
+            }
+            else
+            {
+                double x = (s + 0.5 - center) / stretch;
+                w = filter == ResizeFilter::Bicubic  ? cubic(x)
+                    : filter == ResizeFilter::Lanczos ? lanczos3(x)
+                                                      : triangle(x);
+            }
+            if (w == 0.0)
+                continue;
+            int tap = std::min(std::max(s, lo), hi) - offset; // fold onto the edge
+            weights[tap] += w;
+            sum += w;
+        }
+
+        // Normalize and quantize; the rounding error goes to the largest
+        // tap so the weights sum to exactly one
+        const int one = 1 << RESIZE_WEIGHT_BITS;
+        int16_t *out = &c.weights[(size_t)i * c.taps];
+        int total = 0, largest = 0;
+        for (int t = 0; t < c.taps; ++t)
+        {
+            out[t] = (int16_t)std::lround(weights[t] / sum * one);
+            total += out[t];
+            if (std::abs(out[t]) > std::abs(out[largest]))
+                largest = t;
+        }
+        out[largest] = (int16_t)(out[largest] + one - total);
+        c.offsets[i] = offset;
+    }
+    return c;
+}
+
+void computeOutputSize(int srcW, int srcH, int requestW, int requestH, bool keepAspect,
+                       int &outW, int &outH)
+{
+    double w, h;
+    if (requestW <= 0 && requestH <= 0)
+    {
+        w = srcW / 2;
+        h = srcH / 2;
+    }
+    else if (requestH <= 0)
+    {
+        w = requestW;
+        h = (double)requestW * srcH / srcW;
+    }
+    else if (requestW <= 0)
+    {
+        w = (double)requestH * srcW / srcH;
+        h = requestH;
+    }
+    else if (keepAspect)
+    {
+        double fit = std::min((double)requestW / srcW, (double)requestH / srcH);
+        w = srcW * fit;
+        h = srcH * fit;
+    }
+    else
+    {
+        w = requestW;
+        h = requestH;
+    }
+    outW = std::max(2, (int)std::lround(w) & ~1);
+    outH = std::max(2, (int)std::lround(h) & ~1);
+}
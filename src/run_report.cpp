@@ -0,0 +1,102 @@
+#include "run_report.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+// JSON has no NaN or infinity
+std::string jsonNumber(double value)
+{
+    if (!std::isfinite(value))
+        return "null";
+    std::ostringstream out;
+    out.precision(6);
+    out << value;
+    return out.str();
+}
+} // namespace
+
+std::string jsonQuote(const std::string &value)
+{
+    std::string out = "\"";
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            }
+            else
+                out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void RunReport::set(const std::string &key, const std::string &value)
+{
+    fields_.emplace_back(key, jsonQuote(value));
+}
+
+void RunReport::set(const std::string &key, double value)
+{
+    fields_.emplace_back(key, jsonNumber(value));
+}
+
+void RunReport::addStage(const std::string &name, const LatencyHistogram &latency)
+{
+    if (latency.count() > 0)
+        stages_.emplace_back(name, latency);
+}
+
+std::string RunReport::toJson() const
+{
+    std::ostringstream out;
+    out << "{\n";
+    for (const auto &field : fields_)
+        out << "  " << jsonQuote(field.first) << ": " << field.second << ",\n";
+    out << "  \"stages\": {";
+    for (size_t i = 0; i < stages_.size(); ++i)
+    {
+        const LatencyHistogram &latency = stages_[i].second;
+        out << (i > 0 ? ",\n    " : "\n    ") << jsonQuote(stages_[i].first) << ": {\"count\": " << latency.count()
+            << ", \"mean_ms\": " << jsonNumber(1000.0 * latency.mean())
+            << ", \"p50_ms\": " << jsonNumber(1000.0 * latency.percentile(50))
+            << ", \"p90_ms\": " << jsonNumber(1000.0 * latency.percentile(90))
+            << ", \"p99_ms\": " << jsonNumber(1000.0 * latency.percentile(99))
+            << ", \"max_ms\": " << jsonNumber(1000.0 * latency.max()) << "}";
+    }
+    out << (stages_.empty() ? "}\n" : "\n  }\n") << "}\n";
+    return out.str();
+}
+
+void RunReport::write(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    file << toJson();
+    if (!file)
+        throw std::runtime_error("Cannot write run report " + path);
+}
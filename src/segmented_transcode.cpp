@@ -0,0 +1,237 @@
+#include "segmented_transcode.hpp"
+#include "video_reader.hpp"
+#include "preprocess_backend.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+#ifdef _WIN32
+FILE *openReadPipe(const char *cmd) { return _popen(cmd, "r"); }
+int closePipe(FILE *pipe) { return _pclose(pipe); }
+#else
+FILE *openReadPipe(const char *cmd) { return popen(cmd, "r"); }
+int closePipe(FILE *pipe) { return pclose(pipe); }
+#endif
+
+// <output stem>.segNNN<output extension>, next to the output, so every
+// segment uses the output's container
+std::filesystem::path segmentPath(const std::string &outPath, size_t index)
+{
+    std::filesystem::path out(outPath);
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), ".seg%03zu", index);
+    return out.parent_path() / (out.stem().string() + suffix + out.extension().string());
+}
+
+// Quoting for a path in an ffconcat list: single quotes, with ' as '\''
+std::string concatListQuote(const std::string &path)
+{
+    std::string quoted = "'";
+    for (char c : path)
+    {
+        if (c == '\'')
+            quoted += "'\\''";
+        else
+            quoted += c;
+    }
+    return quoted + "'";
+}
+
+// Removes the intermediate files however runSegmented() exits
+struct TempFiles
+{
+    std::vector<std::filesystem::path> paths;
+    ~TempFiles()
+    {
+        std::error_code ec;
+        for (const std::filesystem::path &path : paths)
+            std::filesystem::remove(path, ec);
+    }
+};
+
+void concatSegments(const std::vector<std::filesystem::path> &segmentFiles, const std::string &outPath,
+                    TempFiles &tempFiles)
+{
+    std::filesystem::path listPath = std::filesystem::path(outPath).string() + ".segments.txt";
+    tempFiles.paths.push_back(listPath);
+    {
+        std::ofstream list(listPath);
+        if (!list)
+            throw std::runtime_error("Cannot write " + listPath.string());
+        list << "ffconcat version 1.0\n";
+        for (const std::filesystem::path &file : segmentFiles)
+            list << "file " << concatListQuote(std::filesystem::absolute(file).string()) << "\n";
+    }
+
+    // Stream copy: packets are remuxed with shifted timestamps, not re-encoded
+    std::string cmd = "ffmpeg -y -v error -f concat -safe 0 -i " + shellQuote(listPath.string()) +
+                      " -c copy " + shellQuote(outPath);
+    if (std::system(cmd.c_str()) != 0)
+        throw std::runtime_error("ffmpeg concat failed for " + outPath);
+}
+} // namespace
+
+KeyframeIndex probeKeyframes(const std::string &path)
+{
+    std::string cmd = "ffprobe -v error -select_streams v:0 -show_entries packet=pts,flags -of csv=p=0 " +
+                      shellQuote(path);
+    FILE *pipe = openReadPipe(cmd.c_str());
+    if (!pipe)
+        throw std::runtime_error("Failed to run ffprobe");
+
+    // Packets come in decode order; a frame's index is the rank of its pts
+    std::vector<std::pair<int64_t, bool>> packets; // pts, keyframe
+    char line[256];
+    while (std::fgets(line, sizeof(line), pipe))
+    {
+        char *end = nullptr;
+        long long pts = std::strtoll(line, &end, 10);
+        if (end == line || *end != ',')
+            continue; // pts N/A
+        const char *flags = end + 1;
+        if (std::strchr(flags, 'D'))
+            continue; // discarded, never displayed
+        packets.emplace_back(pts, flags[0] == 'K');
+    }
+    if (closePipe(pipe) != 0 || packets.empty())
+        throw std::runtime_error("ffprobe found no video frames in " + path);
+
+    std::sort(packets.begin(), packets.end());
+    KeyframeIndex index;
+    index.frameCount = static_cast<int64_t>(packets.size());
+    for (size_t i = 0; i < packets.size(); ++i)
+        if (packets[i].second)
+            index.keyframes.push_back(static_cast<int64_t>(i));
+    return index;
+}
+
+std::vector<Segment> planSegments(const KeyframeIndex &index, size_t segments)
+{
+    std::vector<int64_t> starts{0};
+    const std::vector<int64_t> &keys = index.keyframes;
+    for (size_t i = 1; i < segments; ++i)
+    {
+        int64_t target = index.frameCount * static_cast<int64_t>(i) / static_cast<int64_t>(segments);
+        // Nearest keyframe to the even split point
+        auto it = std::lower_bound(keys.begin(), keys.end(), target);
+        int64_t best = -1;
+        if (it != keys.end())
+            best = *it;
+        if (it != keys.begin() && (best < 0 || target - *(it - 1) <= best - target))
+            best = *(it - 1);
+        if (best > starts.back() && best < index.frameCount)
+            starts.push_back(best);
+    }
+
+    std::vector<Segment> plan;
+    for (size_t i = 0; i < starts.size(); ++i)
+    {
+        int64_t end = i + 1 < starts.size() ? starts[i + 1] : index.frameCount;
+        plan.push_back({starts[i], end - starts[i]});
+    }
+    return plan;
+}
+
+SegmentedStats runSegmented(const std::string &inPath, const std::string &outPath,
+                            const SegmentedOptions &options)
+{
+    if (!options.makeBackends)
+        throw std::invalid_argument("runSegmented needs a backend factory");
+
+    SegmentedStats stats;
+    auto tStart = Clock::now();
+    std::vector<Segment> plan = planSegments(probeKeyframes(inPath), options.segments);
+    stats.probeSec = secondsBetween(tStart, Clock::now());
+
+    // Backends are created up front, one set per segment, so device and
+    // thread pool setup stays out of the segment timings
+    std::vector<std::vector<std::unique_ptr<PreprocessBackend>>> backends;
+    for (size_t i = 0; i < plan.size(); ++i)
+    {
+        backends.push_back(options.makeBackends());
+        if (backends.back().empty())
+            throw std::invalid_argument("Backend factory returned no backends");
+    }
+
+    TempFiles tempFiles;
+    std::vector<std::filesystem::path> segmentFiles;
+    for (size_t i = 0; i < plan.size(); ++i)
+    {
+        segmentFiles.push_back(segmentPath(outPath, i));
+        tempFiles.paths.push_back(segmentFiles.back());
+    }
+
+    stats.segments.resize(plan.size());
+    std::vector<std::exception_ptr> errors(plan.size());
+    std::atomic<size_t> framesEncoded{0};
+    auto tSegments = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < plan.size(); ++i)
+    {
+        threads.emplace_back([&, i]
+                             {
+            try {
+                const Segment &segment = plan[i];
+                const bool last = i + 1 == plan.size();
+                VideoReader reader(inPath, options.reader);
+                if (!reader.seekToFrame(segment.startFrame))
+                    throw std::runtime_error("Cannot seek to frame " + std::to_string(segment.startFrame));
+                Encoder encoder(segmentFiles[i].string(), options.pipeline.outWidth, options.pipeline.outHeight,
+                                reader.getFPS(), options.encoder);
+
+                std::vector<PreprocessBackend *> processors;
+                for (const std::unique_ptr<PreprocessBackend> &backend : backends[i])
+                    processors.push_back(backend.get());
+                PipelineOptions pipelineOptions = options.pipeline;
+                // The last segment runs to the end in case the probe
+                // undercounted; the others must stop exactly at the next
+                // segment's first frame
+                pipelineOptions.maxFrames = last ? 0 : static_cast<size_t>(segment.frameCount);
+                pipelineOptions.onFrameEncoded = [&](size_t)
+                {
+                    size_t total = ++framesEncoded;
+                    if (options.pipeline.onFrameEncoded)
+                        options.pipeline.onFrameEncoded(total);
+                };
+
+                stats.segments[i].segment = segment;
+                stats.segments[i].pipeline = runPipeline(reader, processors, encoder, pipelineOptions);
+                if (!last && stats.segments[i].pipeline.framesProcessed != static_cast<size_t>(segment.frameCount))
+                    throw std::runtime_error("Segment " + std::to_string(i) + " decoded " +
+                                             std::to_string(stats.segments[i].pipeline.framesProcessed) + " of " +
+                                             std::to_string(segment.frameCount) + " frames");
+            } catch (...) {
+                errors[i] = std::current_exception();
+            } });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    stats.segmentsWallSec = secondsBetween(tSegments, Clock::now());
+    for (const std::exception_ptr &error : errors)
+        if (error)
+            std::rethrow_exception(error);
+
+    for (const SegmentedStats::SegmentStats &segment : stats.segments)
+    {
+        stats.framesProcessed += segment.pipeline.framesProcessed;
+        stats.segmentSecSum += segment.pipeline.totalSec;
+    }
+
+    auto tConcat = Clock::now();
+    concatSegments(segmentFiles, outPath, tempFiles);
+    stats.concatSec = secondsBetween(tConcat, Clock::now());
+    stats.totalSec = secondsBetween(tStart, Clock::now());
+    return stats;
+}
@@ -0,0 +1,153 @@
+#include "trace.hpp"
+#include "run_report.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+struct TraceEvent
+{
+    const char *name;
+    int64_t frame;
+    int64_t startNs;
+    int64_t endNs;
+};
+
+// Written only by its own thread; size is published with release so
+// writeTrace() sees complete events
+struct ThreadBuffer
+{
+    explicit ThreadBuffer(size_t capacity, uint32_t tid)
+        : events(new TraceEvent[capacity]), capacity(capacity), tid(tid) {}
+
+    std::unique_ptr<TraceEvent[]> events;
+    const size_t capacity;
+    const uint32_t tid;
+    std::atomic<size_t> size{0};
+    std::atomic<size_t> dropped{0};
+    std::string name; // guarded by registryMutex
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers; // kept after their threads exit
+size_t bufferCapacity = 0;
+int64_t epochNs = 0;
+// Bumped by resetTracing(); a thread's buffer from an older generation is gone
+std::atomic<uint64_t> generation{0};
+
+thread_local ThreadBuffer *localBuffer = nullptr;
+thread_local uint64_t localGeneration = 0;
+
+ThreadBuffer &threadBuffer()
+{
+    if (!localBuffer || localGeneration != generation.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>(bufferCapacity, static_cast<uint32_t>(buffers.size() + 1)));
+        localBuffer = buffers.back().get();
+        localGeneration = generation.load(std::memory_order_relaxed);
+    }
+    return *localBuffer;
+}
+
+// Microseconds with nanosecond digits, as trace-event "ts" and "dur" want
+std::string micros(int64_t ns)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", ns / 1000.0);
+    return text;
+}
+} // namespace
+
+namespace trace_detail
+{
+std::atomic<bool> enabled{false};
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void record(const char *name, int64_t frame, int64_t startNs, int64_t endNs)
+{
+    ThreadBuffer &buffer = threadBuffer();
+    size_t index = buffer.size.load(std::memory_order_relaxed);
+    if (index == buffer.capacity)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[index] = {name, frame, startNs, endNs};
+    buffer.size.store(index + 1, std::memory_order_release);
+}
+} // namespace trace_detail
+
+void enableTracing(size_t eventsPerThread)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (trace_detail::enabled.load())
+        return;
+    bufferCapacity = eventsPerThread;
+    epochNs = trace_detail::nowNs();
+    trace_detail::enabled.store(true);
+}
+
+void resetTracing()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    trace_detail::enabled.store(false);
+    buffers.clear();
+    bufferCapacity = 0;
+    generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+void setTraceThreadName(const std::string &name)
+{
+    if (!tracingEnabled())
+        return;
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer.name = name;
+}
+
+void writeTrace(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::ofstream file(path, std::ios::binary);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char *separator = "\n";
+    size_t dropped = 0;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : buffers)
+    {
+        if (!buffer->name.empty())
+        {
+            file << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+                 << ", \"args\": {\"name\": " << jsonQuote(buffer->name) << "}}";
+            separator = ",\n";
+        }
+        size_t size = buffer->size.load(std::memory_order_acquire);
+        for (size_t i = 0; i < size; ++i)
+        {
+            const TraceEvent &event = buffer->events[i];
+            file << separator << "{\"name\": " << jsonQuote(event.name)
+                 << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+                 << ", \"ts\": " << micros(event.startNs - epochNs)
+                 << ", \"dur\": " << micros(event.endNs - event.startNs);
+            if (event.frame >= 0)
+                file << ", \"args\": {\"frame\": " << event.frame << "}";
+            file << "}";
+            separator = ",\n";
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    file << "\n], \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+    if (!file)
+        throw std::runtime_error("Cannot write trace " + path);
+}
@@ -1,28 +1,272 @@
 #include "video_reader.hpp"
+#include "encoder.hpp"
+#include "timing.hpp"
+#include <chrono>
+#include <sstream>
 #include <stdexcept>
 
-VideoReader::VideoReader(const std::string &path)
-    : cap_(path)
+namespace
 {
+#ifdef _WIN32
+FILE *openReadPipe(const char *cmd) { return _popen(cmd, "rb"); }
+int closePipe(FILE *pipe) { return _pclose(pipe); }
+#else
+FILE *openReadPipe(const char *cmd) { return popen(cmd, "r"); }
+int closePipe(FILE *pipe) { return pclose(pipe); }
+#endif
+} // namespace
+
+VideoReader::VideoReader(const std::string &path, PixelFormat format)
+    : VideoReader(path, Options{format})
+{
+}
+
+VideoReader::VideoReader(const std::string &path, const Options &options)
+    : options_(options), path_(path)
+{
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+    std::vector<int> params;
+    if (options_.decodeThreads > 0 && options_.format == PixelFormat::BGR)
+        params = {cv::CAP_PROP_N_THREADS, options_.decodeThreads};
+    cap_.open(path, cv::CAP_ANY, params);
+#else
+    // No CAP_PROP_N_THREADS before OpenCV 4.6; FFmpeg picks its own count
+    cap_.open(path);
+#endif
     if (!cap_.isOpened())
         throw std::runtime_error("Failed to open video file");
+    width_ = static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH));
+    height_ = static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT));
+    fps_ = cap_.get(cv::CAP_PROP_FPS);
+    frameCount_ = static_cast<int64_t>(cap_.get(cv::CAP_PROP_FRAME_COUNT));
+    if (options_.format == PixelFormat::I420)
+    {
+        // OpenCV still provides the stream properties; only the pixels
+        // come from ffmpeg
+        if (width_ % 2 != 0 || height_ % 2 != 0)
+            throw std::invalid_argument("I420 decoding needs an even frame size, got " + std::to_string(width_) +
+                                        "x" + std::to_string(height_));
+        startDecoder(0.0);
+    }
+    startReadAhead();
+}
+
+VideoReader::~VideoReader()
+{
+    stopReadAhead();
+    stopDecoder();
+}
+
+void VideoReader::startDecoder(double startSec)
+{
+    stopDecoder();
+    // -vsync 0 passes frames through as decoded, without the duplicates
+    // or drops a constant-rate output would add
+    std::ostringstream cmd;
+    cmd << "ffmpeg -nostdin -v error";
+    if (options_.decodeThreads > 0)
+        cmd << " -threads " << options_.decodeThreads;
+    if (startSec > 0.0)
+        cmd << " -ss " << std::to_string(startSec);
+    cmd << " -i " << shellQuote(path_) << " -map 0:v:0 -vsync 0 -f rawvideo -pix_fmt yuv420p -";
+    decoder_ = openReadPipe(cmd.str().c_str());
+    if (!decoder_)
+        throw std::runtime_error("Failed to start ffmpeg decoder for " + path_);
+}
+
+int VideoReader::stopDecoder()
+{
+    int status = decoder_ ? closePipe(decoder_) : 0;
+    decoder_ = nullptr;
+    return status;
+}
+
+// Decode one frame on the calling thread. grab() and retrieve() are timed
+// apart so demux/decode and the BGR conversion show up separately.
+bool VideoReader::decodeFrame(cv::Mat &frame)
+{
+    auto t0 = Clock::now();
+    bool ok;
+    double convertSec = 0.0;
+    if (options_.format == PixelFormat::BGR)
+    {
+        ok = cap_.grab();
+        if (ok)
+        {
+            auto t1 = Clock::now();
+            ok = cap_.retrieve(frame);
+            convertSec = secondsBetween(t1, Clock::now());
+        }
+    }
+    else
+    {
+        frame.create(frameRows(), width_, CV_8UC1);
+        size_t size = frame.total();
+        ok = decoder_ && std::fread(frame.data, 1, size, decoder_) == size;
+        // A short read is the end of ffmpeg's output; its exit status
+        // tells the end of the stream from a decode error
+        if (!ok && decoder_)
+        {
+            int status = stopDecoder();
+            if (status != 0)
+                throw std::runtime_error("ffmpeg failed to decode " + path_ + " (exit status " +
+                                         std::to_string(status) + ")");
+        }
+    }
+    double totalSec = secondsBetween(t0, Clock::now());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.decodeSec += totalSec - convertSec;
+    stats_.convertSec += convertSec;
+    if (ok && ring_.empty())
+        ++stats_.frames;
+    return ok;
+}
+
+void VideoReader::startReadAhead()
+{
+    if (options_.readAhead == 0)
+        return;
+    ring_.resize(options_.readAhead);
+    for (cv::Mat &mat : ring_)
+        mat.create(frameRows(), width_, frameType());
+    head_ = count_ = 0;
+    ended_ = stopping_ = false;
+    error_ = nullptr;
+    readAheadThread_ = std::thread(&VideoReader::readAheadLoop, this);
+}
+
+void VideoReader::stopReadAhead()
+{
+    if (!readAheadThread_.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    slotFree_.notify_one();
+    readAheadThread_.join();
+}
+
+void VideoReader::readAheadLoop()
+{
+    for (;;)
+    {
+        cv::Mat *slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto t0 = Clock::now();
+            slotFree_.wait(lock, [this] { return stopping_ || count_ < ring_.size(); });
+            stats_.fullSec += secondsBetween(t0, Clock::now());
+            if (stopping_)
+                return;
+            slot = &ring_[(head_ + count_) % ring_.size()];
+        }
+        // The slot stays invisible to getNextFrame() until count_ covers it
+        bool ok = false;
+        std::exception_ptr error;
+        try
+        {
+            ok = decodeFrame(*slot);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ok)
+                ++count_;
+            else
+            {
+                ended_ = true;
+                error_ = error; // handed to the caller after the frames before it
+            }
+        }
+        frameReady_.notify_one();
+        if (!ok)
+            return;
+    }
 }
 
 bool VideoReader::getNextFrame(cv::Mat &frame)
 {
-    return cap_.read(frame);
+    if (ring_.empty())
+        return decodeFrame(frame);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto t0 = Clock::now();
+    frameReady_.wait(lock, [this] { return count_ > 0 || ended_; });
+    stats_.stallSec += secondsBetween(t0, Clock::now());
+    if (count_ == 0)
+    {
+        if (error_)
+            std::rethrow_exception(error_);
+        return false;
+    }
+    std::swap(frame, ring_[head_]);
+    head_ = (head_ + 1) % ring_.size();
+    --count_;
+    ++stats_.frames;
+    lock.unlock();
+    slotFree_.notify_one();
+    return true;
 }
+
+bool VideoReader::seekToFrame(int64_t frameIndex)
+{
+    // Frames already decoded ahead belong to the old position
+    stopReadAhead();
+    bool ok;
+    if (options_.format == PixelFormat::I420)
+    {
+        // ffmpeg seeks exactly when decoding; start half a frame early so
+        // timestamp rounding cannot skip the target
+        ok = frameIndex >= 0 && fps_ > 0.0;
+        if (ok)
+            startDecoder(frameIndex > 0 ? (frameIndex - 0.5) / fps_ : 0.0);
+    }
+    else if (frameIndex == 0 && cap_.get(cv::CAP_PROP_POS_FRAMES) == 0.0)
+        ok = true;
+    else
+        ok = cap_.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frameIndex)) &&
+             static_cast<int64_t>(cap_.get(cv::CAP_PROP_POS_FRAMES)) == frameIndex;
+    startReadAhead();
+    return ok;
+}
+
 int VideoReader::getWidth() const
 {
-    return static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH));
+    return width_;
 }
 
 int VideoReader::getHeight() const
 {
-    return static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT));
+    return height_;
 }
 
 double VideoReader::getFPS() const
 {
-    return cap_.get(cv::CAP_PROP_FPS);
-}
\ No newline at end of file
+    return fps_;
+}
+
+int64_t VideoReader::getFrameCount() const
+{
+    return frameCount_;
+}
+
+int VideoReader::frameRows() const
+{
+    return options_.format == PixelFormat::I420 ? height_ * 3 / 2 : height_;
+}
+
+int VideoReader::frameType() const
+{
+    return options_.format == PixelFormat::I420 ? CV_8UC1 : CV_8UC3;
+}
+
+VideoReader::Stats VideoReader::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -1,27 +1,361 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <thread>
 #include <opencv2/opencv.hpp>
 #include "opencl_driver.hpp"
+#include "cpu_backend.hpp"
+#include "multi_device_driver.hpp"
 #include "video_reader.hpp"
 #include "encoder.hpp"
+#include "pipeline.hpp"
+#include "reorder_buffer.hpp"
+#include "segmented_transcode.hpp"
+#include "batch.hpp"
+#include "resize_filter.hpp"
+#include "latency_histogram.hpp"
+#include "run_report.hpp"
+#include "trace.hpp"
+#include "job_server.hpp"
+#include "pipeline_tuning.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Count every heap allocation in the test binary so pipeline tests can
+// check the steady state does none
+static std::atomic<size_t> heapAllocations{0};
+
+void *operator new(std::size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+// First OpenCL device of any type, or nullptr if there is none
+static cl_device_id firstOpenCLDevice()
+{
+    std::vector<cl_device_id> devices = OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL);
+    return devices.empty() ? nullptr : devices.front();
+}
 
 // Test that OpenCLDriver resizes correctly
 TEST(OpenCLDriverTest, ResizesFrameToHalf)
 {
-    OpenCLDriver driver;
+    cl_device_id device = firstOpenCLDevice();
+    if (!device)
+        GTEST_SKIP() << "No OpenCL device";
+    OpenCLDriver driver(device);
 
     // Create a dummy 640x480 BGR image
     int inputW = 640, inputH = 480;
     cv::Mat input(inputH, inputW, CV_8UC3, cv::Scalar(100, 150, 200));
 
     std::vector<uint8_t> yuvOutput;
-    driver.setOutputSize(inputW / 2, inputH / 2);
-    driver.processFrame(input, yuvOutput);
+    driver.processFrame(input, yuvOutput, inputW / 2, inputH / 2);
 
     // YUV420p = Y (w*h) + U (w*h/4) + V (w*h/4)
     size_t expectedSize = (inputW / 2) * (inputH / 2) * 3 / 2;
     ASSERT_EQ(yuvOutput.size(), expectedSize);
 }
 
+// Test that every CPU kernel variant matches the OpenCL kernel within 1 LSB
+TEST(CpuBackendTest, MatchesOpenCLWithinOneLSB)
+{
+    // Any device will do, so CPU-only OpenCL hosts check the tolerance too
+    cl_device_id device = firstOpenCLDevice();
+    if (!device)
+        GTEST_SKIP() << "No OpenCL device";
+    std::unique_ptr<OpenCLDriver> driver = std::make_unique<OpenCLDriver>(device);
+
+    int inputW = 1280, inputH = 720, outW = 642, outH = 362;
+    cv::Mat input(inputH, inputW, CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+
+    // The CPU kernels mirror the direct kernel's float math
+    driver->setFastKernel(OpenCLDriver::FastKernel::Direct);
+    std::vector<uint8_t> expected;
+    driver->processFrame(input, expected, outW, outH);
+
+    for (CpuIsa isa : {CpuIsa::Scalar, CpuIsa::SSE41, CpuIsa::AVX2, CpuIsa::AVX512})
+    {
+        std::unique_ptr<CpuBackend> cpu;
+        try
+        {
+            cpu = std::make_unique<CpuBackend>(0, isa);
+        }
+        catch (const std::exception &)
+        {
+            continue; // not supported on this machine
+        }
+
+        std::vector<uint8_t> actual;
+        cpu->processFrame(input, actual, outW, outH);
+        ASSERT_EQ(actual.size(), expected.size()) << cpu->name();
+        for (size_t i = 0; i < expected.size(); ++i)
+            ASSERT_LE(std::abs(actual[i] - expected[i]), 1) << cpu->name() << " at byte " << i;
+    }
+}
+
+// Test that the tiled local-memory kernel matches the direct kernel within
+// 1 LSB, including sizes that leave partial work-groups and an upscale
+TEST(OpenCLDriverTest, TiledKernelMatchesDirectWithinOneLSB)
+{
+    cl_device_id device = firstOpenCLDevice();
+    if (!device)
+        GTEST_SKIP() << "No OpenCL device";
+    OpenCLDriver direct(device), tiled(device);
+    direct.setFastKernel(OpenCLDriver::FastKernel::Direct);
+    tiled.setFastKernel(OpenCLDriver::FastKernel::Tiled);
+
+    int inputW = 1280, inputH = 720;
+    cv::Mat input(inputH, inputW, CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+
+    const int sizes[][2] = {{640, 360}, {642, 362}, {1000, 562}, {1920, 1080}};
+    for (const auto &size : sizes)
+    {
+        int outW = size[0], outH = size[1];
+        if (!tiled.usesTiledKernel(inputW, inputH, outW, outH))
+            continue; // tile does not fit this device's local memory
+
+        std::vector<uint8_t> expected, actual;
+        direct.processFrame(input, expected, outW, outH);
+        tiled.processFrame(input, actual, outW, outH);
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+            ASSERT_LE(std::abs(actual[i] - expected[i]), 1) << outW << "x" << outH << " at byte " << i;
+    }
+}
+
+// Points VIDEO_RESIZER_CACHE_DIR at an empty private directory, and puts
+// the variable back and removes the directory when done
+class ScopedCacheDir
+{
+public:
+    explicit ScopedCacheDir(const std::string &name)
+        : dir_(std::filesystem::temp_directory_path() / name)
+    {
+        const char *previous = std::getenv("VIDEO_RESIZER_CACHE_DIR");
+        hadPrevious_ = previous != nullptr;
+        if (hadPrevious_)
+            previous_ = previous;
+        std::filesystem::remove_all(dir_);
+        set(dir_.string().c_str());
+    }
+
+    ~ScopedCacheDir()
+    {
+        set(hadPrevious_ ? previous_.c_str() : nullptr);
+        std::error_code ec;
+        std::filesystem::remove_all(dir_, ec);
+    }
+
+    const std::filesystem::path &path() const { return dir_; }
+
+private:
+    static void set(const char *value)
+    {
+#ifdef _WIN32
+        _putenv_s("VIDEO_RESIZER_CACHE_DIR", value ? value : "");
+#else
+        if (value)
+            setenv("VIDEO_RESIZER_CACHE_DIR", value, 1);
+        else
+            unsetenv("VIDEO_RESIZER_CACHE_DIR");
+#endif
+    }
+
+    std::filesystem::path dir_;
+    std::string previous_;
+    bool hadPrevious_ = false;
+};
+
+// Test that tuned work-groups over a padded grid give the same bytes as the
+// runtime's choice, both when benchmarked and when read back from the cache
+TEST(OpenCLDriverTest, TunedWorkGroupsMatchRuntimeChoice)
+{
+    cl_device_id device = firstOpenCLDevice();
+    if (!device)
+        GTEST_SKIP() << "No OpenCL device";
+    // A fresh cache, so run 0 benchmarks and run 1 reads what it saved
+    ScopedCacheDir cache("video_resizer_wgs_test");
+    OpenCLDriver untuned(device);
+    untuned.setWorkGroupTuning(false);
+
+    int inputW = 1280, inputH = 720, outW = 642, outH = 362;
+    cv::Mat input(inputH, inputW, CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+
+    for (ResizeFilter filter : {ResizeFilter::Fast, ResizeFilter::Lanczos})
+    {
+        untuned.setResizeFilter(filter);
+        untuned.setFastKernel(OpenCLDriver::FastKernel::Direct);
+        std::vector<uint8_t> expected;
+        untuned.processFrame(input, expected, outW, outH);
+        for (int run = 0; run < 2; ++run)
+        {
+            OpenCLDriver tuned(device);
+            tuned.setResizeFilter(filter);
+            tuned.setFastKernel(OpenCLDriver::FastKernel::Direct);
+            std::vector<uint8_t> actual;
+            tuned.processFrame(input, actual, outW, outH);
+            ASSERT_EQ(actual, expected) << resizeFilterName(filter) << " run " << run;
+            if (run == 0)
+            {
+                auto files = std::filesystem::recursive_directory_iterator(cache.path());
+                ASSERT_TRUE(std::any_of(begin(files), end(files), [](const std::filesystem::directory_entry &entry)
+                                        { return entry.path().extension() == ".wgs"; }))
+                    << "no work-group sizes saved in " << cache.path();
+            }
+        }
+    }
+}
+
+// A file in the temp directory, removed when the test ends however it ends
+class ScopedTempFile
+{
+public:
+    explicit ScopedTempFile(const std::string &name)
+        : path_((std::filesystem::temp_directory_path() / name).string())
+    {
+    }
+
+    ~ScopedTempFile()
+    {
+        std::error_code ec;
+        std::filesystem::remove(path_, ec);
+    }
+
+    ScopedTempFile(const ScopedTempFile &) = delete;
+    ScopedTempFile &operator=(const ScopedTempFile &) = delete;
+
+    const std::string &path() const { return path_; }
+
+private:
+    std::string path_;
+};
+
+// Write frameCount random BGR frames as an MJPG clip; false if OpenCV
+// cannot write one here
+static bool writeSyntheticClip(const std::string &path, int width, int height, int frameCount)
+{
+    cv::VideoWriter writer(path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 30.0, cv::Size(width, height));
+    if (!writer.isOpened())
+        return false;
+    cv::Mat frame(height, width, CV_8UC3);
+    for (int i = 0; i < frameCount; ++i)
+    {
+        cv::randu(frame, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+        writer.write(frame);
+    }
+    return true;
+}
+
+// Test that frames sharded across two sub-devices come back in order and
+// match a single-device run
+TEST(MultiDeviceDriverTest, SubDevicesMatchSingleDevice)
+{
+    std::vector<cl_device_id> subDevices;
+    cl_device_id root = nullptr;
+    for (cl_device_id device : OpenCLDriver::enumerateDevices(CL_DEVICE_TYPE_ALL))
+    {
+        cl_uint computeUnits = 0;
+        clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, nullptr);
+        if (computeUnits < 2)
+            continue;
+        const cl_device_partition_property props[] = {CL_DEVICE_PARTITION_EQUALLY,
+                                                      static_cast<cl_device_partition_property>(computeUnits / 2), 0};
+        cl_device_id parts[2];
+        cl_uint count = 0;
+        if (clCreateSubDevices(device, props, 2, parts, &count) == CL_SUCCESS && count == 2)
+        {
+            root = device;
+            subDevices.assign(parts, parts + 2);
+            break;
+        }
+    }
+    if (subDevices.empty())
+        GTEST_SKIP() << "No OpenCL device supports CL_DEVICE_PARTITION_EQUALLY";
+
+    {
+        OpenCLDriver single(root);
+        MultiDeviceDriver multi(subDevices, 2);
+        ASSERT_EQ(multi.deviceCount(), 2u);
+
+        int inputW = 640, inputH = 360, outW = 320, outH = 180;
+        std::vector<cv::Mat> inputs(24);
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            inputs[i].create(inputH, inputW, CV_8UC3);
+            cv::randu(inputs[i], cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+        }
+
+        // Keep every slot busy so both devices get work
+        std::vector<PreprocessBackend::FrameTicket> tickets;
+        size_t next = 0;
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            if (tickets.size() - next == multi.slotCount())
+            {
+                std::vector<uint8_t> expected, actual;
+                single.processFrame(inputs[next], expected, outW, outH);
+                multi.waitFrame(tickets[next], actual);
+                ASSERT_EQ(actual, expected) << "frame " << next;
+                ++next;
+            }
+            tickets.push_back(multi.submitFrame(inputs[i], outW, outH));
+        }
+        for (; next < tickets.size(); ++next)
+        {
+            std::vector<uint8_t> expected, actual;
+            single.processFrame(inputs[next], expected, outW, outH);
+            multi.waitFrame(tickets[next], actual);
+            ASSERT_EQ(actual, expected) << "frame " << next;
+        }
+
+        for (const MultiDeviceDriver::DeviceStats &device : multi.deviceStats())
+            EXPECT_GT(device.frames, 0u) << device.name;
+
+        // A frame a device fails on (its output is larger than any device
+        // can allocate) ends runPipeline with the error, and the driver
+        // runs the next job
+        ScopedTempFile clip("multi_device_test_input.avi"), output("multi_device_test_output.mp4");
+        EXPECT_TRUE(writeSyntheticClip(clip.path(), inputW, inputH, static_cast<int>(inputs.size())))
+            << "Cannot write " << clip.path();
+        auto run = [&](int width, int height)
+        {
+            VideoReader reader(clip.path());
+            Encoder encoder(output.path(), outW, outH, reader.getFPS());
+            PipelineOptions options;
+            options.outWidth = width;
+            options.outHeight = height;
+            return runPipeline(reader, multi, encoder, options);
+        };
+        EXPECT_THROW(run(1 << 17, 1 << 17), std::runtime_error);
+        EXPECT_EQ(run(outW, outH).framesProcessed, inputs.size());
+    }
+
+    for (cl_device_id device : subDevices)
+        clReleaseDevice(device);
+}
+
 // Test that VideoReader reads frames
 TEST(VideoReaderTest, LoadsFirstFrame)
 {
@@ -33,6 +367,37 @@ TEST(VideoReaderTest, LoadsFirstFrame)
     ASSERT_FALSE(frame.empty());
 }
 
+// Test that frames decoded ahead on the background thread are the ones
+// the caller's thread decodes, in the same order
+TEST(VideoReaderTest, ReadAheadMatchesDirectDecode)
+{
+    ScopedTempFile sample("read_ahead_test_input.avi");
+    const int frameCount = 30;
+    if (!writeSyntheticClip(sample.path(), 320, 180, frameCount))
+        GTEST_SKIP() << "Cannot write " << sample.path();
+
+    {
+        VideoReader direct(sample.path());
+        VideoReader::Options options;
+        options.readAhead = 3;
+        options.decodeThreads = 2;
+        VideoReader ahead(sample.path(), options);
+
+        cv::Mat expected, actual;
+        size_t frames = 0;
+        for (; direct.getNextFrame(expected); ++frames)
+        {
+            ASSERT_TRUE(ahead.getNextFrame(actual)) << "frame " << frames;
+            ASSERT_EQ(cv::norm(expected, actual, cv::NORM_INF), 0.0) << "frame " << frames;
+        }
+        EXPECT_EQ(frames, static_cast<size_t>(frameCount));
+        EXPECT_FALSE(ahead.getNextFrame(actual)); // ends with the direct decode
+        VideoReader::Stats stats = ahead.stats();
+        EXPECT_EQ(stats.frames, frames);
+        EXPECT_GT(stats.decodeSec, 0.0);
+    }
+}
+
 // Optional: minimal encoder pipeline test
 TEST(EncoderTest, InitializesEncoder)
 {
@@ -48,3 +413,734 @@ TEST(EncoderTest, InitializesEncoder)
     std::ifstream outFile(outputPath);
     ASSERT_TRUE(outFile.good());
 }
+
+// cv::Mat buffers come from OpenCV's allocator, not operator new
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    mutable std::atomic<size_t> allocations{0};
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        if (!data)
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+    bool allocate(cv::UMatData *data, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getStdAllocator()->allocate(data, flags, usageFlags);
+    }
+    void deallocate(cv::UMatData *data) const override
+    {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+// Test that once the frame pool and queues are warm, moving a frame through
+// read -> preprocess -> encode allocates nothing
+TEST(PipelineTest, NoAllocationsPerFrameAfterWarmup)
+{
+    ScopedTempFile input("alloc_test_input.avi"), output("alloc_test_output.mp4");
+    const int inputW = 640, inputH = 360, frameCount = 60, warmupFrames = 10;
+    if (!writeSyntheticClip(input.path(), inputW, inputH, frameCount))
+        GTEST_SKIP() << "Cannot write " << input.path();
+
+    VideoReader reader(input.path());
+    CpuBackend backend;
+    int outW = inputW / 2, outH = inputH / 2;
+    Encoder encoder(output.path(), outW, outH, reader.getFPS());
+
+    CountingMatAllocator matAllocator;
+    cv::Mat::setDefaultAllocator(&matAllocator);
+
+    size_t heapAtWarmup = 0, matAtWarmup = 0, heapAtEnd = 0, matAtEnd = 0, encoded = 0;
+    PipelineOptions options;
+    options.outWidth = outW;
+    options.outHeight = outH;
+    options.onFrameEncoded = [&](size_t frames)
+    {
+        encoded = frames;
+        if (frames == warmupFrames)
+        {
+            heapAtWarmup = heapAllocations.load();
+            matAtWarmup = matAllocator.allocations.load();
+        }
+        heapAtEnd = heapAllocations.load();
+        matAtEnd = matAllocator.allocations.load();
+    };
+    runPipeline(reader, backend, encoder, options);
+    cv::Mat::setDefaultAllocator(nullptr);
+
+    ASSERT_EQ(encoded, static_cast<size_t>(frameCount));
+    EXPECT_EQ(heapAtEnd - heapAtWarmup, 0u) << "heap allocations after warm-up";
+    EXPECT_EQ(matAtEnd - matAtWarmup, 0u) << "cv::Mat allocations after warm-up";
+}
+
+// CPU backend whose submission number failAt throws, as a device error would
+class FailingBackend : public CpuBackend
+{
+public:
+    explicit FailingBackend(size_t failAt) : failAt_(failAt) {}
+
+    FrameTicket submitFrame(const cv::Mat &input, int targetWidth, int targetHeight) override
+    {
+        if (submitted_++ == failAt_)
+            throw std::runtime_error("backend failed");
+        return CpuBackend::submitFrame(input, targetWidth, targetHeight);
+    }
+
+private:
+    size_t failAt_;
+    size_t submitted_ = 0;
+};
+
+// Test that an error in a worker or in the encoder stage ends runPipeline
+// with that error instead of terminating the process, and that the backend
+// can run the next job afterwards
+TEST(PipelineTest, StageErrorsReachTheCaller)
+{
+    ScopedTempFile input("error_test_input.avi"), output("error_test_output.mp4");
+    const int inputW = 320, inputH = 180, frameCount = 30;
+    if (!writeSyntheticClip(input.path(), inputW, inputH, frameCount))
+        GTEST_SKIP() << "Cannot write " << input.path();
+
+    PipelineOptions options;
+    options.outWidth = inputW / 2;
+    options.outHeight = inputH / 2;
+    auto run = [&](const std::vector<PreprocessBackend *> &backends, const PipelineOptions &pipelineOptions)
+    {
+        VideoReader reader(input.path());
+        Encoder encoder(output.path(), pipelineOptions.outWidth, pipelineOptions.outHeight, reader.getFPS());
+        return runPipeline(reader, backends, encoder, pipelineOptions);
+    };
+
+    FailingBackend failing(10);
+    try
+    {
+        run({&failing}, options);
+        ADD_FAILURE() << "worker error was not reported";
+    }
+    catch (const std::runtime_error &ex)
+    {
+        EXPECT_STREQ(ex.what(), "backend failed");
+    }
+    EXPECT_EQ(run({&failing}, options).framesProcessed, static_cast<size_t>(frameCount));
+
+    CpuBackend first, second;
+    PipelineOptions failingEncode = options;
+    failingEncode.onFrameEncoded = [](size_t frames)
+    {
+        if (frames == 5)
+            throw std::runtime_error("encoder failed");
+    };
+    try
+    {
+        run({&first, &second}, failingEncode);
+        ADD_FAILURE() << "encoder error was not reported";
+    }
+    catch (const std::runtime_error &ex)
+    {
+        EXPECT_STREQ(ex.what(), "encoder failed");
+    }
+    EXPECT_EQ(run({&first, &second}, options).framesProcessed, static_cast<size_t>(frameCount));
+}
+
+// Test that one ladder submission produces the same frames as a
+// submitFrame() per size, on the default path (CPU) and on OpenCL
+TEST(PreprocessBackendTest, RenditionsMatchSingleFrames)
+{
+    std::vector<std::unique_ptr<PreprocessBackend>> backends;
+    backends.push_back(std::make_unique<CpuBackend>());
+    if (cl_device_id device = firstOpenCLDevice())
+        backends.push_back(std::make_unique<OpenCLDriver>(device));
+
+    cv::Mat input(360, 640, CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+    const std::vector<PreprocessBackend::OutputSize> sizes = {{480, 270}, {320, 180}, {160, 90}};
+    for (std::unique_ptr<PreprocessBackend> &backend : backends)
+    {
+        // The second round reuses the slots and their outputs
+        for (int round = 0; round < 2; ++round)
+        {
+            std::vector<YuvFrame> frames;
+            backend->waitRenditions(backend->submitRenditions(input, sizes), sizes.size(), frames);
+            ASSERT_EQ(frames.size(), sizes.size());
+            std::vector<std::vector<uint8_t>> ladder;
+            for (const YuvFrame &frame : frames)
+                ladder.emplace_back(frame.data(), frame.data() + frame.size());
+            frames.clear();
+
+            for (size_t i = 0; i < sizes.size(); ++i)
+            {
+                std::vector<uint8_t> single;
+                backend->processFrame(input, single, sizes[i].width, sizes[i].height);
+                EXPECT_EQ(ladder[i], single) << backend->name() << " " << sizes[i].width << "x" << sizes[i].height;
+            }
+        }
+    }
+    EXPECT_THROW(backends.front()->submitRenditions(input, std::vector<PreprocessBackend::OutputSize>(5, sizes[0])),
+                 std::invalid_argument);
+    for (std::unique_ptr<PreprocessBackend> &backend : backends)
+    {
+        PreprocessBackend::FrameTicket ticket = backend->submitFrame(input, sizes[0].width, sizes[0].height);
+        EXPECT_THROW(backend->waitMappedFrame(ticket + 1), std::runtime_error) << backend->name(); // never submitted
+        backend->waitMappedFrame(ticket);
+    }
+}
+
+// Test that the polyphase CPU path matches the two-pass OpenCL kernels for
+// every filter on a heavy downscale
+TEST(CpuBackendTest, PolyphaseMatchesOpenCLWithinOneLSB)
+{
+    cl_device_id device = firstOpenCLDevice();
+    if (!device)
+        GTEST_SKIP() << "No OpenCL device";
+    std::unique_ptr<OpenCLDriver> driver = std::make_unique<OpenCLDriver>(device);
+
+    int inputW = 1920, inputH = 1080, outW = 640, outH = 360;
+    cv::Mat input(inputH, inputW, CV_8UC3);
+    cv::randu(input, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+
+    CpuBackend cpu;
+    for (ResizeFilter filter : {ResizeFilter::Bilinear, ResizeFilter::Bicubic, ResizeFilter::Lanczos, ResizeFilter::Area})
+    {
+        driver->setResizeFilter(filter);
+        cpu.setResizeFilter(filter);
+        std::vector<uint8_t> expected, actual;
+        driver->processFrame(input, expected, outW, outH);
+        cpu.processFrame(input, actual, outW, outH);
+        ASSERT_EQ(actual.size(), expected.size()) << resizeFilterName(filter);
+        for (size_t i = 0; i < expected.size(); ++i)
+            ASSERT_LE(std::abs(actual[i] - expected[i]), 1) << resizeFilterName(filter) << " at byte " << i;
+    }
+}
+
+// Test that a one-pixel checkerboard averages to flat grey under the area
+// filter, where the fast 4-tap kernel picks up the pattern
+TEST(CpuBackendTest, AreaFilterDoesNotAlias)
+{
+    int inputW = 1280, inputH = 720, outW = 320, outH = 180;
+    cv::Mat input(inputH, inputW, CV_8UC3);
+    for (int y = 0; y < inputH; ++y)
+    {
+        uint8_t *row = input.ptr<uint8_t>(y);
+        for (int x = 0; x < inputW * 3; ++x)
+            row[x] = (x / 3 + y) % 2 ? 255 : 0;
+    }
+
+    CpuBackend cpu;
+    auto lumaRange = [&](ResizeFilter filter)
+    {
+        cpu.setResizeFilter(filter);
+        std::vector<uint8_t> yuv;
+        cpu.processFrame(input, yuv, outW, outH);
+        auto luma = std::minmax_element(yuv.begin(), yuv.begin() + outW * outH);
+        return *luma.second - *luma.first;
+    };
+    EXPECT_LE(lumaRange(ResizeFilter::Area), 2);
+    EXPECT_EQ(resolveResizeFilter(ResizeFilter::Auto, inputW, inputH, outW, outH), ResizeFilter::Area);
+    EXPECT_GT(lumaRange(ResizeFilter::Fast), 100);
+}
+
+// Test that planar I420 sources are resized plane by plane without a
+// colour conversion: flat planes keep their values, and the CPU backend
+// and the resize_plane kernels agree
+TEST(CpuBackendTest, I420SourceMatchesOpenCLWithinOneLSB)
+{
+    int inputW = 1280, inputH = 720, outW = 640, outH = 360;
+    cv::Mat flat(inputH * 3 / 2, inputW, CV_8UC1);
+    flat.rowRange(0, inputH).setTo(90);
+    flat.rowRange(inputH, inputH * 3 / 2).setTo(200);
+
+    CpuBackend cpu;
+    for (ResizeFilter filter : {ResizeFilter::Fast, ResizeFilter::Area, ResizeFilter::Lanczos})
+    {
+        cpu.setResizeFilter(filter);
+        std::vector<uint8_t> yuv;
+        cpu.processFrame(flat, yuv, outW, outH);
+        ASSERT_EQ(yuv.size(), (size_t)outW * outH * 3 / 2);
+        EXPECT_TRUE(std::all_of(yuv.begin(), yuv.begin() + outW * outH, [](uint8_t v) { return v == 90; }))
+            << resizeFilterName(filter);
+        EXPECT_TRUE(std::all_of(yuv.begin() + outW * outH, yuv.end(), [](uint8_t v) { return v == 200; }))
+            << resizeFilterName(filter);
+    }
+
+    cl_device_id device = firstOpenCLDevice();
+    if (!device)
+        GTEST_SKIP() << "No OpenCL device";
+    std::unique_ptr<OpenCLDriver> driver = std::make_unique<OpenCLDriver>(device);
+
+    cv::Mat bgr(inputH, inputW, CV_8UC3), input;
+    cv::randu(bgr, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+    cv::cvtColor(bgr, input, cv::COLOR_BGR2YUV_I420);
+    for (ResizeFilter filter : {ResizeFilter::Fast, ResizeFilter::Bicubic, ResizeFilter::Area})
+    {
+        driver->setResizeFilter(filter);
+        cpu.setResizeFilter(filter);
+        std::vector<uint8_t> expected, actual;
+        driver->processFrame(input, expected, outW, outH);
+        cpu.processFrame(input, actual, outW, outH);
+        ASSERT_EQ(actual.size(), expected.size()) << resizeFilterName(filter);
+        for (size_t i = 0; i < expected.size(); ++i)
+            ASSERT_LE(std::abs(actual[i] - expected[i]), 1) << resizeFilterName(filter) << " at byte " << i;
+    }
+}
+
+// Test that coefficient tables stay inside the source and sum to one for
+// up- and downscales of every polyphase filter
+TEST(ResizeFilterTest, CoefficientTablesAreNormalized)
+{
+    for (ResizeFilter filter : {ResizeFilter::Bilinear, ResizeFilter::Bicubic, ResizeFilter::Lanczos, ResizeFilter::Area})
+    {
+        for (auto sizes : {std::make_pair(3840, 640), std::make_pair(1920, 1280), std::make_pair(640, 1920),
+                           std::make_pair(5, 3), std::make_pair(1, 4)})
+        {
+            ResizeCoefficients c = computeResizeCoefficients(sizes.first, sizes.second, filter);
+            ASSERT_EQ(c.offsets.size(), (size_t)sizes.second);
+            ASSERT_EQ(c.weights.size(), (size_t)sizes.second * c.taps);
+            for (int i = 0; i < sizes.second; ++i)
+            {
+                ASSERT_GE(c.offsets[i], 0);
+                ASSERT_LE(c.offsets[i] + c.taps, sizes.first);
+                int sum = 0;
+                for (int t = 0; t < c.taps; ++t)
+                    sum += c.weights[(size_t)i * c.taps + t];
+                ASSERT_EQ(sum, 1 << RESIZE_WEIGHT_BITS) << resizeFilterName(filter) << " " << sizes.first << "->"
+                                                         << sizes.second << " output " << i;
+            }
+        }
+    }
+
+    int outW, outH;
+    computeOutputSize(3840, 2160, 0, 360, false, outW, outH);
+    EXPECT_EQ(outW, 640);
+    EXPECT_EQ(outH, 360);
+    computeOutputSize(1920, 1080, 1000, 1000, true, outW, outH);
+    EXPECT_EQ(outW, 1000);
+    EXPECT_EQ(outH, 562);
+    computeOutputSize(1921, 1081, 0, 0, false, outW, outH);
+    EXPECT_EQ(outW, 960);
+    EXPECT_EQ(outH, 540);
+}
+
+// Test that items put out of order by several producers come out in
+// sequence, with producers running ahead of a small window blocking
+// rather than deadlocking
+TEST(ReorderBufferTest, RestoresOrderFromConcurrentProducers)
+{
+    const int producers = 4, itemsPerProducer = 1000;
+    ReorderBuffer<int> reorder(3);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+        threads.emplace_back([&reorder, p]
+                             {
+            for (int i = 0; i < itemsPerProducer; ++i) {
+                int seq = i * producers + p;
+                int value = seq;
+                reorder.put(seq, std::move(value));
+            } });
+
+    for (int expected = 0; expected < producers * itemsPerProducer; ++expected)
+    {
+        int value = -1;
+        ASSERT_TRUE(reorder.pop(value));
+        ASSERT_EQ(value, expected);
+    }
+    for (std::thread &t : threads)
+        t.join();
+}
+
+// Test that white, black and grey come out at the nominal levels of every
+// matrix and range, with neutral chroma
+TEST(ColorSpaceTest, FlatColorsMapToNominalLevels)
+{
+    int w = 64, h = 32;
+    cv::Mat input(h, w, CV_8UC3);
+    CpuBackend cpu(1);
+    for (ColorMatrix matrix : {ColorMatrix::BT601, ColorMatrix::BT709})
+    {
+        for (ColorRange range : {ColorRange::Limited, ColorRange::Full})
+        {
+            cpu.setColorSpace({matrix, range});
+            bool full = range == ColorRange::Full;
+            const int levels[][2] = {{255, full ? 255 : 235}, {0, full ? 0 : 16}, {128, full ? 128 : 126}};
+            for (const auto &level : levels)
+            {
+                input.setTo(cv::Scalar(level[0], level[0], level[0]));
+                std::vector<uint8_t> yuv;
+                cpu.processFrame(input, yuv, w, h); // same size, so no resampling
+                SCOPED_TRACE(std::string(colorMatrixName(matrix)) + "/" + colorRangeName(range));
+                EXPECT_EQ(yuv[0], level[1]);
+                EXPECT_EQ(yuv[w * h], 128);
+                EXPECT_EQ(yuv.back(), 128);
+            }
+        }
+    }
+    EXPECT_EQ(colorBuildOptions({ColorMatrix::BT709, ColorRange::Full}), "-D COLOR_MATRIX_BT709 -D COLOR_RANGE_FULL");
+    EXPECT_EQ(colorBuildOptions(ColorSpace()), "");
+}
+
+// Test that segments start on keyframes near an even split, cover every
+// frame exactly once, and collapse when keyframes are scarce
+TEST(SegmentedTranscodeTest, PlansSegmentsAtKeyframes)
+{
+    KeyframeIndex index;
+    index.frameCount = 1000;
+    for (int64_t k = 0; k < 1000; k += 48)
+        index.keyframes.push_back(k);
+
+    std::vector<Segment> plan = planSegments(index, 4);
+    ASSERT_EQ(plan.size(), 4u);
+    const int64_t expectedStarts[] = {0, 240, 480, 768};
+    int64_t next = 0;
+    for (size_t i = 0; i < plan.size(); ++i)
+    {
+        EXPECT_EQ(plan[i].startFrame, expectedStarts[i]);
+        EXPECT_EQ(plan[i].startFrame, next);
+        next = plan[i].startFrame + plan[i].frameCount;
+    }
+    EXPECT_EQ(next, index.frameCount);
+
+    KeyframeIndex sparse;
+    sparse.frameCount = 1000;
+    sparse.keyframes = {0, 900};
+    plan = planSegments(sparse, 8);
+    ASSERT_EQ(plan.size(), 2u);
+    EXPECT_EQ(plan[1].startFrame, 900);
+    EXPECT_EQ(plan[1].frameCount, 100);
+}
+
+// Test that globs, directories and manifests expand to the expected
+// input/output pairs and that colliding outputs are rejected
+TEST(BatchTest, LoadsGlobDirectoryAndManifest)
+{
+    namespace fs = std::filesystem;
+    const fs::path dir = "batch_test_inputs";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "sub");
+    for (const char *name : {"b.mp4", "a.mp4", "c.mov", "sub/a.mp4"})
+        std::ofstream(dir / name) << "x";
+
+    std::vector<BatchItem> items = loadBatch((dir / "*.mp4").string(), "out");
+    ASSERT_EQ(items.size(), 2u);
+    EXPECT_EQ(fs::path(items[0].input).filename(), "a.mp4");
+    EXPECT_EQ(fs::path(items[1].input).filename(), "b.mp4");
+    EXPECT_EQ(fs::path(items[1].output), fs::path("out") / "b.mp4");
+
+    EXPECT_EQ(loadBatch(dir.string(), "out").size(), 3u); // regular files only
+
+    const fs::path manifest = dir / "list.txt";
+    std::ofstream(manifest) << "# clips\n"
+                            << (dir / "c.mov").string() << "\n\n"
+                            << (dir / "a.mp4").string() << "\t" << (dir / "custom.mp4").string() << "\n";
+    items = loadBatch(manifest.string(), "out");
+    ASSERT_EQ(items.size(), 2u);
+    EXPECT_EQ(fs::path(items[0].output), fs::path("out") / "c.mp4");
+    EXPECT_EQ(fs::path(items[1].output), dir / "custom.mp4");
+
+    std::ofstream(manifest) << (dir / "a.mp4").string() << "\n"
+                            << (dir / "sub" / "a.mp4").string() << "\n";
+    EXPECT_THROW(loadBatch(manifest.string(), "out"), std::invalid_argument);
+    EXPECT_THROW(loadBatch((dir / "*.mp4").string(), dir.string()), std::invalid_argument);
+    EXPECT_THROW(loadBatch((dir / "*.none").string(), "out"), std::invalid_argument);
+    fs::remove_all(dir);
+}
+
+// Test that percentiles land within the bucket resolution, and that merged
+// histograms and stage lists add up
+TEST(LatencyHistogramTest, PercentilesWithinBucketResolution)
+{
+    LatencyHistogram latency;
+    EXPECT_EQ(latency.percentile(50), 0.0);
+    for (int i = 1; i <= 1000; ++i)
+        latency.record(i * 1e-4); // 0.1 .. 100 ms
+    EXPECT_EQ(latency.count(), 1000u);
+    EXPECT_DOUBLE_EQ(latency.min(), 1e-4);
+    EXPECT_DOUBLE_EQ(latency.max(), 0.1);
+    EXPECT_NEAR(latency.percentile(50), 0.050, 0.050 * 0.025);
+    EXPECT_NEAR(latency.percentile(90), 0.090, 0.090 * 0.025);
+    EXPECT_NEAR(latency.percentile(99), 0.099, 0.099 * 0.025);
+    EXPECT_DOUBLE_EQ(latency.percentile(100), 0.1);
+
+    LatencyHistogram slow;
+    slow.record(2.0);
+    latency.merge(slow);
+    EXPECT_EQ(latency.count(), 1001u);
+    EXPECT_DOUBLE_EQ(latency.max(), 2.0);
+    EXPECT_NEAR(latency.percentile(50), 0.050, 0.050 * 0.025);
+
+    StageLatencies stages = {{"decode", latency}};
+    mergeStageLatencies(stages, {{"decode", slow}, {"upload", slow}});
+    ASSERT_EQ(stages.size(), 2u);
+    EXPECT_EQ(stages[0].second.count(), 1002u);
+    EXPECT_EQ(stages[1].first, "upload");
+}
+
+// Test that the report quotes string fields, writes numbers and stage
+// percentiles, and leaves out stages with no samples
+TEST(RunReportTest, WritesFieldsAndStages)
+{
+    LatencyHistogram latency;
+    latency.record(0.002);
+    RunReport report;
+    report.set("input", "a \"b\".mp4");
+    report.set("frames", 12.0);
+    report.addStage("resize", latency);
+    report.addStage("readback", LatencyHistogram()); // empty, left out
+    std::string json = report.toJson();
+    EXPECT_NE(json.find("\"input\": \"a \\\"b\\\".mp4\""), std::string::npos) << json;
+    EXPECT_NE(json.find("\"frames\": 12"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"resize\": {\"count\": 1"), std::string::npos) << json;
+    EXPECT_EQ(json.find("readback"), std::string::npos) << json;
+    EXPECT_EQ(jsonQuote("a\nb"), "\"a\\nb\"");
+}
+
+// Test that each thread gets its own named track, that a full buffer drops
+// events and counts them, and that scopes opened while tracing is off are
+// not recorded
+TEST(TraceTest, WritesOneTrackPerThread)
+{
+    TraceScope before("before_enable", 0); // constructed while off: never recorded
+    enableTracing(4);
+    std::thread worker([]
+                       {
+        setTraceThreadName("test worker");
+        for (int frame = 0; frame < 6; ++frame)
+            TraceScope trace("step", frame); });
+    worker.join();
+    {
+        TraceScope trace("main_step");
+    }
+
+    ScopedTempFile trace("trace_test.json");
+    writeTrace(trace.path());
+    std::ifstream file(trace.path());
+    std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_NE(json.find("\"args\": {\"name\": \"test worker\"}"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"name\": \"main_step\""), std::string::npos) << json;
+    EXPECT_NE(json.find("\"args\": {\"frame\": 3}"), std::string::npos) << json;
+    EXPECT_EQ(json.find("\"frame\": 4}"), std::string::npos) << json; // buffer holds 4 events
+    EXPECT_NE(json.find("\"dropped_events\": 2"), std::string::npos) << json;
+    EXPECT_EQ(json.find("before_enable"), std::string::npos) << json;
+    file.close();
+    resetTracing(); // later tests run untraced
+    EXPECT_FALSE(tracingEnabled());
+}
+
+// Test that requests and updates survive the wire format, and that malformed
+// lines and unsendable fields are rejected
+TEST(JobServerTest, RequestsAndUpdatesRoundTrip)
+{
+    JobRequest job;
+    job.input = "/clips/in put.mp4";
+    job.output = "/out/a.mp4";
+    job.height = 720;
+    job.crf = 28;
+    job.preset = "veryfast";
+    job.priority = -2;
+    JobRequest parsed = parseJobRequest(formatJobRequest(job));
+    EXPECT_EQ(parsed.input, job.input);
+    EXPECT_EQ(parsed.output, job.output);
+    EXPECT_EQ(parsed.width, 0);
+    EXPECT_EQ(parsed.height, 720);
+    EXPECT_EQ(parsed.crf, 28);
+    EXPECT_EQ(parsed.preset, "veryfast");
+    EXPECT_EQ(parsed.priority, -2);
+    EXPECT_THROW(parseJobRequest("submit\tinput=a.mp4"), std::invalid_argument);
+    EXPECT_THROW(parseJobRequest("submit\tinput=a\toutput=b\tcrf=99"), std::invalid_argument);
+    EXPECT_THROW(parseJobRequest("submit\tinput=a\toutput=b\tpreset=warp"), std::invalid_argument);
+    job.input = "bad\tname";
+    EXPECT_THROW(formatJobRequest(job), std::invalid_argument);
+
+    JobUpdate done;
+    done.kind = JobUpdate::Kind::Done;
+    done.id = 7;
+    done.frames = 300;
+    done.seconds = 1.5;
+    done.inBytes = 1000;
+    done.outBytes = 250;
+    JobUpdate update = parseJobUpdate(formatJobUpdate(done));
+    EXPECT_EQ(update.kind, JobUpdate::Kind::Done);
+    EXPECT_EQ(update.id, 7u);
+    EXPECT_EQ(update.frames, 300u);
+    EXPECT_DOUBLE_EQ(update.seconds, 1.5);
+    EXPECT_EQ(update.outBytes, 250u);
+
+    JobUpdate failed;
+    failed.kind = JobUpdate::Kind::Failed;
+    failed.error = "ffmpeg said:\nno";
+    EXPECT_EQ(parseJobUpdate(formatJobUpdate(failed)).error, "ffmpeg said: no");
+    EXPECT_THROW(parseJobUpdate("done\t1\t2"), std::invalid_argument);
+}
+
+#ifndef _WIN32
+// Test that a job whose input cannot be opened reaches the client as
+// Queued, Started and Failed, and that a stopped server refuses connections
+TEST(JobServerTest, ReportsFailedJobsToTheClient)
+{
+    const std::string socketPath = (std::filesystem::temp_directory_path() / "job_server_test.sock").string();
+    CpuBackend backend(1);
+    JobServer server(socketPath, {&backend}, JobServerOptions());
+    EXPECT_THROW(JobServer(socketPath, {&backend}, JobServerOptions()), std::runtime_error); // already serving
+    std::thread serverThread([&] { server.run(); });
+
+    JobRequest job;
+    job.input = "does_not_exist.mp4";
+    job.output = "job_server_test_out.mp4";
+    std::vector<JobUpdate::Kind> kinds;
+    JobUpdate result = submitJob(socketPath, job, [&](const JobUpdate &update) { kinds.push_back(update.kind); });
+    EXPECT_EQ(result.kind, JobUpdate::Kind::Failed);
+    EXPECT_FALSE(result.error.empty());
+    ASSERT_GE(kinds.size(), 3u);
+    EXPECT_EQ(kinds.front(), JobUpdate::Kind::Queued);
+    EXPECT_EQ(kinds[1], JobUpdate::Kind::Started);
+
+    server.stop();
+    serverThread.join();
+    EXPECT_THROW(submitJob(socketPath, job, nullptr), std::runtime_error);
+}
+
+// Test that a client that connects and sends nothing holds up neither
+// other clients nor stop(), and that a path that is not a socket is left
+// alone
+TEST(JobServerTest, IdleClientsDoNotBlockOthers)
+{
+    CpuBackend backend(1);
+    {
+        ScopedTempFile file("job_server_test_not_a_socket");
+        std::ofstream(file.path()) << "keep me";
+        EXPECT_THROW(JobServer(file.path(), {&backend}, JobServerOptions()), std::runtime_error);
+        EXPECT_TRUE(std::filesystem::exists(file.path()));
+    }
+
+    const std::string socketPath = (std::filesystem::temp_directory_path() / "job_server_idle_test.sock").string();
+    JobServer server(socketPath, {&backend}, JobServerOptions());
+    std::thread serverThread([&] { server.run(); });
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    int idle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(::connect(idle, reinterpret_cast<const sockaddr *>(&address), sizeof(address)), 0);
+
+    // The server waits 5 s for a request line; the other client and stop()
+    // must not
+    auto t0 = std::chrono::steady_clock::now();
+    JobRequest job;
+    job.input = "does_not_exist.mp4";
+    job.output = "job_server_test_out.mp4";
+    EXPECT_EQ(submitJob(socketPath, job, nullptr).kind, JobUpdate::Kind::Failed);
+    server.stop();
+    serverThread.join();
+    EXPECT_LT(std::chrono::steady_clock::now() - t0, std::chrono::seconds(2));
+    ::close(idle);
+}
+
+// Test that a job whose backend fails mid-stream, after Started, is
+// reported as Failed and the server runs the next job on that backend
+TEST(JobServerTest, SurvivesJobsThatFailAfterStarting)
+{
+    ScopedTempFile input("job_server_test_input.avi"), output("job_server_test_out.mp4");
+    const int inputW = 320, inputH = 180, frameCount = 30;
+    if (!writeSyntheticClip(input.path(), inputW, inputH, frameCount))
+        GTEST_SKIP() << "Cannot write " << input.path();
+
+    const std::string socketPath = (std::filesystem::temp_directory_path() / "job_server_fail_test.sock").string();
+    FailingBackend backend(10);
+    JobServer server(socketPath, {&backend}, JobServerOptions());
+    std::thread serverThread([&] { server.run(); });
+
+    JobRequest job;
+    job.input = input.path();
+    job.output = output.path();
+    job.width = inputW / 2;
+    job.height = inputH / 2;
+    std::vector<JobUpdate::Kind> kinds;
+    JobUpdate result = submitJob(socketPath, job, [&](const JobUpdate &update) { kinds.push_back(update.kind); });
+    EXPECT_EQ(result.kind, JobUpdate::Kind::Failed);
+    EXPECT_EQ(result.error, "backend failed");
+    ASSERT_GE(kinds.size(), 3u);
+    EXPECT_EQ(kinds[1], JobUpdate::Kind::Started);
+
+    result = submitJob(socketPath, job, nullptr);
+    EXPECT_EQ(result.kind, JobUpdate::Kind::Done) << result.error;
+    EXPECT_EQ(result.frames, static_cast<size_t>(frameCount));
+
+    server.stop();
+    serverThread.join();
+}
+#endif
+
+// Test that saving a key again replaces its line, that entries round-trip
+// with their memory footprint, and that lines without one are ignored
+TEST(PipelineTuningTest, ProfileKeepsOneEntryPerKey)
+{
+    ScopedTempFile profile("tuning_test.profile");
+    const std::string &path = profile.path();
+    std::filesystem::remove(path);
+    const std::string key = tuningKey("cpu", 1920, 1080, 960, 540, VideoReader::PixelFormat::BGR);
+    const std::string otherKey = tuningKey("cpu", 3840, 2160, 960, 540, VideoReader::PixelFormat::BGR);
+    PipelineTuning tuning;
+    EXPECT_FALSE(loadTuning(path, key, tuning));
+
+    tuning.queueCapacity = 8;
+    tuning.workers = 2;
+    tuning.fps = 250.0;
+    tuning.memoryBytes = 96u << 20;
+    saveTuning(path, key, tuning);
+    tuning.queueCapacity = 2;
+    saveTuning(path, otherKey, tuning);
+    tuning.queueCapacity = 16;
+    tuning.workers = 1;
+    saveTuning(path, key, tuning); // replaces the first entry
+
+    PipelineTuning loaded;
+    ASSERT_TRUE(loadTuning(path, key, loaded));
+    EXPECT_EQ(loaded.queueCapacity, 16u);
+    EXPECT_EQ(loaded.workers, 1u);
+    EXPECT_DOUBLE_EQ(loaded.fps, 250.0);
+    EXPECT_EQ(loaded.memoryBytes, 96u << 20);
+    ASSERT_TRUE(loadTuning(path, otherKey, loaded));
+    EXPECT_EQ(loaded.queueCapacity, 2u);
+    EXPECT_FALSE(loadTuning(path, tuningKey("cpu", 1920, 1080, 960, 540, VideoReader::PixelFormat::I420), loaded));
+
+    std::ifstream file(path);
+    size_t lines = 0;
+    for (std::string line; std::getline(file, line);)
+        ++lines;
+    EXPECT_EQ(lines, 2u);
+    file.close();
+
+    std::ofstream(path) << key << " 8 2 250\n"; // no memory footprint
+    EXPECT_FALSE(loadTuning(path, key, loaded));
+}
+
+// Test that calibration measures every configuration, returns one of them
+// with its footprint inside the memory cap, and throws when none fits
+TEST(PipelineTuningTest, CalibrationPicksAMeasuredConfiguration)
+{
+    ScopedTempFile input("tuning_test_input.avi");
+    const int inputW = 320, inputH = 180;
+    if (!writeSyntheticClip(input.path(), inputW, inputH, 40))
+        GTEST_SKIP() << "Cannot write " << input.path();
+
+    TuningOptions options;
+    options.queueDepths = {1, 4};
+    options.workerCounts = {1, 2};
+    options.calibrationSec = 1.0;
+    size_t measured = 0;
+    options.onMeasured = [&](const PipelineTuning &) { ++measured; };
+    auto cpuBackend = [](size_t workers) { return std::make_unique<CpuBackend>(workers); };
+    PipelineTuning tuning = calibratePipeline(input.path(), inputW / 2, inputH / 2, cpuBackend, options);
+    EXPECT_EQ(measured, 4u);
+    EXPECT_GT(tuning.fps, 0.0);
+    EXPECT_TRUE(tuning.queueCapacity == 1 || tuning.queueCapacity == 4);
+    EXPECT_TRUE(tuning.workers == 1 || tuning.workers == 2);
+    EXPECT_GT(tuning.memoryBytes, 0u);
+    EXPECT_LE(tuning.memoryBytes, options.memoryCap);
+
+    options.memoryCap = 1024; // not even one source frame
+    EXPECT_THROW(calibratePipeline(input.path(), inputW / 2, inputH / 2, cpuBackend, options), std::runtime_error);
+}